@@ -0,0 +1,425 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bkpt_table.h"
+#include "mi_raw.h"
+
+static bkpt_t **num_buckets;
+static int num_size, bkpt_count;
+static bkpt_loc_t **loc_buckets;
+static int loc_size, loc_count;
+
+/*
+ * Commands that change breakpoints without a notification to us, with
+ * the shortest abbreviation gdb takes for each: "i r" is info, not
+ * ignore, and "sh" is shell.
+ */
+static const struct {
+	const char *name;
+	int min_len;
+} bkpt_changing_cmds[] = {
+	{"break", 1}, {"tbreak", 2}, {"hbreak", 2}, {"thbreak", 3},
+	{"rbreak", 2}, {"delete", 1}, {"clear", 2}, {"enable", 2},
+	{"disable", 3}, {"condition", 4}, {"ignore", 2}, {"watch", 2},
+	{"rwatch", 2}, {"awatch", 2}, {"dprintf", 2}, {"source", 2},
+	{"file", 3}, {"exec-file", 4}, {"symbol-file", 3},
+	{"add-symbol-file", 5}, {"sharedlibrary", 3}, {NULL, 0}
+};
+
+static unsigned int loc_hash(const char *file, int line)
+{
+	return (mi_raw_hash(file) ^ line) * 16777619u;
+}
+
+/* Both tables are kept at most one entry per bucket on average */
+static int grow_num_buckets(void)
+{
+	bkpt_t **new_buckets, *bp, *next;
+	int new_size = num_size ? num_size * 2 : BKPT_HASH_MIN;
+	int i;
+
+	new_buckets = (bkpt_t **)calloc(new_size, sizeof(bkpt_t *));
+	if (!new_buckets) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return -1;
+	}
+	for (i = 0; i < num_size; i++) {
+		for (bp = num_buckets[i]; bp; bp = next) {
+			next = bp->hnext;
+			bp->hnext = new_buckets[bp->number & (new_size - 1)];
+			new_buckets[bp->number & (new_size - 1)] = bp;
+		}
+	}
+	free(num_buckets);
+	num_buckets = new_buckets;
+	num_size = new_size;
+
+	return 0;
+}
+
+static int grow_loc_buckets(void)
+{
+	bkpt_loc_t **new_buckets, *loc, *next;
+	int new_size = loc_size ? loc_size * 2 : BKPT_HASH_MIN;
+	unsigned int h;
+	int i;
+
+	new_buckets = (bkpt_loc_t **)calloc(new_size, sizeof(bkpt_loc_t *));
+	if (!new_buckets) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return -1;
+	}
+	for (i = 0; i < loc_size; i++) {
+		for (loc = loc_buckets[i]; loc; loc = next) {
+			next = loc->hnext;
+			h = loc_hash(loc->file, loc->line) & (new_size - 1);
+			loc->hnext = new_buckets[h];
+			new_buckets[h] = loc;
+		}
+	}
+	free(loc_buckets);
+	loc_buckets = new_buckets;
+	loc_size = new_size;
+
+	return 0;
+}
+
+static void unlink_loc(bkpt_loc_t *loc)
+{
+	bkpt_loc_t **pp;
+
+	pp = &loc_buckets[loc_hash(loc->file, loc->line) & (loc_size - 1)];
+	for (; *pp; pp = &(*pp)->hnext) {
+		if (*pp == loc) {
+			*pp = loc->hnext;
+			loc_count--;
+			return;
+		}
+	}
+}
+
+static void free_bkpt(bkpt_t *bp)
+{
+	int i;
+
+	for (i = 0; i < bp->nlocs; i++) {
+		if (!bp->locs[i].file)
+			continue;
+		unlink_loc(&bp->locs[i]);
+		free(bp->locs[i].file);
+	}
+	free(bp->locs);
+	free(bp->type);
+	free(bp->addr);
+	free(bp->func);
+	free(bp->cond);
+	free(bp->what);
+	free(bp);
+}
+
+static char *dup_or_null(const char *str)
+{
+	char *dup;
+
+	if (!str)
+		return NULL;
+	if (!(dup = strdup(str)))
+		fprintf(stderr, "Cannot allocate memory\n");
+
+	return dup;
+}
+
+/*
+ * A location without a file, e.g. in a library without debug
+ * information, is kept but not hashed.
+ */
+static void set_loc(bkpt_loc_t *loc, bkpt_t *bp, bkpt_info_t *bi)
+{
+	unsigned int h;
+
+	loc->bp = bp;
+	loc->line = bi->line;
+	loc->enabled = bi->enabled;
+	if (!bi->file || !(loc->file = strdup(bi->file)))
+		return;
+
+	if (loc_count >= loc_size && grow_loc_buckets() < 0) {
+		free(loc->file);
+		loc->file = NULL;
+		return;
+	}
+	h = loc_hash(loc->file, loc->line) & (loc_size - 1);
+	loc->hnext = loc_buckets[h];
+	loc_buckets[h] = loc;
+	loc_count++;
+}
+
+/* A breakpoint as gdb describes it now, the old one is replaced */
+static void update_bkpt(bkpt_info_t *bi)
+{
+	bkpt_info_t *li;
+	bkpt_t *bp;
+	int i;
+
+	bkpt_table_delete(bi->number);
+	if (bkpt_count >= num_size && grow_num_buckets() < 0)
+		return;
+	if (!(bp = (bkpt_t *)calloc(1, sizeof(bkpt_t)))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return;
+	}
+	bp->number = bi->number;
+	bp->temporary = bi->temporary;
+	bp->enabled = bi->enabled;
+	bp->times = bi->times;
+	bp->type = dup_or_null(bi->type);
+	bp->addr = dup_or_null(bi->addr);
+	bp->func = dup_or_null(bi->func);
+	bp->cond = dup_or_null(bi->cond);
+	bp->what = dup_or_null(bi->what);
+
+	/* Several locations come in locs, a single one in bi itself */
+	if (bi->locs)
+		for (li = bi->locs; li; li = li->next)
+			bp->nlocs++;
+	else if (bi->file)
+		bp->nlocs = 1;
+	if (bp->nlocs && !(bp->locs = (bkpt_loc_t *)calloc(bp->nlocs,
+						sizeof(bkpt_loc_t)))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		bp->nlocs = 0;
+	}
+	if (bi->locs)
+		for (li = bi->locs, i = 0; li && i < bp->nlocs; li = li->next)
+			set_loc(&bp->locs[i++], bp, li);
+	else if (bp->nlocs)
+		set_loc(&bp->locs[0], bp, bi);
+
+	bp->hnext = num_buckets[bp->number & (num_size - 1)];
+	num_buckets[bp->number & (num_size - 1)] = bp;
+	bkpt_count++;
+}
+
+/* The changes of mi_get_bkpt_changes, in the order gdb made them */
+void bkpt_table_apply(bkpt_info_t *changes)
+{
+	for (; changes; changes = changes->next) {
+		if (changes->deleted)
+			bkpt_table_delete(changes->number);
+		else
+			update_bkpt(changes);
+	}
+}
+
+/* The whole table of -break-list replaces what we have */
+void bkpt_table_load(bkpt_info_t *list)
+{
+	bkpt_table_clear();
+	for (; list; list = list->next)
+		update_bkpt(list);
+}
+
+void bkpt_table_delete(int number)
+{
+	bkpt_t **pp, *bp;
+
+	if (!num_size)
+		return;
+	for (pp = &num_buckets[number & (num_size - 1)]; bp = *pp;
+	     pp = &bp->hnext) {
+		if (bp->number == number) {
+			*pp = bp->hnext;
+			free_bkpt(bp);
+			bkpt_count--;
+			return;
+		}
+	}
+}
+
+void bkpt_table_clear(void)
+{
+	bkpt_t *bp, *next;
+	int i;
+
+	for (i = 0; i < num_size; i++) {
+		for (bp = num_buckets[i]; bp; bp = next) {
+			next = bp->hnext;
+			free_bkpt(bp);
+		}
+		num_buckets[i] = NULL;
+	}
+	bkpt_count = 0;
+}
+
+bkpt_t *bkpt_table_find(int number)
+{
+	bkpt_t *bp;
+
+	if (!num_size)
+		return NULL;
+	for (bp = num_buckets[number & (num_size - 1)]; bp; bp = bp->hnext)
+		if (bp->number == number)
+			return bp;
+
+	return NULL;
+}
+
+/* Numbers of the breakpoints with a location at file:line */
+int bkpt_table_at(const char *file, int line, int *numbers, int max)
+{
+	bkpt_loc_t *loc;
+	int i, n = 0;
+
+	if (!loc_size)
+		return 0;
+	loc = loc_buckets[loc_hash(file, line) & (loc_size - 1)];
+	for (; loc && n < max; loc = loc->hnext) {
+		if (loc->line != line || strcmp(loc->file, file))
+			continue;
+		for (i = 0; i < n && numbers[i] != loc->bp->number; i++)
+			;
+		if (i == n)
+			numbers[n++] = loc->bp->number;
+	}
+
+	return n;
+}
+
+/* "LINE NUMBER ENABLED\n" for each location in file, where signs go */
+void bkpt_table_file_lines(const char *file, strbuf_t *sb)
+{
+	bkpt_t *bp;
+	int i, j;
+
+	for (i = 0; i < num_size; i++)
+		for (bp = num_buckets[i]; bp; bp = bp->hnext)
+			for (j = 0; j < bp->nlocs; j++)
+				if (bp->locs[j].file &&
+				    !strcmp(bp->locs[j].file, file))
+					strbuf_printf(sb, "%d %d %d\n",
+						bp->locs[j].line, bp->number,
+						bp->enabled &&
+						bp->locs[j].enabled);
+}
+
+static int cmp_bkpt(const void *a, const void *b)
+{
+	return (*(bkpt_t **)a)->number - (*(bkpt_t **)b)->number;
+}
+
+static const char *base_name(const char *path)
+{
+	const char *s = strrchr(path, '/');
+
+	return s ? s + 1 : path;
+}
+
+/* Laid out as "info breakpoints" does */
+static void print_bkpt(bkpt_t *bp)
+{
+	int i;
+
+	printf("%-7d %-14s %-4s %-3s %-18s ", bp->number,
+	       bp->type ? bp->type : "breakpoint",
+	       bp->temporary ? "del" : "keep", bp->enabled ? "y" : "n",
+	       bp->nlocs > 1 ? "<MULTIPLE>" : bp->addr ? bp->addr : "");
+	if (bp->nlocs == 1 && bp->locs[0].file && bp->func)
+		printf("in %s at %s:%d\n", bp->func,
+		       base_name(bp->locs[0].file), bp->locs[0].line);
+	else if (bp->nlocs == 1 && bp->locs[0].file)
+		printf("at %s:%d\n", base_name(bp->locs[0].file),
+		       bp->locs[0].line);
+	else
+		printf("%s\n", bp->what ? bp->what : "");
+	if (bp->cond)
+		printf("\tstop only if %s\n", bp->cond);
+	if (bp->times)
+		printf("\tbreakpoint already hit %d time%s\n", bp->times,
+		       bp->times == 1 ? "" : "s");
+	if (bp->nlocs < 2)
+		return;
+	for (i = 0; i < bp->nlocs; i++)
+		printf("%d.%-5d %-19s %-3s %-18s at %s:%d\n", bp->number,
+		       i + 1, "", bp->locs[i].enabled ? "y" : "n", "",
+		       bp->locs[i].file ? base_name(bp->locs[i].file) : "??",
+		       bp->locs[i].line);
+}
+
+void bkpt_table_print(void)
+{
+	bkpt_t **all, *bp;
+	int i, n = 0;
+
+	if (!bkpt_count) {
+		printf("No breakpoints or watchpoints.\n");
+		return;
+	}
+	if (!(all = (bkpt_t **)malloc(bkpt_count * sizeof(bkpt_t *)))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return;
+	}
+	for (i = 0; i < num_size; i++)
+		for (bp = num_buckets[i]; bp; bp = bp->hnext)
+			all[n++] = bp;
+	qsort(all, n, sizeof(bkpt_t *), cmp_bkpt);
+
+	printf("Num     Type           Disp Enb Address            What\n");
+	for (i = 0; i < n; i++)
+		print_bkpt(all[i]);
+	free(all);
+}
+
+int bkpt_table_count(void)
+{
+	return bkpt_count;
+}
+
+/*
+ * Before gdb/mi 3 a breakpoint with several locations comes as
+ *
+ *	bkpt={number="1",...,addr="<MULTIPLE>"},{number="1.1",...},...
+ *
+ * which the grammar does not take. It is rewritten the way gdb/mi 3
+ * and later give it, bkpt={number="1",...,locations=[{...},...]}.
+ * Returns str, or the rewritten copy in a buffer of its own.
+ */
+char *bkpt_fold_locations(char *str)
+{
+	static strbuf_t sb;
+	const char *from, *p, *end, *q, *next;
+
+	if (!strstr(str, "},{number=\""))
+		return str;
+	strbuf_reset(&sb);
+	for (from = str; (p = strstr(from, "bkpt={")); from = q) {
+		if (!(end = mi_raw_end(p + 5)))
+			break;
+		for (q = end; q[0] == ',' && q[1] == '{' &&
+		     (next = mi_raw_end(q + 1)); q = next)
+			;
+		if (q == end) {
+			strbuf_append(&sb, from, end - from);
+			continue;
+		}
+		/* The closing brace goes after the locations */
+		strbuf_append(&sb, from, end - 1 - from);
+		strbuf_puts(&sb, ",locations=[");
+		strbuf_append(&sb, end + 1, q - end - 1);
+		strbuf_puts(&sb, "]}");
+	}
+	strbuf_puts(&sb, from);
+
+	return sb.str;
+}
+
+int bkpt_cmd_changes(const char *cmd, int cmd_len)
+{
+	int i;
+
+	for (i = 0; bkpt_changing_cmds[i].name; i++)
+		if (cmd_len >= bkpt_changing_cmds[i].min_len &&
+		    !strncmp(bkpt_changing_cmds[i].name, cmd, cmd_len))
+			return 1;
+
+	return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef __BKPT_TABLE_H__
+#define __BKPT_TABLE_H__
+
+#include "mi_parser.h"
+#include "strbuf.h"
+
+/*
+ * A mirror of gdb's breakpoint table, kept up to date from the
+ * =breakpoint-* notifications and the replies of -break-insert, and
+ * loaded whole from -break-list only when a gdb/cli command may have
+ * changed it. Breakpoints are hashed by number, their locations by
+ * file:line, so listing them or telling Vim where the signs go costs
+ * no round trip to gdb however many there are.
+ */
+struct bkpt;
+
+typedef struct bkpt_loc {
+	struct bkpt *bp;
+	char *file;
+	int line;
+	int enabled;
+	struct bkpt_loc *hnext;	/* in its file:line bucket */
+} bkpt_loc_t;
+
+typedef struct bkpt {
+	int number;
+	char *type;
+	int temporary;
+	int enabled;
+	char *addr;
+	char *func;
+	char *cond;
+	int times;
+	char *what;
+	int nlocs;
+	bkpt_loc_t *locs;
+	struct bkpt *hnext;	/* in its number bucket */
+} bkpt_t;
+
+#define BKPT_HASH_MIN	64
+
+/* Function prototypes */
+void bkpt_table_apply(bkpt_info_t *changes);
+void bkpt_table_load(bkpt_info_t *list);
+void bkpt_table_delete(int number);
+void bkpt_table_clear(void);
+bkpt_t *bkpt_table_find(int number);
+int bkpt_table_at(const char *file, int line, int *numbers, int max);
+void bkpt_table_file_lines(const char *file, strbuf_t *sb);
+void bkpt_table_print(void);
+int bkpt_table_count(void);
+int bkpt_cmd_changes(const char *cmd, int cmd_len);
+char *bkpt_fold_locations(char *str);
+
+#endif /* __BKPT_TABLE_H__ */
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cmd_queue.h"
+
+/* line may be NULL, e.g. for a bare prompt expected from gdb */
+cmd_entry_t *cmd_queue_push(cmd_queue_t *q, const char *line, int len,
+			    gdb_state_t state)
+{
+	cmd_entry_t *e;
+
+	if (!(e = (cmd_entry_t *)calloc(1, sizeof(cmd_entry_t)))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return NULL;
+	}
+	if (line && !(e->line = strdup(line))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		free(e);
+		return NULL;
+	}
+	e->len = len;
+	e->state = state;
+
+	if (q->tail)
+		q->tail->next = e;
+	else
+		q->head = e;
+	q->tail = e;
+	q->count++;
+
+	return e;
+}
+
+/* The caller owns the entry and frees it with free_cmd_entry */
+cmd_entry_t *cmd_queue_pop(cmd_queue_t *q)
+{
+	cmd_entry_t *e = q->head;
+
+	if (!e)
+		return NULL;
+
+	q->head = e->next;
+	if (!q->head)
+		q->tail = NULL;
+	q->count--;
+	e->next = NULL;
+
+	return e;
+}
+
+void cmd_queue_clear(cmd_queue_t *q)
+{
+	cmd_entry_t *e;
+
+	while (e = cmd_queue_pop(q))
+		free_cmd_entry(e);
+}
+
+void free_cmd_entry(cmd_entry_t *e)
+{
+	if (e->line)
+		free(e->line);
+	free(e);
+}
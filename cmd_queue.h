@@ -0,0 +1,37 @@
+#ifndef __CMD_QUEUE_H__
+#define __CMD_QUEUE_H__
+
+#include "gdbvim.h"
+
+/*
+ * A line waiting to be sent to gdb or whose reply is being waited for.
+ * state tells how its reply is to be read, len is the length of the
+ * echo gdb sends back and line is what the user typed, if anything.
+ * A command gdbvim sends for itself has a handler; its reply is given
+ * to the handler with tag, e.g. the id of a request from Vim, and is
+ * not shown.
+ */
+typedef struct cmd_entry {
+	char *line;
+	int len;
+	gdb_state_t state;
+	const struct gdb_mi_cmd *mi_cmd;
+	void (*handler)(char *reply, long tag);
+	long tag;
+	struct cmd_entry *next;
+} cmd_entry_t;
+
+typedef struct cmd_queue {
+	cmd_entry_t *head;
+	cmd_entry_t *tail;
+	int count;
+} cmd_queue_t;
+
+/* Function prototypes */
+cmd_entry_t *cmd_queue_push(cmd_queue_t *q, const char *line, int len,
+			    gdb_state_t state);
+cmd_entry_t *cmd_queue_pop(cmd_queue_t *q);
+void cmd_queue_clear(cmd_queue_t *q);
+void free_cmd_entry(cmd_entry_t *e);
+
+#endif /* __CMD_QUEUE_H__ */
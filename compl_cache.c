@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "compl_cache.h"
+
+#define COMPL_CACHE_SIZE	8
+
+static compl_entry_t compl_cache[COMPL_CACHE_SIZE];
+static unsigned long compl_stamp;
+
+/*
+ * Commands after which cached completions may be wrong: new symbols,
+ * another scope for locals etc. They are matched as whole words, with
+ * gdb's own aliases for them; one letter such as "s" or "b" stands for
+ * far more commands that do not change them.
+ */
+static const char *compl_invalidating_cmds[] = {
+	"file", "symbol-file", "add-symbol-file", "sharedlibrary",
+	"core-file", "attach", "detach", "kill", "k", "load", "frame", "f",
+	"up", "down", "select-frame", "thread", "t", "inferior", "target",
+	NULL
+};
+
+static void free_compl_entry(compl_entry_t *e)
+{
+	free(e->prefix);
+	free(e->cands);
+	free(e->pool);
+	memset(e, 0, sizeof(compl_entry_t));
+}
+
+static int compare_cands(const void *a, const void *b)
+{
+	return strcmp(*(char **)a, *(char **)b);
+}
+
+/*
+ * reply is the output of "server complete <prefix>" without the echo:
+ *
+ *	break main\n
+ *	break malloc\n
+ *	*** List may be truncated, max-completions reached. ***\n
+ *	(gdb)[space]
+ */
+compl_entry_t *compl_cache_store(const char *prefix, char *reply)
+{
+	compl_entry_t *e, *victim = &compl_cache[0];
+	char *line, *end;
+	int i, n, len;
+
+	/* Same prefix again or the least recently used one is replaced */
+	for (i = 0; i < COMPL_CACHE_SIZE; i++) {
+		e = &compl_cache[i];
+		if (e->prefix && !strcmp(e->prefix, prefix)) {
+			victim = e;
+			break;
+		}
+		if (!e->prefix || e->stamp < victim->stamp)
+			victim = e;
+	}
+	e = victim;
+	if (e->prefix)
+		free_compl_entry(e);
+
+	len = strlen(reply);
+	e->prefix = strdup(prefix);
+	e->pool = (char *)malloc(len + 1);
+	/* Not more candidates than newlines */
+	for (n = 0, line = reply; line = strchr(line, '\n'); line++)
+		n++;
+	e->cands = (char **)malloc((n + 1) * sizeof(char *));
+	if (!e->prefix || !e->pool || !e->cands) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		free_compl_entry(e);
+		return NULL;
+	}
+	e->prefix_len = strlen(prefix);
+	memcpy(e->pool, reply, len + 1);
+
+	for (line = e->pool; *line; line = end + 1) {
+		if (!(end = strchr(line, '\n')))
+			break;
+		*end = '\0';
+		if (end > line && end[-1] == '\r')
+			end[-1] = '\0';
+		if (!strncmp(line, "*** List may be truncated", 25)) {
+			e->truncated = 1;
+			continue;
+		}
+		if (*line)
+			e->cands[e->ncands++] = line;
+	}
+
+	qsort(e->cands, e->ncands, sizeof(char *), compare_cands);
+	/* Duplicates are dropped */
+	for (i = 1, n = e->ncands ? 1 : 0; i < e->ncands; i++)
+		if (strcmp(e->cands[i], e->cands[n - 1]))
+			e->cands[n++] = e->cands[i];
+	e->ncands = n;
+	e->stamp = ++compl_stamp;
+
+	return e;
+}
+
+/*
+ * An entry serves a line starting with its prefix if the rest of the
+ * line does not start a new word; completions of "b ma" cover "b mall"
+ * but not "b main if". A truncated list only serves its own prefix.
+ */
+compl_entry_t *compl_cache_lookup(const char *line)
+{
+	compl_entry_t *e, *best = NULL;
+	const char *c;
+	int i;
+
+	for (i = 0; i < COMPL_CACHE_SIZE; i++) {
+		e = &compl_cache[i];
+		if (!e->prefix || strncmp(line, e->prefix, e->prefix_len))
+			continue;
+		if (e->truncated && line[e->prefix_len])
+			continue;
+		for (c = line + e->prefix_len; *c; c++)
+			if (!isalnum((unsigned char)*c) && *c != '_')
+				break;
+		if (*c)
+			continue;
+		if (!best || e->prefix_len > best->prefix_len)
+			best = e;
+	}
+	if (best)
+		best->stamp = ++compl_stamp;
+
+	return best;
+}
+
+/*
+ * Finds the candidates starting with line. Returns their number and
+ * the index of the first one in first.
+ */
+int compl_cache_range(compl_entry_t *e, const char *line, int *first)
+{
+	int len = strlen(line);
+	int lo, hi, mid, start;
+
+	/* First candidate not less than line */
+	lo = 0;
+	hi = e->ncands;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (strcmp(e->cands[mid], line) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	start = lo;
+
+	/* First candidate past the ones starting with line */
+	hi = e->ncands;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (strncmp(e->cands[mid], line, len) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*first = start;
+	return lo - start;
+}
+
+int compl_cache_cmd_invalidates(const char *cmd, size_t cmd_len)
+{
+	int i;
+
+	for (i = 0; compl_invalidating_cmds[i]; i++)
+		if (strlen(compl_invalidating_cmds[i]) == cmd_len &&
+		    !strncmp(compl_invalidating_cmds[i], cmd, cmd_len))
+			return 1;
+
+	return 0;
+}
+
+void compl_cache_invalidate(void)
+{
+	int i;
+
+	for (i = 0; i < COMPL_CACHE_SIZE; i++)
+		if (compl_cache[i].prefix)
+			free_compl_entry(&compl_cache[i]);
+}
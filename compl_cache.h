@@ -0,0 +1,28 @@
+#ifndef __COMPL_CACHE_H__
+#define __COMPL_CACHE_H__
+
+#include <sys/types.h>
+
+/*
+ * Completions of a line as listed by "server complete <line>". The
+ * candidates are whole lines, sorted, so the ones starting with a
+ * longer line are a contiguous range found by binary search.
+ */
+typedef struct compl_entry {
+	char *prefix;
+	int prefix_len;
+	char **cands;
+	int ncands;
+	int truncated;		/* gdb hit max-completions */
+	char *pool;		/* the candidate strings */
+	unsigned long stamp;	/* for LRU eviction */
+} compl_entry_t;
+
+/* Function prototypes */
+compl_entry_t *compl_cache_store(const char *prefix, char *reply);
+compl_entry_t *compl_cache_lookup(const char *line);
+int compl_cache_range(compl_entry_t *e, const char *line, int *first);
+int compl_cache_cmd_invalidates(const char *cmd, size_t cmd_len);
+void compl_cache_invalidate(void);
+
+#endif /* __COMPL_CACHE_H__ */
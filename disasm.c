@@ -0,0 +1,383 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "disasm.h"
+#include "strbuf.h"
+#include "slot_cache.h"
+
+static disasm_range_t ranges[DISASM_RANGES_MAX];
+/* Ranges are asked by their first address */
+static slot_cache_t cache = {
+	.slots = DISASM_RANGES_MAX,
+	.asked_max = DISASM_ASKED_MAX
+};
+static int insns_kept;
+static unsigned long da_fetched, da_insns, da_shown, da_evicted;
+/* The instructions of a reply, and their text, before they are kept */
+static disasm_insn_t *scratch;
+static int *scratch_offs;
+static int scratch_size;
+static strbuf_t text;
+
+static void free_range(disasm_range_t *r)
+{
+	insns_kept -= r->count;
+	free(r->insns);
+	free(r->text);
+	r->insns = NULL;
+	r->text = NULL;
+	r->count = 0;
+	slot_cache_free(&cache, r - ranges);
+}
+
+void disasm_clear(void)
+{
+	int i;
+
+	for (i = 0; i < DISASM_RANGES_MAX; i++)
+		if (ranges[i].insns)
+			free_range(&ranges[i]);
+	slot_cache_clear(&cache);
+}
+
+/* The index of the first instruction of r at or past addr */
+static int insn_index(const disasm_range_t *r, unsigned long addr)
+{
+	int lo = 0, hi = r->count, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (r->insns[mid].addr < addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* The instruction starting at addr, NULL if no range has it */
+static disasm_insn_t *lookup(unsigned long addr)
+{
+	disasm_range_t *r;
+	int i, k;
+
+	for (i = 0; i < DISASM_RANGES_MAX; i++) {
+		r = &ranges[i];
+		if (!r->insns || addr < r->lo || addr >= r->hi)
+			continue;
+		k = insn_index(r, addr);
+		if (k < r->count && r->insns[k].addr == addr) {
+			slot_cache_touch(&cache, i);
+			return &r->insns[k];
+		}
+	}
+
+	return NULL;
+}
+
+/* The instruction ending at addr */
+static disasm_insn_t *lookup_before(unsigned long addr)
+{
+	disasm_range_t *r;
+	disasm_insn_t *insn;
+	int i, k;
+
+	for (i = 0; i < DISASM_RANGES_MAX; i++) {
+		r = &ranges[i];
+		if (!r->insns || addr <= r->lo || addr > r->hi)
+			continue;
+		if (!(k = insn_index(r, addr)))
+			continue;
+		insn = &r->insns[k - 1];
+		if (insn->addr + insn->len == addr) {
+			slot_cache_touch(&cache, i);
+			return insn;
+		}
+	}
+
+	return NULL;
+}
+
+disasm_insn_t *disasm_find(unsigned long addr)
+{
+	return lookup(addr);
+}
+
+/*
+ * Where n instructions from addr end, or where the kept code does if
+ * that is before; *count tells how many instructions there were.
+ */
+unsigned long disasm_walk(unsigned long addr, int n, int *count)
+{
+	disasm_insn_t *insn;
+	int k;
+
+	for (k = 0; k < n && (insn = lookup(addr)); k++)
+		addr = insn->addr + insn->len;
+	*count = k;
+
+	return addr;
+}
+
+/* The same going back: where the n instructions before addr start */
+unsigned long disasm_back(unsigned long addr, int n, int *count)
+{
+	disasm_insn_t *insn;
+	int k;
+
+	for (k = 0; k < n && (insn = lookup_before(addr)); k++)
+		addr = insn->addr;
+	*count = k;
+
+	return addr;
+}
+
+/* 1 if the code from addr is to be asked: neither kept nor asked */
+int disasm_ask(unsigned long addr)
+{
+	return !lookup(addr) && slot_cache_ask(&cache, addr);
+}
+
+/*
+ * Reads key="value" at s, as gdb/mi quotes it; returns what follows the
+ * closing quote, NULL if s is not such a field.
+ */
+static const char *next_field(const char *s, char *key, int key_size,
+			      char *val, int val_size)
+{
+	int n = 0;
+
+	for (; *s && *s != '=' && *s != ',' && *s != '}'; s++)
+		if (n < key_size - 1)
+			key[n++] = *s;
+	key[n] = '\0';
+	if (s[0] != '=' || s[1] != '"')
+		return NULL;
+	for (s += 2, n = 0; *s && *s != '"'; s++) {
+		if (*s == '\\' && s[1]) {
+			s++;
+			if (n < val_size - 1)
+				val[n++] = *s == 't' ? '\t' :
+					   *s == 'n' ? '\n' : *s;
+			continue;
+		}
+		if (n < val_size - 1)
+			val[n++] = *s;
+	}
+	val[n] = '\0';
+
+	return *s ? s + 1 : NULL;
+}
+
+/* The bytes of "48 83 ec 10" */
+static int opcode_bytes(const char *s)
+{
+	int digits = 0;
+
+	for (; *s; s++)
+		if (isxdigit((unsigned char)*s))
+			digits++;
+
+	return digits / 2;
+}
+
+static int grow_scratch(int n)
+{
+	disasm_insn_t *insns;
+	int *offs;
+	int size = scratch_size ? scratch_size * 2 : 1024;
+
+	if (n < scratch_size)
+		return 0;
+	insns = (disasm_insn_t *)realloc(scratch, size * sizeof(*insns));
+	if (insns)
+		scratch = insns;
+	offs = (int *)realloc(scratch_offs, size * sizeof(*offs));
+	if (offs)
+		scratch_offs = offs;
+	if (!insns || !offs) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return -1;
+	}
+	scratch_size = size;
+
+	return 0;
+}
+
+/*
+ * Reads the instructions of the reply into scratch, one record at a
+ * time; they end at the first one not following the one before.
+ * Returns how many there are.
+ */
+static int read_insns(const char *s)
+{
+	char key[32], val[DISASM_NAME_MAX];
+	char func[DISASM_NAME_MAX], inst[DISASM_NAME_MAX];
+	disasm_insn_t *insn, *prev;
+	int n = 0;
+
+	strbuf_reset(&text);
+	if (!(s = strstr(s, "asm_insns=[")))
+		return 0;
+	for (s += 11; *s == '{'; n++) {
+		if (grow_scratch(n) < 0)
+			break;
+		insn = &scratch[n];
+		insn->addr = 0;
+		insn->len = 0;
+		insn->offset = -1;
+		func[0] = inst[0] = '\0';
+		for (s++; *s != '}'; ) {
+			if (!(s = next_field(s, key, sizeof(key), val,
+					     sizeof(val))))
+				return n;
+			if (!strcmp(key, "address"))
+				insn->addr = strtoul(val, NULL, 0);
+			else if (!strcmp(key, "func-name"))
+				strcpy(func, val);
+			else if (!strcmp(key, "offset"))
+				insn->offset = atoi(val);
+			else if (!strcmp(key, "opcodes"))
+				insn->len = opcode_bytes(val);
+			else if (!strcmp(key, "inst"))
+				strcpy(inst, val);
+			if (*s == ',')
+				s++;
+		}
+		prev = n ? &scratch[n - 1] : NULL;
+		if (prev && prev->addr + prev->len != insn->addr) {
+			/* Without the opcodes, the next one tells the length */
+			if (prev->len || insn->addr <= prev->addr)
+				break;
+			prev->len = insn->addr - prev->addr;
+		}
+		scratch_offs[n] = text.len;
+		if (*func)
+			strbuf_printf(&text, " <%s+%d>:\t%s", func,
+				      insn->offset < 0 ? 0 : insn->offset,
+				      inst);
+		else
+			strbuf_printf(&text, ":\t%s", inst);
+		strbuf_putc(&text, '\0');
+		if (*++s == ',')
+			s++;
+	}
+	/* The last one's length is not known without its opcodes */
+	if (n && !scratch[n - 1].len)
+		n--;
+
+	return n;
+}
+
+/* A free slot, or the one looked at least recently */
+static disasm_range_t *get_slot(void)
+{
+	disasm_range_t *r = &ranges[slot_cache_pick(&cache)];
+
+	if (r->insns) {
+		free_range(r);
+		da_evicted++;
+	}
+
+	return r;
+}
+
+static void evict_oldest(void)
+{
+	int i;
+
+	if ((i = slot_cache_oldest(&cache)) >= 0) {
+		free_range(&ranges[i]);
+		da_evicted++;
+	}
+}
+
+/*
+ * Keeps the reply of "-data-disassemble -s ADDR -e END -- 2" as the
+ * range from ADDR, read as it comes:
+ *
+ *	^done,asm_insns=[{address="0x401136",func-name="main",offset="4",
+ *			  opcodes="48 83 ec 10",inst="sub $0x10,%rsp"},...]
+ *
+ * The ranges it covers whole are dropped. Returns the number of
+ * instructions kept, -1 on error.
+ */
+int disasm_store(unsigned long addr, const char *reply)
+{
+	disasm_range_t *r;
+	int i, first = 0, n;
+	unsigned long hi;
+
+	if (!slot_cache_take(&cache, addr))
+		return 0;
+	if (strncmp(reply, "^done", 5))
+		return -1;
+	if (!(n = read_insns(reply)))
+		return 0;
+	/* A huge function asked from its start: the end is looked at */
+	if (n > DISASM_INSNS_MAX)
+		first = n - DISASM_INSNS_MAX;
+	addr = scratch[first].addr;
+	hi = scratch[n - 1].addr + scratch[n - 1].len;
+	for (i = 0; i < DISASM_RANGES_MAX; i++)
+		if (ranges[i].insns && ranges[i].lo >= addr &&
+		    ranges[i].hi <= hi)
+			free_range(&ranges[i]);
+	while (insns_kept + n - first > DISASM_INSNS_MAX)
+		evict_oldest();
+
+	r = get_slot();
+	r->insns = (disasm_insn_t *)malloc((n - first) * sizeof(*r->insns));
+	r->text = (char *)malloc(text.len);
+	if (!r->insns || !r->text) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		free_range(r);
+		return -1;
+	}
+	memcpy(r->text, text.str, text.len);
+	for (i = first; i < n; i++) {
+		r->insns[i - first] = scratch[i];
+		r->insns[i - first].text = r->text + scratch_offs[i];
+	}
+	r->lo = addr;
+	r->hi = hi;
+	r->count = n - first;
+	slot_cache_touch(&cache, r - ranges);
+	insns_kept += r->count;
+	da_fetched++;
+	da_insns += r->count;
+
+	return r->count;
+}
+
+/* n instructions from addr, as x/i shows them, pc marked */
+void disasm_print(unsigned long addr, int n, unsigned long pc)
+{
+	disasm_insn_t *insn;
+	int k;
+
+	for (k = 0; k < n && (insn = lookup(addr)); k++) {
+		printf("%s0x%016lx%s\n", addr == pc ? "=> " : "   ", addr,
+		       insn->text);
+		addr += insn->len;
+	}
+	if (k)
+		da_shown++;
+	else
+		printf("Cannot disassemble at 0x%lx.\n", addr);
+}
+
+void disasm_print_stats(void)
+{
+	int i, n = 0;
+
+	for (i = 0; i < DISASM_RANGES_MAX; i++)
+		if (ranges[i].insns)
+			n++;
+	printf("Disassembly: %d of %d ranges, %d of %d instructions\n", n,
+	       DISASM_RANGES_MAX, insns_kept, DISASM_INSNS_MAX);
+	printf("%lu ranges fetched, %lu instructions read, %lu screens shown, "
+	       "%lu evicted\n", da_fetched, da_insns, da_shown, da_evicted);
+}
@@ -0,0 +1,50 @@
+#ifndef __DISASM_H__
+#define __DISASM_H__
+
+/*
+ * The disassembly view. gdb is asked for the code a part at a time,
+ * "-data-disassemble -s START -e END -- 2" from an instruction START,
+ * and the reply is read one instruction at a time straight into a range
+ * of the cache; no parse tree is built, so a function of tens of
+ * thousands of instructions costs no more than its parts looked at.
+ * The ranges are found by the addresses they cover: stepping with stepi
+ * or nexti through code seen once does not ask gdb again.
+ *
+ * Code stays the same while the program stops and runs, the ranges are
+ * dropped only when it starts anew or the symbols are read again. At
+ * most DISASM_INSNS_MAX instructions are kept, the range looked at
+ * least recently goes first.
+ */
+#define DISASM_CHUNK		512
+#define DISASM_RANGES_MAX	256
+#define DISASM_INSNS_MAX	200000
+#define DISASM_ASKED_MAX	16
+#define DISASM_SCREEN		16
+#define DISASM_ABOVE_PC		4
+#define DISASM_NAME_MAX		256
+
+typedef struct disasm_insn {
+	unsigned long addr;
+	int len;		/* in bytes */
+	int offset;		/* from the start of its function, -1 if none */
+	char *text;		/* "<main+4>:\tsub $0x10,%rsp" */
+} disasm_insn_t;
+
+typedef struct disasm_range {
+	unsigned long lo, hi;	/* hi is the end of the last instruction */
+	int count;
+	disasm_insn_t *insns;	/* NULL if the slot is free */
+	char *text;
+} disasm_range_t;
+
+/* Function prototypes */
+void disasm_clear(void);
+disasm_insn_t *disasm_find(unsigned long addr);
+unsigned long disasm_walk(unsigned long addr, int n, int *count);
+unsigned long disasm_back(unsigned long addr, int n, int *count);
+int disasm_ask(unsigned long addr);
+int disasm_store(unsigned long addr, const char *reply);
+void disasm_print(unsigned long addr, int n, unsigned long pc);
+void disasm_print_stats(void);
+
+#endif /* __DISASM_H__ */
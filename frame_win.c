@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "frame_win.h"
+#include "strbuf.h"
+#include "mi_raw.h"
+#include "slot_cache.h"
+
+static stack_page_t pages[FRAME_PAGES_MAX];
+static slot_cache_t cache = {
+	.slots = FRAME_PAGES_MAX,
+	.asked_max = FRAME_ASKED_MAX
+};
+static int depth = -1;		/* not known yet */
+static unsigned long fw_fetched, fw_hits, fw_evicted;
+static strbuf_t text;
+
+static void free_pages(void)
+{
+	int i;
+
+	for (i = 0; i < FRAME_PAGES_MAX; i++) {
+		free(pages[i].text);
+		pages[i].text = NULL;
+	}
+}
+
+/* Drops the pages of an older epoch; 1 if there was one */
+int frame_win_sync(unsigned long epoch)
+{
+	if (!slot_cache_sync(&cache, epoch))
+		return 0;
+	free_pages();
+	depth = -1;
+
+	return 1;
+}
+
+static int find_page(int page)
+{
+	int i;
+
+	for (i = 0; i < FRAME_PAGES_MAX; i++)
+		if (pages[i].text && pages[i].page == page)
+			return i;
+
+	return -1;
+}
+
+stack_page_t *frame_win_page(int page)
+{
+	int i;
+
+	if ((i = find_page(page)) < 0)
+		return NULL;
+	slot_cache_touch(&cache, i);
+	fw_hits++;
+
+	return &pages[i];
+}
+
+/* Whether the page is kept, without counting it as looked at */
+int frame_win_has(int page)
+{
+	return find_page(page) >= 0;
+}
+
+/* 1 if the page is to be asked: it is neither kept nor asked already */
+int frame_win_ask(int page)
+{
+	return !frame_win_has(page) && slot_cache_ask(&cache, page);
+}
+
+/* The slot of page if it was asked twice, a free one or the oldest */
+static stack_page_t *get_slot(int page)
+{
+	int i;
+
+	if ((i = find_page(page)) < 0) {
+		i = slot_cache_pick(&cache);
+		if (cache.stamps[i])
+			fw_evicted++;
+	}
+	free(pages[i].text);
+	pages[i].text = NULL;
+	slot_cache_free(&cache, i);
+
+	return &pages[i];
+}
+
+/* Appends one frame={...} between s and end to text, as bt prints it */
+static void format_frame(const char *s, const char *end)
+{
+	char level[16], addr[32], line[16];
+	char func[FRAME_NAME_MAX], file[FRAME_NAME_MAX];
+
+	if (!mi_raw_field(s, end, "level", level, sizeof(level)))
+		strcpy(level, "?");
+	if (!mi_raw_field(s, end, "addr", addr, sizeof(addr)))
+		strcpy(addr, "?");
+	if (!mi_raw_field(s, end, "func", func, sizeof(func)))
+		strcpy(func, "??");
+	strbuf_printf(&text, "#%-5s %s in %s", level, addr, func);
+	if (mi_raw_field(s, end, "file", file, sizeof(file)) &&
+	    mi_raw_field(s, end, "line", line, sizeof(line)))
+		strbuf_printf(&text, " at %s:%s", file, line);
+	else if (mi_raw_field(s, end, "from", file, sizeof(file)))
+		strbuf_printf(&text, " from %s", file);
+	strbuf_putc(&text, '\0');
+}
+
+/*
+ * Keeps the reply of "-stack-list-frames LOW HIGH" for the page
+ * starting at LOW, read as it is:
+ *
+ *	^done,stack=[frame={level="100",addr="0x..",func="f",...},...]
+ *
+ * A page with fewer frames than asked is the bottom of the stack, which
+ * tells its depth; gdb refuses a page starting past the bottom. A page
+ * asked before the epoch changed is dropped.
+ * Returns the number of frames kept, -1 on error.
+ */
+int frame_win_store(int page, const char *reply)
+{
+	int offs[FRAME_PAGE_SIZE];
+	stack_page_t *p;
+	const char *s, *end;
+	int i, n = 0;
+
+	if (!slot_cache_take(&cache, page))
+		return 0;
+	if (strncmp(reply, "^done", 5)) {
+		/* LOW is past the bottom, right below a full page if known */
+		if (strstr(reply, "Not enough frames") &&
+		    (p = frame_win_page(page - 1)) &&
+		    p->count == FRAME_PAGE_SIZE)
+			depth = page * FRAME_PAGE_SIZE;
+		return -1;
+	}
+	strbuf_reset(&text);
+	for (s = reply; n < FRAME_PAGE_SIZE && (s = strstr(s, "frame={"));
+	     s = end) {
+		if (!(end = mi_raw_end(s + 6)))
+			break;
+		offs[n++] = text.len;
+		format_frame(s + 6, end);
+	}
+	if (n < FRAME_PAGE_SIZE)
+		depth = page * FRAME_PAGE_SIZE + n;
+	if (!n)
+		return 0;
+
+	p = get_slot(page);
+	if (!(p->text = (char *)malloc(text.len))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return -1;
+	}
+	memcpy(p->text, text.str, text.len);
+	for (i = 0; i < n; i++)
+		p->lines[i] = p->text + offs[i];
+	p->page = page;
+	p->count = n;
+	slot_cache_touch(&cache, p - pages);
+	fw_fetched++;
+
+	return n;
+}
+
+/* The number of frames, -1 while it is not known */
+int frame_win_depth(void)
+{
+	return depth;
+}
+
+void frame_win_set_depth(int d)
+{
+	depth = d;
+}
+
+void frame_win_print_stats(void)
+{
+	int i, n = 0;
+
+	for (i = 0; i < FRAME_PAGES_MAX; i++)
+		if (pages[i].text)
+			n++;
+	printf("Stack window: %d of %d pages of %d frames, ", n,
+	       FRAME_PAGES_MAX, FRAME_PAGE_SIZE);
+	if (depth < 0)
+		printf("depth not known\n");
+	else
+		printf("depth %d\n", depth);
+	printf("%lu pages fetched, %lu hits, %lu evicted\n", fw_fetched,
+	       fw_hits, fw_evicted);
+}
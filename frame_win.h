@@ -0,0 +1,38 @@
+#ifndef __FRAME_WIN_H__
+#define __FRAME_WIN_H__
+
+/*
+ * A window on the stack of the selected thread, which may be hundreds
+ * of thousands of frames deep after a runaway recursion. It is asked in
+ * pages of FRAME_PAGE_SIZE frames, "-stack-list-frames LOW HIGH", as
+ * they are looked at, and at most FRAME_PAGES_MAX of them are kept: the
+ * one looked at least recently goes first. The frames are formatted
+ * straight from the reply, as bt shows them; no parse tree is built.
+ *
+ * The pages belong to an epoch of the stop cache and are dropped when
+ * it changes: the program ran, or another thread or frame was selected.
+ */
+#define FRAME_PAGE_LAST	99	/* a plain number, it goes in a command */
+#define FRAME_PAGE_SIZE	(FRAME_PAGE_LAST + 1)
+#define FRAME_PAGES_MAX	16
+#define FRAME_ASKED_MAX	64
+#define FRAME_NAME_MAX	256
+
+typedef struct stack_page {
+	int page;
+	int count;		/* fewer than FRAME_PAGE_SIZE at the bottom */
+	char *text;		/* the frames, NULL if the slot is free */
+	char *lines[FRAME_PAGE_SIZE];
+} stack_page_t;
+
+/* Function prototypes */
+int frame_win_sync(unsigned long epoch);
+stack_page_t *frame_win_page(int page);
+int frame_win_has(int page);
+int frame_win_ask(int page);
+int frame_win_store(int page, const char *reply);
+int frame_win_depth(void);
+void frame_win_set_depth(int depth);
+void frame_win_print_stats(void);
+
+#endif /* __FRAME_WIN_H__ */
@@ -7,17 +7,62 @@
 #include <stdlib.h>
 #include <termios.h>
 #include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <sys/time.h>
+#include <sys/ioctl.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 #include "gdbvim.h"
+#include "cmd_queue.h"
+#include "strbuf.h"
+#include "compl_cache.h"
+#include "symidx.h"
+#include "vim_channel.h"
+#include "src_cache.h"
+#include "stop_cache.h"
+#include "watch.h"
+#include "bkpt_table.h"
+#include "inferior.h"
+#include "profile.h"
+#include "frame_win.h"
+#include "regs.h"
+#include "memview.h"
+#include "disasm.h"
+#include "triage.h"
 
 /* Symbolic constants */
 #define IN_BUF_SIZE	256
 #define OUT_BUF_SIZE	256
 #define GDB_BUF_SIZE	1024
 #define PROG_BUF_SIZE	1024
-#define GDB_CMD_SIZE	256
 #define GDB_ARGS_SIZE	64
+#define GDB_ARGV_SIZE	5
+#define STATUS_SIZE	64
+#define COMPL_LIST_MAX	200
+#define SYM_LIST_MAX	50
+#define SOCK_PATH_SIZE	108
+#define STRINGIFY(x)	#x
+#define TO_STRING(x)	STRINGIFY(x)
+/* The first page of the stack window */
+#define PREFETCH_FRAMES	"interpreter mi \"-stack-list-frames 0 " \
+			TO_STRING(FRAME_PAGE_LAST) "\""
+#define PREFETCH_LOCALS	"interpreter mi \"-stack-list-variables " \
+			"--simple-values\""
+#define WATCH_UPDATE	"interpreter mi \"-var-update --all-values *\""
+#define BKPT_LIST	"interpreter mi \"-break-list\""
+#define REGS_NAMES	"interpreter mi \"-data-list-register-names\""
+#define REGS_CHANGED	"interpreter mi \"-data-list-changed-registers\""
+#define BKPT_AT_MAX	16
+#define LOAD_WINDOW	32
+#define PROFILE_CONT	"interpreter mi \"-exec-continue\""
+#define PROFILE_THREADS_MAX	256
+#define PROG_INPUT_KEY	'\035'	/* ^] */
+#define LOAD_ERRORS_MAX	10
+#define LOAD_LINE_SIZE	1024
+#define STACK_SCREEN	20
+#define STACK_DEPTH	"interpreter mi \"-stack-info-depth\""
 
 /* Extern declarations */
 typedef struct yy_buffer_state *YY_BUFFER_STATE;
@@ -29,7 +74,7 @@ extern const struct gdb_mi_cmd *is_gdb_mi_cmd(register const char *str,
 					      register unsigned int len);
 
 /* static global variable defitions */
-static gdb_state_t gdbstatus = GDB_STATE_CLI;
+static gdb_state_t gdbstatus = GDB_STATE_STARTUP;
 static key_type_t prev_key = KEY_OTHER;
 static int gdb_out = GDB_OUT_ECHO_TRIMMED;
 
@@ -37,24 +82,189 @@ static int gdb_ptym;
 static int readline_ptym, readline_ptys;
 static int prog_ptym, prog_ptys;
 
-static char *current_gdb_line;
+static strbuf_t current_gdb_line;
 static int gdb_cmd_len;
 
+/* Every line written to gdb is formatted here, the memory is reused */
+static strbuf_t gdb_cmd_sb;
+/* The line whose completions are asked to gdb */
+static strbuf_t compl_line;
+/* Reads the reply of the gdb/mi command in progress */
+static gdb_mi_handler_t mi_handler = parse_mi_parsetree;
+
+/* Lines entered before gdb could take them, sent later as one batch */
+static cmd_queue_t pending_queue;
+/* Replies still expected for the batch written to gdb */
+static cmd_queue_t reply_queue;
+static cmd_entry_t *active_reply;
+/* A command written at once, not in a batch, has not been answered */
+static int gdb_direct_busy;
+
+/* gdb output is accumulated until a whole reply is seen */
+static char *gdb_acc;
+static int gdb_acc_len, gdb_acc_size;
+static int gdb_reply_len;
+static char gdb_reply_end;
+/* Where the search for the end of the reply goes on from */
+static int gdb_acc_scanned;
+static const char *gdb_acc_pattern;
+static int startup_scanned;
+
+/* The symbol index is to be built when gdb is idle */
+static int symidx_wanted = 1;
+static int symidx_failed;
+static unsigned long symidx_lib_gen;	/* the libraries it was made for */
+
+/*
+ * Typeahead: while gdb is running the program, keys go on to readline
+ * and the lines are queued, unless PROG_INPUT_KEY has sent the input
+ * to the program until gdb is back.
+ */
+static int typeahead_on;
+static int prog_input;
+
+/* ^C only writes to this pipe, the main loop does the rest */
+static int sig_pipe[2] = {-1, -1};
+/* gdb has said ^running and the stop has not come yet */
+static int prog_running;
+/* The handler of an internal command waits for more gdb/mi output */
+static int internal_more;
+/* The folded stacks of gv profile go here */
+static char *profile_file;
+/* The first frame gv stack shows, and what waits for gdb's reply */
+static int stack_top;
+static int stack_show_wanted, stack_bottom_wanted;
+/* The first byte gv mem shows, and whether as characters only */
+static unsigned long mem_addr;
+static int mem_ascii, mem_shown, mem_show_wanted;
+/* The first instruction gv disas shows, and the pc of the last stop */
+static unsigned long disas_addr, disas_pc;
+static int disas_show_wanted;
+/* gv disas - waits for the code above the screen, asked from here */
+static unsigned long disas_back_lo;
+static int disas_back_wanted;
+
+/* The stack and the locals are asked as soon as gdb is idle after a stop */
+static int prefetch_on;
+static int prefetch_wanted;
+static unsigned long prefetch_sent, prefetch_cancelled;
+/* The watches are updated once gdb is idle after a stop */
+static int watch_wanted;
+/* The registers changed are asked once gdb is idle after a stop */
+static int regs_on;
+static int regs_wanted;
+/* The code around the pc is shown once gdb is idle after a stop */
+static int disas_on;
+static int disas_wanted;
+/* -var-create does not give the expression back, it waits here */
+static cmd_queue_t watch_exps;
+
+/* The breakpoint mirror is to be read again, a gdb/cli command changed it */
+static int bkpt_sync_wanted = 1;
+static int bkpt_syncing;
+/* -break-list could not be read, the mirror can not be trusted */
+static int bkpt_stale;
+/* Files Vim wants the signs of once the mirror has been read again */
+static cmd_queue_t bkpt_files;
+
+/* A breakpoint file being loaded, its locations go LOAD_WINDOW at a time */
+static cmd_queue_t load_locs;
+static char *load_file;
+static int load_window, load_done, load_failed;
+static struct timeval load_start;
+
+/* A query sent at once, its reply goes to the stop cache under this */
+static strbuf_t query_key;
+static int query_pending;
+
 static struct termios save_termios;
 
+static void gv_cmd_stats(char *args);
+static void gv_cmd_sym(char *args);
+static void gv_cmd_vim(char *args);
+static void gv_cmd_src(char *args);
+static void gv_cmd_cache(char *args);
+static void gv_cmd_prefetch(char *args);
+static void gv_cmd_typeahead(char *args);
+static void gv_cmd_watch(char *args);
+static void gv_cmd_unwatch(char *args);
+static void gv_cmd_expand(char *args);
+static void gv_cmd_collapse(char *args);
+static void gv_cmd_break(char *args);
+static void gv_cmd_load(char *args);
+static void gv_cmd_libs(char *args);
+static void gv_cmd_threads(char *args);
+static void gv_cmd_profile(char *args);
+static void gv_cmd_stack(char *args);
+static void gv_cmd_regs(char *args);
+static void gv_cmd_mem(char *args);
+static void gv_cmd_disas(char *args);
+static void cancel_stop_work(void);
+static void disas_forget(void);
+static void show_disas_at_pc(int async);
+static void interrupt_gdb(void);
+static void gv_cmd_help(char *args);
+
+static gv_cmd_t gv_cmd_list[] = {
+	{"stats", gv_cmd_stats, "Show parse tree memory statistics"},
+	{"sym", gv_cmd_sym, "Show the symbol index or the names with a prefix"},
+	{"vim", gv_cmd_vim, "Show the Vim channel"},
+	{"src", gv_cmd_src, "Show the source cache"},
+	{"cache", gv_cmd_cache, "Show the answers cached since the last stop"},
+	{"prefetch", gv_cmd_prefetch, "Ask the stack and the locals for Vim on "
+	 "stops: on or off"},
+	{"typeahead", gv_cmd_typeahead, "Queue the lines typed while the "
+	 "program runs: on or off"},
+	{"watch", gv_cmd_watch, "Watch an expression, or show the watches"},
+	{"unwatch", gv_cmd_unwatch, "Remove a watch, or all of them"},
+	{"expand", gv_cmd_expand, "Show the children of a watch: 2 or s.next, "
+	 "[INDEX|+|-]"},
+	{"collapse", gv_cmd_collapse, "Hide the children of a watch"},
+	{"break", gv_cmd_break, "List the breakpoints without asking gdb"},
+	{"load", gv_cmd_load, "Set the breakpoints listed in a file"},
+	{"libs", gv_cmd_libs, "List the shared libraries, or the one at an "
+	 "address"},
+	{"threads", gv_cmd_threads, "List the threads gdb has told us of"},
+	{"profile", gv_cmd_profile, "Sample the stacks of the running program: "
+	 "[HZ [SECONDS [FILE]]]"},
+	{"stack", gv_cmd_stack, "Show the stack a screen at a time: "
+	 "[LEVEL|+|-|$]"},
+	{"regs", gv_cmd_regs, "Show the registers, those changed at stops: "
+	 "on or off"},
+	{"mem", gv_cmd_mem, "Show memory a screen at a time: [/x|/a] "
+	 "[ADDR|+|-]"},
+	{"disas", gv_cmd_disas, "Show the code a screen at a time, at stops "
+	 "if on: [on|off|ADDR|+|-]"},
+	{"help", gv_cmd_help, "List gdbvim commands"},
+	{NULL, NULL, NULL}
+};
+
 /* Function definitions */
-gdb_mi_cmd_state_t parse_mi_parsetree(void)
+/* The lines around a stop, and Vim follows, if there is a source line */
+static void show_stop_source(frame_info_t *finfo_ptr)
+{
+	int line;
+
+	if (!finfo_ptr->fullname || !finfo_ptr->line)
+		return;
+	line = atoi(finfo_ptr->line);
+	src_cache_print_context(finfo_ptr->fullname, line, SRC_CONTEXT_LINES);
+	vim_channel_frame(finfo_ptr->fullname, line);
+}
+
+gdb_mi_cmd_state_t parse_mi_parsetree(gdbmi_output_t *out)
 {
 	async_record_t *async_rec_ptr;
 	frame_info_t *finfo_ptr;
 	char *str;
+	int thread = 0;
 
 	/*
 	 * FIXME: DONE should be handled. Others; EXIT, CONNECTED,
 	 * and RUNNING do not have any value(s).
 	 */
 	/* Check if there is error result record */
-	if (str = mi_get_error_result_record(gdbmi_out_ptr)) {
+	if (str = mi_get_error_result_record(out)) {
 		printf("%s\n", str);
 		logger(str, strlen(str), 0);
 		logger("\n", 1, 0);
@@ -63,13 +273,37 @@ gdb_mi_cmd_state_t parse_mi_parsetree(void)
 	}
 	else {
 		/* Print console stream messages */
-		mi_print_console_stream(gdbmi_out_ptr);
+		mi_print_console_stream(out);
+		/* Nothing asked before holds once it runs */
+		if (mi_is_running(out)) {
+			prog_running = 1;
+			cancel_stop_work();
+			stop_cache_running();
+		}
 		/* Frame information is retrieved from exec async record */
-		if (async_rec_ptr = mi_get_exec_async_record(gdbmi_out_ptr)) {
+		if (async_rec_ptr = mi_get_exec_async_record(out)) {
 			/* Found */
-			finfo_ptr = mi_get_frame(async_rec_ptr);
-			mi_print_frame_info(finfo_ptr);
-			free_frame_info(finfo_ptr);
+			if (str = mi_get_async_result(async_rec_ptr,
+						       "thread-id")) {
+				thread = atoi(str);
+				free(str);
+			}
+			prog_running = 0;
+			stop_cache_stopped(thread);
+			prefetch_wanted = prefetch_on;
+			watch_wanted = watch_count() > 0;
+			regs_wanted = regs_on;
+			/* An exited program stops without a frame */
+			disas_pc = 0;
+			if (finfo_ptr = mi_get_frame(async_rec_ptr)) {
+				if (finfo_ptr->addr)
+					disas_pc = strtoul(finfo_ptr->addr,
+							   NULL, 0);
+				mi_print_frame_info(finfo_ptr);
+				show_stop_source(finfo_ptr);
+				free_frame_info(finfo_ptr);
+			}
+			disas_wanted = disas_on && disas_pc;
 			return GDB_MI_CMD_COMPLETED;
 		}
 		else /* We have not got it yet */
@@ -84,6 +318,9 @@ int create_mi_parsetree(char *str)
 	YY_BUFFER_STATE bufstate;
 	int ret;
 
+	/* Library and thread notifications are taken out, not parsed */
+	inferior_scan(str);
+	str = bkpt_fold_locations(str);
 	bufstate = yy_scan_string(str);
 
 	/* Start creating a parse tree */
@@ -93,6 +330,9 @@ int create_mi_parsetree(char *str)
 	if (!gdbmi_out_ptr) {
 		printf("Partial or wrong gdbmi output. Syntax or "
 		       "grammar problem?\n");
+		/* A breakpoint change is lost, the mirror is read again */
+		if (strstr(str, "bkpt="))
+			bkpt_sync_wanted = 1;
 		ret = -1;
 	}
 	else
@@ -146,6 +386,161 @@ static inline void turn_echo_on(int fd)
 	tcsetattr(fd, TCSANOW, &stermios);
 }
 
+/*
+ * Copies what readline has written, e.g. the echo of the line just
+ * entered, to the terminal. Anything gdbvim prints itself must come
+ * after it.
+ */
+static void relay_readline_output(void)
+{
+	char outbuf[OUT_BUF_SIZE];
+	struct pollfd fds;
+	int nread;
+
+	fds.fd = readline_ptym;
+	fds.events = POLLIN;
+	while (poll(&fds, 1, 0) > 0 && fds.revents == POLLIN) {
+		if ((nread = read(readline_ptym, outbuf, OUT_BUF_SIZE)) <= 0)
+			break;
+		write(STDOUT_FILENO, outbuf, nread);
+	}
+}
+
+/*
+ * gdb prints "(gdb) " itself after every command. Commands handled by
+ * gdbvim never reach gdb, so the prompt is printed here. While gdb is
+ * starting, the prompt carries the status line.
+ */
+static void show_prompt(void)
+{
+	relay_readline_output();
+	fflush(stdout);
+	write(STDOUT_FILENO, rl_prompt, strlen(rl_prompt));
+}
+
+/* gdb is not ready while it is starting or answering a command */
+static int gdb_is_ready(void)
+{
+	return gdbstatus != GDB_STATE_STARTUP && !gdb_direct_busy &&
+	       !active_reply && !reply_queue.count;
+}
+
+static void gv_cmd_stats(char *args)
+{
+	mi_print_mem_stats();
+}
+
+static void gv_cmd_sym(char *args)
+{
+	int k, i, n, first, shown = 0;
+
+	if (!args || !*args) {
+		symidx_print_stats();
+		return;
+	}
+	if (!symidx_ready()) {
+		printf("Symbol index is not built yet.\n");
+		return;
+	}
+
+	for (k = 0; k < SYM_KIND_MAX; k++) {
+		n = symidx_range(k, args, strlen(args), &first);
+		for (i = 0; i < n && shown < SYM_LIST_MAX; i++, shown++)
+			printf("%s %s\n", k == SYM_FUNC ? "f" : "v",
+			       symidx_name(k, first + i));
+		if (n > i)
+			printf("... %d more\n", n - i);
+	}
+}
+
+static void gv_cmd_vim(char *args)
+{
+	vim_channel_print_stats();
+}
+
+static void gv_cmd_src(char *args)
+{
+	src_cache_print_stats();
+}
+
+static void gv_cmd_cache(char *args)
+{
+	stop_cache_print_stats();
+	frame_win_print_stats();
+	memview_print_stats();
+	disasm_print_stats();
+}
+
+static void gv_cmd_prefetch(char *args)
+{
+	if (!strcmp(args, "on"))
+		prefetch_on = 1;
+	else if (!strcmp(args, "off"))
+		prefetch_on = prefetch_wanted = 0;
+	else if (*args) {
+		printf("\"on\" or \"off\" expected.\n");
+		return;
+	}
+	printf("Prefetch on stop is %s, %lu sent, %lu cancelled\n",
+	       prefetch_on ? "on" : "off", prefetch_sent, prefetch_cancelled);
+}
+
+static void gv_cmd_typeahead(char *args)
+{
+	if (!strcmp(args, "on"))
+		typeahead_on = 1;
+	else if (!strcmp(args, "off"))
+		typeahead_on = prog_input = 0;
+	else if (*args) {
+		printf("\"on\" or \"off\" expected.\n");
+		return;
+	}
+	printf("Typeahead is %s, ^] sends the input to the program\n",
+	       typeahead_on ? "on" : "off");
+}
+
+static void gv_cmd_help(char *args)
+{
+	gv_cmd_t *c;
+
+	for (c = gv_cmd_list; c->name; c++)
+		printf("gdbvim %-10s -- %s\n", c->name, c->help);
+}
+
+static int is_gdbvim_cmd(const char *cmd, int cmd_len)
+{
+	return (cmd_len == 6 && !strncmp(cmd, "gdbvim", 6)) ||
+	       (cmd_len == 2 && !strncmp(cmd, "gv", 2));
+}
+
+/* args: "stats", "help" etc. */
+static void do_gdbvim_cmd(char *args)
+{
+	gv_cmd_t *c;
+	char *sub_args;
+	int sub_len;
+
+	if (!args || !*args) {
+		gv_cmd_help(NULL);
+		return;
+	}
+
+	sub_len = strcspn(args, " ");
+	sub_args = args + sub_len;
+	while (*sub_args == ' ')
+		sub_args++;
+
+	for (c = gv_cmd_list; c->name; c++) {
+		if (strlen(c->name) == sub_len &&
+		    !strncmp(c->name, args, sub_len)) {
+			c->handler(sub_args);
+			return;
+		}
+	}
+	printf("Undefined gdbvim command: \"%.*s\".  Try \"gdbvim help\".\n",
+	       sub_len, args);
+}
+
 static inline void erase_line(int fd)
 {
 	char c = 0x15;
@@ -223,116 +618,249 @@ static char *kill_echo(char *char_ptr, int cmd_echo)
 	return char_ptr;
 }
 
+/*
+ * Completes the line the way readline does: the part common to all
+ * candidates is inserted, a second TAB lists them. A candidate is the
+ * line without its first base characters.
+ */
+static void complete_line(const char **cands, int n, int base,
+			  int second_tab)
+{
+	const char **matches;
+	const char *last;
+	char *common;
+	int len, lcp, word, max, i;
+
+	/* gdb completes the whole line, so does gdbvim */
+	rl_point = rl_end;
+	len = rl_end - base;
+
+	if (!n) {
+		rl_ding();
+		return;
+	}
+
+	/* Sorted, so the first and the last share the common part */
+	last = cands[n - 1];
+	for (lcp = 0; cands[0][lcp] && cands[0][lcp] == last[lcp]; lcp++)
+		;
+
+	if (lcp > len) {
+		if (!(common = strndup(cands[0] + len, lcp - len))) {
+			fprintf(stderr, "Cannot allocate memory\n");
+			return;
+		}
+		rl_insert_text(common);
+		free(common);
+		if (n == 1)
+			rl_insert_text(" ");
+	}
+	else if (n == 1)
+		rl_insert_text(" ");
+	else if (second_tab) {
+		/* Only the word being completed is listed */
+		for (word = rl_end; word > base &&
+		     rl_line_buffer[word - 1] != ' '; word--)
+			;
+		word -= base;
+		if (n > COMPL_LIST_MAX)
+			n = COMPL_LIST_MAX;
+		matches = (const char **)malloc((n + 2) * sizeof(char *));
+		if (!matches) {
+			fprintf(stderr, "Cannot allocate memory\n");
+			return;
+		}
+		matches[0] = rl_line_buffer + base + word;
+		for (i = 0, max = 0; i < n; i++) {
+			matches[i + 1] = cands[i] + word;
+			if (strlen(matches[i + 1]) > max)
+				max = strlen(matches[i + 1]);
+		}
+		matches[n + 1] = NULL;
+		rl_display_match_list((char **)matches, n, max);
+		rl_forced_update_display();
+		free(matches);
+	}
+	else
+		rl_ding();
+}
+
+static void complete_from_cache(compl_entry_t *e, int second_tab)
+{
+	int first, n;
+
+	n = compl_cache_range(e, rl_line_buffer, &first);
+	complete_line((const char **)e->cands + first, n, 0, second_tab);
+}
+
+/* Commands taking a function as their only argument */
+static const char *location_cmds[] = {
+	"break", "b", "br", "bre", "brea", "tbreak", "tb", "until", "u",
+	"advance", "jump", "j", "list", "l", "disassemble", "clear", NULL
+};
+
+/*
+ * "break ma<TAB>" is completed from the symbol index. Returns 0 if the
+ * line is not a location command with one word or nothing matches, so
+ * gdb is asked instead.
+ */
+static int complete_from_symidx(int second_tab)
+{
+	const char **cands;
+	char *cmd, *word, *c;
+	int cmd_len, i, n, first;
+
+	if (!symidx_ready())
+		return 0;
+
+	cmd = rl_line_buffer + strspn(rl_line_buffer, " ");
+	cmd_len = strcspn(cmd, " ");
+	word = cmd + cmd_len + strspn(cmd + cmd_len, " ");
+	if (!cmd[cmd_len] || !*word)
+		return 0;
+	for (c = word; *c; c++)
+		if (!isalnum((unsigned char)*c) && !strchr("_:~", *c))
+			return 0;
+
+	for (i = 0; location_cmds[i]; i++)
+		if (strlen(location_cmds[i]) == cmd_len &&
+		    !strncmp(location_cmds[i], cmd, cmd_len))
+			break;
+	if (!location_cmds[i])
+		return 0;
+
+	if (!(n = symidx_range(SYM_FUNC, word, c - word, &first)))
+		return 0;
+	if (!(cands = (const char **)malloc(n * sizeof(char *)))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return 0;
+	}
+	for (i = 0; i < n; i++)
+		cands[i] = symidx_name(SYM_FUNC, first + i);
+	complete_line(cands, n, word - rl_line_buffer, second_tab);
+	free(cands);
+
+	return 1;
+}
+
+/*
+ * TAB is answered from the symbol index or the completion cache when
+ * it can be. gdb is asked with "server complete" only when the line is
+ * not covered by either, and the reply is cached in turn.
+ */
 int tab_completion(int count, int key)
 {
-	char gdb_cmd_buf[GDB_CMD_SIZE];
-	int nread;
+	compl_entry_t *e;
+	int second_tab = prev_key == KEY_TAB;
 
-	if (prev_key == KEY_TAB)
-		write(gdb_ptym, "\t", 1);
-	else {
-		erase_line(gdb_ptym);
-		sprintf(gdb_cmd_buf, "%s\t", rl_line_buffer);
-		write(gdb_ptym, gdb_cmd_buf, strlen(gdb_cmd_buf));
+	prev_key = KEY_TAB;
+
+	/* gdb can not complete yet, readline completes file names */
+	if (!gdb_is_ready())
+		return rl_complete(count, key);
+
+	if (complete_from_symidx(second_tab))
+		return 0;
+
+	if (e = compl_cache_lookup(rl_line_buffer)) {
+		complete_from_cache(e, second_tab);
+		return 0;
 	}
+
+	strbuf_reset(&compl_line);
+	strbuf_puts(&compl_line, rl_line_buffer);
+
+	erase_line(gdb_ptym);
+	strbuf_reset(&gdb_cmd_sb);
+	strbuf_printf(&gdb_cmd_sb, "server complete %s\n", rl_line_buffer);
+	gdb_cmd_len = gdb_cmd_sb.len;
+	gdb_out = GDB_OUT_ECHO_INCLUDED;
+	write(gdb_ptym, gdb_cmd_sb.str, gdb_cmd_len);
 	gdbstatus = GDB_STATE_COMPLETION;
-	prev_key = KEY_TAB;
+	gdb_direct_busy = 1;
 
 	return 0;
 }
 
-void do_gdb_mi_cmd(gdb_mi_cmd_code_t mi_cmd_code, char *args)
+/* Appends str escaped for the inside of a cstring */
+static void put_cstring(strbuf_t *sb, const char *str)
 {
-	char gdb_cmd_buf[GDB_CMD_SIZE];
+	for (; *str; str++) {
+		if (*str == '\"' || *str == '\\')
+			strbuf_putc(sb, '\\');
+		strbuf_putc(sb, *str);
+	}
+}
 
-	erase_line(gdb_ptym);
+/*
+ * interpreter mi "MI_CMD \"ARG\"" in sb, ARG is a cstring in a cstring
+ * so it survives both the gdb/cli and the gdb/mi parsers.
+ */
+static void make_internal_mi_cmd(strbuf_t *sb, const char *mi_cmd,
+				 const char *arg)
+{
+	static strbuf_t mi_sb;
+
+	strbuf_reset(&mi_sb);
+	strbuf_printf(&mi_sb, "%s \"", mi_cmd);
+	put_cstring(&mi_sb, arg);
+	strbuf_putc(&mi_sb, '\"');
+	strbuf_reset(sb);
+	strbuf_puts(sb, "interpreter mi \"");
+	put_cstring(sb, mi_sb.str);
+	strbuf_putc(sb, '\"');
+}
 
-	switch (mi_cmd_code) {
-	case GDB_MI_EXEC_START:
-		sprintf(gdb_cmd_buf, "interpreter mi -exec-start\n");
-		break;
-	case GDB_MI_EXEC_RUN:
-		if (args) /* arguments given to the inferior */
-			sprintf(gdb_cmd_buf,
-				"interpreter mi \"-exec-run %s\"\n",
-				args);
-		else
-			sprintf(gdb_cmd_buf, "interpreter mi -exec-run\n");
-		break;
-	case GDB_MI_EXEC_CONTINUE:
-		if (args) /* ignore-count */
-			sprintf(gdb_cmd_buf,
-				"interpreter mi \"-exec-continue %s\"\n",
-				args);
-		else
-			sprintf(gdb_cmd_buf, "interpreter mi -exec-continue\n");
-		break;
-	case GDB_MI_EXEC_UNTIL:
-		if (args) /* location */
-			sprintf(gdb_cmd_buf,
-				"interpreter mi \"-exec-until %s\"\n",
-				args);
-		else
-			sprintf(gdb_cmd_buf, "interpreter mi -exec-until\n");
-		break;
-	case GDB_MI_EXEC_NEXT:
-		if (args) /* the number of lines */
-			sprintf(gdb_cmd_buf,
-				"interpreter mi \"-exec-next %s\"\n",
-				args);
-		else
-			sprintf(gdb_cmd_buf, "interpreter mi -exec-next\n");
-		break;
-	case GDB_MI_EXEC_NEXT_INS:
-		if (args) /* the number of instructions */
-			sprintf(gdb_cmd_buf,
-				"interpreter mi \"-exec-next-instruction %s\"\n",
-				args);
-		else
-			sprintf(gdb_cmd_buf,
-				"interpreter mi -exec-next-instruction\n");
-		break;
-	case GDB_MI_EXEC_STEP:
-		if (args) /* the number of lines */
-			sprintf(gdb_cmd_buf,
-				"interpreter mi \"-exec-step %s\"\n",
-				args);
-		else
-			sprintf(gdb_cmd_buf, "interpreter mi -exec-step\n");
-		break;
-	case GDB_MI_EXEC_STEP_INS:
-		if (args) /* the number of instructions */
-			sprintf(gdb_cmd_buf,
-				"interpreter mi \"-exec-step-instruction %s\"\n",
-				args);
-		else
-			sprintf(gdb_cmd_buf,
-				"interpreter mi -exec-step-instruction\n");
-		break;
-	case GDB_MI_EXEC_JUMP:
-		if (args) /* location */
-			sprintf(gdb_cmd_buf,
-				"interpreter mi \"-exec-jump %s\"\n",
-				args);
-		else
-			sprintf(gdb_cmd_buf, "interpreter mi -exec-jump\n");
-		break;
-	case GDB_MI_EXEC_FINISH:
-		sprintf(gdb_cmd_buf, "interpreter mi -exec-finish\n");
-		break;
-	case GDB_MI_EXEC_RETURN:
-		sprintf(gdb_cmd_buf, "interpreter mi -exec-return\n");
-		break;
+/*
+ * Appends the cli line running an mi command from the table to sb:
+ *
+ *	interpreter mi "-exec-next 3"\n
+ *
+ * Double quotes and backslashes in args are escaped since the mi
+ * command is given to gdb as a cstring. Returns -1 if args is needed
+ * but missing.
+ */
+static int make_gdb_mi_cmd(strbuf_t *sb, const gdb_mi_cmd_t *mi_cmd,
+			   const char *args)
+{
+	if (mi_cmd->args_rule == GDB_MI_ARGS_REQUIRED && !args)
+		return -1;
+
+	strbuf_puts(sb, "interpreter mi \"");
+	strbuf_puts(sb, mi_cmd->mi_cmd);
+	if (args && mi_cmd->args_rule != GDB_MI_ARGS_NONE) {
+		strbuf_putc(sb, ' ');
+		put_cstring(sb, args);
+	}
+	strbuf_puts(sb, "\"\n");
+
+	return 0;
+}
+
+int do_gdb_mi_cmd(const gdb_mi_cmd_t *mi_cmd, char *args)
+{
+	strbuf_reset(&gdb_cmd_sb);
+	if (make_gdb_mi_cmd(&gdb_cmd_sb, mi_cmd, args) < 0) {
+		printf("Argument required (%s).\n", mi_cmd->name);
+		return -1;
 	}
 
-	gdb_cmd_len = strlen(gdb_cmd_buf);
-	write(gdb_ptym, gdb_cmd_buf, gdb_cmd_len);
+	erase_line(gdb_ptym);
+	mi_handler = mi_cmd->handler;
+	gdb_cmd_len = gdb_cmd_sb.len;
+	write(gdb_ptym, gdb_cmd_sb.str, gdb_cmd_len);
+
+	return 0;
 }
 
-void tokenize_gdb_line(char *line, char **cmd, char **args)
+/*
+ * Splits line into cmd and args without copying. cmd is not null
+ * terminated, its length is returned in cmd_len. args points into line
+ * or is NULL.
+ */
+void tokenize_gdb_line(char *line, int *cmd_len, char **args)
 {
 	char *str = line;
-	int cmd_len;
 
 	/*
 	 * space and dot are separators.
@@ -343,328 +871,2467 @@ void tokenize_gdb_line(char *line, char **cmd, char **args)
 	 */
 	while (*str != ' ' && *str != '.' && *str != '\0')
 		++str;
+	*cmd_len = str - line;
 	if (*str == '\0') {
-		*cmd = strdup(line);
 		*args = NULL;
 		return;
 	}
-
-	/* +1 because we need space for the null char */
-	cmd_len = str - line + 1;
-	if (!(*cmd = (char *)malloc(cmd_len))) {
-		fprintf(stderr, "Cannot allocate memory\n");
-		exit(EXIT_FAILURE);
+
+	if (*str == ' ')
+		++str;
+	*args = str;
+}
+
+/*
+ * What a command changes besides its output: cached completions may go
+ * stale, symbols may come and go, and the answers cached since the
+ * stop may not hold any more.
+ */
+static void note_cmd_effects(const char *cmd, int cmd_len, const char *args,
+			     const gdb_mi_cmd_t *mi_cmd)
+{
+	if (mi_cmd) {
+		/* The program moves, locals and libraries change */
+		compl_cache_invalidate();
+		cancel_stop_work();
+		stop_cache_invalidate();
+		/*
+		 * Shared libraries are loaded once it runs; the symbol
+		 * index is made again only if they are not the same.
+		 */
+		if (mi_cmd->code == GDB_MI_EXEC_RUN ||
+		    mi_cmd->code == GDB_MI_EXEC_START) {
+			bkpt_sync_wanted = 1;
+			disas_forget();
+		}
+		return;
+	}
+	if (compl_cache_cmd_invalidates(cmd, cmd_len))
+		compl_cache_invalidate();
+	if (symidx_cmd_reloads(cmd, cmd_len)) {
+		symidx_wanted = 1;
+		disas_forget();
+	}
+	if (bkpt_cmd_changes(cmd, cmd_len))
+		bkpt_sync_wanted = 1;
+	/* "thread 2" only selects, the entries are kept per thread */
+	if (cmd_len == 6 && !strncmp(cmd, "thread", 6) && args &&
+	    isdigit((unsigned char)*args) &&
+	    args[strspn(args, "0123456789")] == '\0')
+		stop_cache_select_thread(atoi(args));
+	else if (!stop_cache_keeps(cmd, cmd_len, args))
+		stop_cache_invalidate();
+}
+
+/* Sends a line to gdb, or keeps it until gdb is ready */
+static void do_gdb_line(char *line)
+{
+	static gdb_cmd_type_t prev_cmd_type = GDB_CMD_CLI;
+	const gdb_mi_cmd_t *mi_cmd_ptr;
+	const char *cached;
+	char *stripped_line;
+	char *cmd = NULL, *args = NULL;
+	int cmd_len;
+	int local_cmd = 0;
+
+	/*
+	 * Remove leading and trailing whitespace(s) from the line.
+	 *
+	 * line == ""	      means newline   -> stripped_line = ""
+	 * line == " /t/t   " means all blank -> stripped_line = ""
+	 */
+	if (*line && *(stripped_line = stripws(line))) {
+		/* Tokenize gdb line to cmd and args */
+		cmd = stripped_line;
+		tokenize_gdb_line(stripped_line, &cmd_len, &args);
+
+		/*
+		 * Command or more precisely line is added to the
+		 * history when it is first encountered. It may
+		 * come here second time after the command type
+		 * could not be decided but in this case it is not
+		 * added so as not to have duplicate entries.
+		 */
+		if (gdbstatus != GDB_STATE_CHECK_CMD)
+			add_history(stripped_line);
+	}
+
+	/*
+	 * When readline library gives the line to the application,
+	 * it strips newline. However, gdb commands should be ended
+	 * with a newline so we set it again.
+	 */
+	if (cmd && is_gdbvim_cmd(cmd, cmd_len)) {
+		/* Handled here, gdb never sees it */
+		local_cmd = 1;
+		do_gdbvim_cmd(args);
+		show_prompt();
+	}
+	else if (!gdb_is_ready() && cmd &&
+		 (mi_cmd_ptr = is_gdb_mi_cmd(cmd, cmd_len)) &&
+		 mi_cmd_ptr->code == GDB_MI_EXEC_INTERRUPT) {
+		/* Typed ahead, it cannot wait for the stop it asks for */
+		local_cmd = 1;
+		interrupt_gdb();
+		show_prompt();
+	}
+	else if (!gdb_is_ready()) {
+		/* Goes to gdb with the others when it is ready */
+		local_cmd = 1;
+		if (cmd)
+			cmd_queue_push(&pending_queue, stripped_line, 0,
+				       GDB_STATE_CLI);
+		show_prompt();
+	}
+	else if (!cmd) { /* previous command */
+		/* readline gives: line = "" */
+		if (prev_cmd_type == GDB_CMD_MI)
+			gdbstatus = GDB_STATE_MI;
+		else
+			gdbstatus = GDB_STATE_CLI;
+		erase_line(gdb_ptym);
+		/* newline produces n\n as echo */
+		gdb_cmd_len = 1;
+		write(gdb_ptym, "\n", 1);
+	}
+	else if ((mi_cmd_ptr = is_gdb_mi_cmd(cmd, cmd_len)) != NULL) {
+		note_cmd_effects(cmd, cmd_len, args, mi_cmd_ptr);
+		if (do_gdb_mi_cmd(mi_cmd_ptr, args) < 0) {
+			local_cmd = 1;
+			gdbstatus = GDB_STATE_CLI;
+			show_prompt();
+		}
+		else {
+			prev_cmd_type = GDB_CMD_MI;
+			gdbstatus = GDB_STATE_MI;
+		}
+	}
+	else if (gdbstatus == GDB_STATE_CLI &&
+		 stop_cache_is_query(cmd, cmd_len, args) &&
+		 (cached = stop_cache_lookup(stripped_line))) {
+		/* Nothing has run since it was asked */
+		local_cmd = 1;
+		write(STDOUT_FILENO, cached, strlen(cached));
+		show_prompt();
+	}
+	else if (gdbstatus == GDB_STATE_CLI) {
+		/* The reply is kept under the line as it was typed */
+		if (query_pending = stop_cache_is_query(cmd, cmd_len, args)) {
+			strbuf_reset(&query_key);
+			strbuf_puts(&query_key, stripped_line);
+		}
+		/*
+		 * We need one more step to decide if it is a
+		 * gdb/cli or gdb/mi cmd. For this, we are
+		 * sending a req to gdb to learn the type of
+		 * cmd.
+		 */
+		gdbstatus = GDB_STATE_CHECK_CMD;
+		erase_line(gdb_ptym);
+		strbuf_reset(&current_gdb_line);
+		strbuf_puts(&current_gdb_line, stripped_line);
+		strbuf_reset(&gdb_cmd_sb);
+		strbuf_printf(&gdb_cmd_sb, "server complete %.*s\n",
+			      cmd_len, cmd);
+		gdb_cmd_len = gdb_cmd_sb.len;
+		write(gdb_ptym, gdb_cmd_sb.str, gdb_cmd_len);
+	}
+	else { /* gdb/cli command */
+		/* readline gives: line = file'\0' */
+		note_cmd_effects(cmd, cmd_len, args, NULL);
+		prev_cmd_type = GDB_CMD_CLI;
+		gdbstatus = GDB_STATE_CLI;
+		erase_line(gdb_ptym);
+		strbuf_reset(&gdb_cmd_sb);
+		strbuf_printf(&gdb_cmd_sb, "%s\n", stripped_line);
+		gdb_cmd_len = gdb_cmd_sb.len;
+		write(gdb_ptym, gdb_cmd_sb.str, gdb_cmd_len);
+	}
+	if (!local_cmd) {
+		gdb_out = GDB_OUT_ECHO_INCLUDED;
+		gdb_direct_busy = 1;
+	}
+}
+
+/* Called when EOF or newline is encountered */
+void do_gdb_cmd(char *line)
+{
+	/* Check if it is EOF: C-d */
+	if (line) {
+		/* Echo of the line first, then whatever it prints */
+		relay_readline_output();
+		do_gdb_line(line);
+		free(line);
+	}
+	else { /* EOF */
+		//FIXME: Handle EOF
+	}
+}
+
+/*
+ * The cmd of current_gdb_line is replaced with its full name found by
+ * "server complete". Built in gdb_cmd_sb and then the two are swapped,
+ * so no memory is allocated once they have grown.
+ */
+void reconstruct_gdb_line(const char *new_cmd, int new_cmd_len)
+{
+	strbuf_t tmp;
+	char *args;
+	int cmd_len;
+
+	tokenize_gdb_line(current_gdb_line.str, &cmd_len, &args);
+
+	/*
+	 * If the new_cmd is the same as with the given one, then there
+	 * is no need to reconstruct current_gdb_line.
+	 */
+	if (new_cmd_len == cmd_len)
+		return;
+
+	strbuf_reset(&gdb_cmd_sb);
+	strbuf_append(&gdb_cmd_sb, new_cmd, new_cmd_len);
+	strbuf_putc(&gdb_cmd_sb, ' ');
+	if (args)
+		strbuf_puts(&gdb_cmd_sb, args);
+
+	tmp = current_gdb_line;
+	current_gdb_line = gdb_cmd_sb;
+	gdb_cmd_sb = tmp;
+}
+
+/*
+ * Returns the length of the cmd at the start of cmd_list_buf if it is
+ * the only one listed, 0 otherwise.
+ */
+int parse_check_cmd_output(char *cmd_list_buf)
+{
+	char *cmd_iter;
+
+	/* not a valid cmd: (gdb)[space] */
+	if (!(cmd_iter = strchr(cmd_list_buf, '\n')))
+		return 0;
+
+	cmd_iter++;
+
+	/* unambiguous cmd: break\n(gdb)[space] */
+	if (!strncmp(cmd_iter, "(gdb) ", 6))
+		return cmd_iter - cmd_list_buf - 1;
+	/* ambiguous cmd: backtrace\nbreak\nbt\n(gdb)[space] */
+
+	return 0;
+}
+
+/* =breakpoint-* records and ^done,bkpt={...} go to the mirror */
+static void note_bkpt_changes(gdbmi_output_t *out)
+{
+	bkpt_info_t *changes;
+
+	if (changes = mi_get_bkpt_changes(out)) {
+		bkpt_table_apply(changes);
+		free_bkpt_info(changes);
+	}
+}
+
+gdb_mi_cmd_state_t handle_mi_output(char *gdbbuf)
+{
+	gdb_mi_cmd_state_t mi_cmd_status;
+	char *ans_ptr;
+
+	if (gdb_out == GDB_OUT_ECHO_INCLUDED) {
+		/* This means echo'ing will be cut */
+		ans_ptr = kill_echo(gdbbuf, 1);
+		gdb_out = GDB_OUT_ECHO_TRIMMED;
+	}
+	else
+		ans_ptr = gdbbuf;
+
+	if (!create_mi_parsetree(ans_ptr)) {
+		/* There is a valid parse tree */
+		note_bkpt_changes(gdbmi_out_ptr);
+		mi_cmd_status = mi_handler(gdbmi_out_ptr);
+		destroy_gdbmi_output();
+		gdbmi_out_ptr = NULL;
+
+		return mi_cmd_status;
+	}
+	/* Parse tree could not be created */
+
+	return GDB_MI_CMD_COMPLETED;
+}
+
+/*
+ * Looks for 'Function "mian" not defined.' in a reply and prints the
+ * names in the symbol index close to it.
+ */
+static void suggest_symbols(const char *ans)
+{
+	const char *sugg[SYMIDX_MAX_SUGGEST];
+	const char *name, *end;
+	int i, n;
+
+	if (!(name = strstr(ans, "Function \"")))
+		return;
+	name += 10;
+	if (!(end = strstr(name, "\" not defined.")))
+		return;
+	if (!(n = symidx_suggest(name, end - name, sugg, SYMIDX_MAX_SUGGEST)))
+		return;
+
+	printf("Did you mean ");
+	for (i = 0; i < n; i++)
+		printf("%s\"%s\"", i ? (i == n - 1 ? " or " : ", ") : "",
+		       sugg[i]);
+	printf("?\n");
+	fflush(stdout);
+}
+
+void handle_cli_output(char *gdbbuf)
+{
+	char *ans_ptr = kill_echo(gdbbuf, 1);
+	int len = strlen(ans_ptr);
+
+	gdb_out = GDB_OUT_ECHO_TRIMMED;
+
+	/* A query typed at the prompt, the same one is answered from here */
+	if (query_pending && !active_reply) {
+		query_pending = 0;
+		if (len >= 6 && !strcmp(ans_ptr + len - 6, "(gdb) ")) {
+			ans_ptr[len - 6] = '\0';
+			stop_cache_store(query_key.str, ans_ptr);
+			ans_ptr[len - 6] = '(';
+		}
+	}
+
+	/* Suggestions go before the prompt */
+	if (symidx_ready() && len >= 6 &&
+	    !strcmp(ans_ptr + len - 6, "(gdb) ")) {
+		write(STDOUT_FILENO, ans_ptr, len - 6);
+		suggest_symbols(ans_ptr);
+		write(STDOUT_FILENO, "(gdb) ", 6);
+	}
+	else
+		write(STDOUT_FILENO, ans_ptr, len);
+}
+
+/* Reply to a command gdbvim sent for itself */
+static void handle_internal_output(char *gdbbuf)
+{
+	char *ans_ptr = kill_echo(gdbbuf, 1);
+
+	gdb_out = GDB_OUT_ECHO_TRIMMED;
+	gdbstatus = GDB_STATE_CLI;
+	internal_more = 0;
+	active_reply->handler(ans_ptr, active_reply->tag);
+	/* The same handler gets the next gdb/mi output too, e.g. *stopped */
+	if (internal_more)
+		gdbstatus = GDB_STATE_MI;
+}
+
+void handle_check_cmd_output(char *gdbbuf)
+{
+	char *ans_ptr = kill_echo(gdbbuf, 1);
+	int completed_len = parse_check_cmd_output(ans_ptr);
+
+	if (completed_len)
+		reconstruct_gdb_line(ans_ptr, completed_len);
+
+	/* The check is answered, now the command itself */
+	gdb_direct_busy = 0;
+	do_gdb_line(current_gdb_line.str);
+}
+
+/* Reply to "server complete", the list goes to the cache */
+void handle_completion_output(char *gdbbuf)
+{
+	char *ans_ptr = kill_echo(gdbbuf, 1);
+	compl_entry_t *e;
+
+	gdb_out = GDB_OUT_ECHO_TRIMMED;
+	gdbstatus = GDB_STATE_CLI;
+
+	compl_cache_store(compl_line.str, ans_ptr);
+	/* The line may have changed while gdb was busy */
+	if (e = compl_cache_lookup(rl_line_buffer)) {
+		complete_from_cache(e, 0);
+		rl_redisplay();
+	}
+}
+
+/*
+ * Input typed ahead while the program runs. PROG_INPUT_KEY switches
+ * between readline and the program, what follows it in inbuf goes to
+ * the other side.
+ */
+static void handle_typeahead(char *inbuf, int nread)
+{
+	char *key;
+	int len;
+
+	while (nread > 0) {
+		key = memchr(inbuf, PROG_INPUT_KEY, nread);
+		len = key ? key - inbuf : nread;
+		if (len)
+			write(prog_input ? prog_ptym : readline_ptym, inbuf,
+			      len);
+		if (!key)
+			return;
+		prog_input = !prog_input;
+		printf("\n[%s]\n", prog_input ? "input to the program" :
+		       "input to gdb, queued");
+		fflush(stdout);
+		inbuf += len + 1;
+		nread -= len + 1;
+	}
+}
+
+/* Lines the user typed ahead; gdbvim's own commands and Vim's stay */
+static int drop_typeahead(void)
+{
+	cmd_queue_t keep = {NULL, NULL, 0};
+	cmd_entry_t *e, *k;
+	int n = 0;
+
+	while (e = cmd_queue_pop(&pending_queue)) {
+		if (!e->handler)
+			n++;
+		else if (k = cmd_queue_push(&keep, e->line, e->len,
+					    e->state)) {
+			k->handler = e->handler;
+			k->tag = e->tag;
+		}
+		free_cmd_entry(e);
+	}
+	pending_queue = keep;
+
+	return n;
+}
+
+/*
+ * gdb runs the program synchronously and reads no command until it
+ * stops, so an -exec-interrupt would only be queued behind it. The
+ * program's process group gets SIGINT instead, and gdb reports the
+ * stop at once. When its pid is not known, e.g. after an attach from
+ * the command line, or when gdb itself is busy, the interrupt character
+ * goes to gdb's terminal as if ^C were typed there.
+ */
+static void signal_program(int running)
+{
+	pid_t pid, pgrp;
+
+	if (running && (pid = inferior_pid()) > 0) {
+		/* Not ours: an attached process may share our group */
+		pgrp = getpgid(pid);
+		if (pgrp > 0 && pgrp != getpgrp() ? !kill(-pgrp, SIGINT) :
+		    !kill(pid, SIGINT))
+			return;
+	}
+	write(gdb_ptym, "\003", 1);
+}
+
+static void interrupt_gdb(void)
+{
+	int n;
+
+	/* A continue typed ahead is not to run it again at once */
+	if (n = drop_typeahead())
+		printf("[%d line%s typed ahead dropped]\n", n,
+		       n == 1 ? "" : "s");
+	if (load_file && load_locs.count) {
+		printf("[loading %s stopped]\n", load_file);
+		cmd_queue_clear(&load_locs);
+	}
+	fflush(stdout);
+
+	/* A profile ends at its next stop, the main loop makes it now */
+	if (profile_active()) {
+		profile_cancel();
+		return;
+	}
+	signal_program(prog_running);
+}
+
+/* At the prompt, ^C drops the line being typed as a shell does */
+static void handle_interrupt(void)
+{
+	char buf[16];
+
+	while (read(sig_pipe[0], buf, sizeof(buf)) > 0)
+		;
+	if (!gdb_is_ready()) {
+		interrupt_gdb();
+		return;
+	}
+	rl_replace_line("", 0);
+	printf("^C\n");
+	fflush(stdout);
+	rl_forced_update_display();
+}
+
+void handle_user_input(char *inbuf)
+{
+	int nread;
+
+	/* gdb or prog input */
+	if (gdbstatus == GDB_STATE_CLI || gdbstatus == GDB_STATE_STARTUP ||
+	    gdbstatus == GDB_STATE_COMPLETION) {
+		/* input for gdb */
+		nread = read(STDIN_FILENO, inbuf, IN_BUF_SIZE);
+		if (*inbuf != '\t')
+			prev_key = KEY_OTHER;
+		prog_input = 0;
+		write(readline_ptym, inbuf, nread);
+	}
+	else if (typeahead_on) {
+		nread = read(STDIN_FILENO, inbuf, IN_BUF_SIZE);
+		prev_key = KEY_OTHER;
+		if (nread > 0)
+			handle_typeahead(inbuf, nread);
+	}
+	else { /* input for prog */
+		/*
+		 * The only possibility for a program to get input is the
+		 * state of already being run, and a program is
+		 * in that condition only if execution control commands
+		 * are being executed. That means that gdb must be operating
+		 * in the mi state.
+		 */
+		nread = read(STDIN_FILENO, inbuf, IN_BUF_SIZE);
+		write(prog_ptym, inbuf, nread);
+	}
+}
+
+/* Appends whatever gdb has written to gdb_acc */
+static int read_gdb_output(void)
+{
+	char *new_acc;
+	int new_size;
+	int nread;
+
+	if (gdb_acc_size - gdb_acc_len < GDB_BUF_SIZE + 1) {
+		/* Doubled, so a long reply is not copied over and over */
+		new_size = gdb_acc_size ? gdb_acc_size * 2 : GDB_BUF_SIZE * 4;
+		if (!(new_acc = (char *)realloc(gdb_acc, new_size))) {
+			fprintf(stderr, "Cannot allocate memory\n");
+			return -1;
+		}
+		gdb_acc = new_acc;
+		gdb_acc_size = new_size;
+	}
+
+	nread = read(gdb_ptym, gdb_acc + gdb_acc_len,
+		     gdb_acc_size - gdb_acc_len - 1);
+	if (nread <= 0)
+		return nread;
+	gdb_acc_len += nread;
+	gdb_acc[gdb_acc_len] = '\0';
+
+	return nread;
+}
+
+/*
+ * Whether the n bytes at rest may start the next reply of a batch: gdb
+ * echoes each command after the prompt, a reply without a command is
+ * the gdb/cli prompt after gdb/mi output. Without a batch, nothing but
+ * that prompt may follow.
+ */
+static int starts_next_reply(const char *rest, int n)
+{
+	cmd_entry_t *e = reply_queue.head;
+	const char *echo = "(gdb) ";
+	int len;
+
+	if (e && e->len)
+		echo = e->mi_cmd && !e->handler ? "interpreter mi \"" : e->line;
+	len = strlen(echo);
+
+	return !strncmp(rest, echo, n < len ? n : len);
+}
+
+/*
+ * Whether the prompt of len bytes at p ends a reply. It must start a
+ * line, readline's bracketed paste switch aside, and either end what
+ * has come so far or be followed by the next reply; "(gdb) " in the
+ * output of print, list or echo is not a prompt.
+ */
+static int is_reply_end(const char *p, int len)
+{
+	const char *line = p;
+	const char *rest = p + len;
+
+	if (line - gdb_acc >= 8 && !strncmp(line - 8, "\033[?2004h", 8))
+		line -= 8;
+	if (line > gdb_acc && line[-1] != '\n')
+		return 0;
+
+	return starts_next_reply(rest, gdb_acc + gdb_acc_len - rest);
+}
+
+/*
+ * Returns the first reply in gdb_acc ending with pattern as a null
+ * terminated string, NULL if it has not been complete yet. A read may
+ * contain more than one reply when a batch of commands is answered,
+ * so the pattern is looked up in the whole buffer instead of its end.
+ * The part already searched for the same pattern is not searched
+ * again, a long reply would be scanned once per read otherwise.
+ */
+static char *get_gdb_reply(const char *pattern)
+{
+	int pattern_len = strlen(pattern);
+	int from = 0;
+	char *end;
+
+	if (!gdb_acc_len)
+		return NULL;
+	if (pattern == gdb_acc_pattern && gdb_acc_scanned > pattern_len)
+		from = gdb_acc_scanned - pattern_len + 1;
+	for (end = gdb_acc + from; (end = strstr(end, pattern)) &&
+	     !is_reply_end(end, pattern_len); end++)
+		;
+	if (!end) {
+		gdb_acc_pattern = pattern;
+		gdb_acc_scanned = gdb_acc_len;
+		return NULL;
+	}
+
+	gdb_reply_len = end - gdb_acc + strlen(pattern);
+	gdb_reply_end = gdb_acc[gdb_reply_len];
+	gdb_acc[gdb_reply_len] = '\0';
+
+	/* logged for debugging purposes */
+	logger(gdb_acc, gdb_reply_len, 1);
+
+	return gdb_acc;
+}
+
+/* Drops the reply handed out by get_gdb_reply, keeps the rest */
+static void release_gdb_reply(void)
+{
+	gdb_acc[gdb_reply_len] = gdb_reply_end;
+	memmove(gdb_acc, gdb_acc + gdb_reply_len,
+		gdb_acc_len - gdb_reply_len + 1);
+	gdb_acc_len -= gdb_reply_len;
+	gdb_reply_len = 0;
+	gdb_acc_scanned = 0;
+}
+
+static void next_reply(void);
+
+/* The prompt after the gdb/mi output of gdbvim's own command */
+static void discard_reply(char *reply, long tag)
+{
+}
+
+/*
+ * Everything entered while gdb was not ready goes out in one write.
+ * The replies come back in order and are read one by one through
+ * reply_queue. Commands are not checked with "server complete" here,
+ * the ones not in the gdb/mi table simply go as gdb/cli commands.
+ */
+static void flush_pending_queue(void)
+{
+	const gdb_mi_cmd_t *mi_cmd_ptr;
+	cmd_entry_t *e, *reply;
+	char *args;
+	int cmd_len, start;
+
+	strbuf_reset(&gdb_cmd_sb);
+	while (e = cmd_queue_pop(&pending_queue)) {
+		start = gdb_cmd_sb.len;
+		if (e->handler) {
+			/* gdbvim's own, sent as it is */
+			strbuf_printf(&gdb_cmd_sb, "%s\n", e->line);
+			reply = cmd_queue_push(&reply_queue, e->line,
+					       gdb_cmd_sb.len - start,
+					       e->state);
+			if (reply) {
+				reply->handler = e->handler;
+				reply->tag = e->tag;
+			}
+			if (e->state == GDB_STATE_MI &&
+			    (reply = cmd_queue_push(&reply_queue, NULL, 0,
+						    GDB_STATE_CLI)))
+				reply->handler = discard_reply;
+			free_cmd_entry(e);
+			continue;
+		}
+
+		tokenize_gdb_line(e->line, &cmd_len, &args);
+		mi_cmd_ptr = is_gdb_mi_cmd(e->line, cmd_len);
+		note_cmd_effects(e->line, cmd_len, args, mi_cmd_ptr);
+
+		if (mi_cmd_ptr &&
+		    !make_gdb_mi_cmd(&gdb_cmd_sb, mi_cmd_ptr, args)) {
+			reply = cmd_queue_push(&reply_queue, e->line,
+					       gdb_cmd_sb.len - start,
+					       GDB_STATE_MI);
+			if (reply)
+				reply->mi_cmd = mi_cmd_ptr;
+			/* gdb/cli prompt follows the gdb/mi output */
+			cmd_queue_push(&reply_queue, NULL, 0, GDB_STATE_CLI);
+		}
+		else {
+			strbuf_printf(&gdb_cmd_sb, "%s\n", e->line);
+			cmd_queue_push(&reply_queue, e->line,
+				       gdb_cmd_sb.len - start, GDB_STATE_CLI);
+		}
+		free_cmd_entry(e);
+	}
+
+	if (!gdb_cmd_sb.len)
+		return;
+	write(gdb_ptym, gdb_cmd_sb.str, gdb_cmd_sb.len);
+
+	next_reply();
+}
+
+/* Makes the next reply of the batch the one being read */
+static void next_reply(void)
+{
+	if (active_reply)
+		free_cmd_entry(active_reply);
+
+	if (!(active_reply = cmd_queue_pop(&reply_queue))) {
+		if (pending_queue.count)
+			flush_pending_queue();
+		else if (rl_end) {
+			/* Bring back what the user has been typing */
+			write(STDOUT_FILENO, "\r", 1);
+			rl_forced_update_display();
+		}
+		return;
+	}
+
+	gdbstatus = active_reply->state;
+	gdb_cmd_len = active_reply->len;
+	if (active_reply->mi_cmd)
+		mi_handler = active_reply->mi_cmd->handler;
+	if (active_reply->len)
+		gdb_out = GDB_OUT_ECHO_INCLUDED;
+	else
+		gdb_out = GDB_OUT_ECHO_TRIMMED;
+
+	if (active_reply->line && !active_reply->handler) {
+		/* As if it were typed right after the prompt */
+		printf("%s\n", active_reply->line);
+		fflush(stdout);
+	}
+}
+
+/*
+ * Queues a command gdbvim sends for itself. Its reply is given to
+ * handler with tag instead of being shown. It goes out with the next
+ * batch, at once if gdb is ready.
+ */
+static void queue_internal_cmd(const char *line, gdb_state_t state,
+			       void (*handler)(char *reply, long tag),
+			       long tag)
+{
+	cmd_entry_t *e;
+
+	if (!(e = cmd_queue_push(&pending_queue, line, 0, state)))
+		return;
+	e->handler = handler;
+	e->tag = tag;
+}
+
+static void do_internal_cmd(const char *line, gdb_state_t state,
+			    void (*handler)(char *reply, long tag))
+{
+	queue_internal_cmd(line, state, handler, 0);
+	if (gdb_is_ready())
+		flush_pending_queue();
+}
+
+static void load_sym_functions(char *reply, long tag)
+{
+	/* gdb older than 10 does not have -symbol-info-* */
+	if (!strncmp(reply, "^error", 6)) {
+		symidx_failed = 1;
+		return;
+	}
+	symidx_load_mi(SYM_FUNC, reply);
+}
+
+static void load_sym_variables(char *reply, long tag)
+{
+	if (symidx_failed || !strncmp(reply, "^error", 6))
+		return;
+	symidx_load_mi(SYM_VAR, reply);
+	symidx_commit();
+}
+
+/*
+ * The names of all functions and variables, with the ones in the
+ * libraries without debug information, make the symbol index. It is
+ * built once gdb is idle and replaces the old one when both replies
+ * have been read.
+ */
+static void request_symbol_index(void)
+{
+	symidx_failed = 0;
+	symidx_begin();
+	do_internal_cmd("interpreter mi \"-symbol-info-functions "
+			"--include-nondebug\"", GDB_STATE_MI,
+			load_sym_functions);
+	do_internal_cmd("interpreter mi \"-symbol-info-variables "
+			"--include-nondebug\"", GDB_STATE_MI,
+			load_sym_variables);
+}
+
+static void store_prefetch(char *reply, long tag)
+{
+	stop_cache_store(active_reply->line, reply);
+	/* The frames are the first page of the stack window too */
+	if (!strcmp(active_reply->line, PREFETCH_FRAMES) &&
+	    tag == (long)stop_cache_epoch()) {
+		frame_win_sync(tag);
+		if (frame_win_ask(0))
+			frame_win_store(0, reply);
+	}
+}
+
+/*
+ * Right after a stop the user is about to look at the stack and the
+ * locals. Both are asked once gdb is idle, so anything typed goes
+ * first; their replies are dropped if the program runs meanwhile.
+ */
+static void prefetch_stop(void)
+{
+	queue_internal_cmd(PREFETCH_FRAMES, GDB_STATE_MI, store_prefetch,
+			   stop_cache_epoch());
+	queue_internal_cmd(PREFETCH_LOCALS, GDB_STATE_MI, store_prefetch, 0);
+	prefetch_sent++;
+}
+
+/* The program is to run before gdb gets idle, the stop is over */
+static void cancel_stop_work(void)
+{
+	if (prefetch_wanted)
+		prefetch_cancelled++;
+	prefetch_wanted = 0;
+	watch_wanted = 0;
+	regs_wanted = 0;
+	disas_wanted = 0;
+}
+
+/* Output nobody asked for at the prompt goes in place of its line */
+static void begin_async_output(void)
+{
+	write(STDOUT_FILENO, "\r\033[K", 4);
+}
+
+static void end_async_output(void)
+{
+	fflush(stdout);
+	write(STDOUT_FILENO, rl_prompt, strlen(rl_prompt));
+}
+
+/* Parses a gdb/mi reply; 0 on success, gdbmi_out_ptr has the tree */
+static int parse_internal_reply(const char *reply)
+{
+	char *str;
+
+	if (create_mi_parsetree((char *)reply) < 0) {
+		printf("Unexpected reply from gdb\n");
+		return -1;
+	}
+	if (str = mi_get_error_result_record(gdbmi_out_ptr)) {
+		printf("%s\n", str);
+		free(str);
+		destroy_gdbmi_output();
+		gdbmi_out_ptr = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void release_internal_reply(void)
+{
+	destroy_gdbmi_output();
+	gdbmi_out_ptr = NULL;
+}
+
+static void watch_created(char *reply, long tag)
+{
+	cmd_entry_t *exp = cmd_queue_pop(&watch_exps);
+	varobj_info_t *vo;
+	int n;
+
+	begin_async_output();
+	if (exp && !parse_internal_reply(reply)) {
+		if (vo = mi_get_varobj(gdbmi_out_ptr)) {
+			vo->exp = exp->line;
+			exp->line = NULL;
+			if ((n = watch_add(vo)) > 0)
+				printf("%d: %s = %s\n", n, vo->exp,
+				       vo->value ? vo->value : "");
+		}
+		free_varobj_info(vo);
+		release_internal_reply();
+	}
+	if (exp)
+		free_cmd_entry(exp);
+	end_async_output();
+}
+
+/* tag is 1 if the user has expanded it, the panel is shown then */
+static void watch_children(char *reply, long tag)
+{
+	varobj_info_t *children;
+	watch_var_t *w;
+	char name[WATCH_NAME_MAX];
+	int from;
+
+	/* interpreter mi "-var-list-children --all-values var1 20 39" */
+	if (sscanf(active_reply->line, "interpreter mi \"-var-list-children "
+		   "--all-values %255s %d", name, &from) != 2)
+		return;
+	/* Removed meanwhile */
+	if (!(w = watch_find(name)))
+		return;
+
+	if (tag)
+		begin_async_output();
+	if (!parse_internal_reply(reply)) {
+		children = mi_get_varobj_list(gdbmi_out_ptr, "children");
+		watch_set_children(w, from, children);
+		free_varobj_info(children);
+		release_internal_reply();
+		if (tag)
+			watch_print(0);
+	}
+	if (tag)
+		end_async_output();
+}
+
+/* Only the window of children starting at from is asked */
+static void queue_watch_children(watch_var_t *w, int from, long show)
+{
+	strbuf_reset(&gdb_cmd_sb);
+	strbuf_printf(&gdb_cmd_sb, "interpreter mi \"-var-list-children "
+		      "--all-values %s %d %d\"", w->name, from,
+		      from + WATCH_PAGE_SIZE);
+	queue_internal_cmd(gdb_cmd_sb.str, GDB_STATE_MI, watch_children,
+			   show);
+}
+
+/*
+ * The changelist of -var-update has only what has changed since the
+ * last stop, only those lines are shown. Expanded watches whose shape
+ * has changed ask their children again.
+ */
+static void watch_updated(char *reply, long tag)
+{
+	varobj_info_t *changes;
+	watch_var_t *w;
+
+	if (parse_internal_reply(reply))
+		return;
+	changes = mi_get_varobj_list(gdbmi_out_ptr, "changelist");
+	if (watch_update(changes)) {
+		begin_async_output();
+		watch_print(1);
+		end_async_output();
+	}
+	free_varobj_info(changes);
+	release_internal_reply();
+
+	while (w = watch_next_refetch())
+		queue_watch_children(w, w->child_from, 0);
+}
+
+static void regs_named(char *reply, long tag)
+{
+	if (regs_load_names(reply) < 0) {
+		regs_on = 0;
+		begin_async_output();
+		if (!parse_internal_reply(reply))
+			release_internal_reply();
+		end_async_output();
+	}
+}
+
+/* tag is 1 to show only what has changed, 0 to show all of them */
+static void regs_fetched(char *reply, long tag)
+{
+	int n = regs_load_values(reply);
+
+	if (n < 0) {
+		begin_async_output();
+		if (!parse_internal_reply(reply))
+			release_internal_reply();
+		end_async_output();
+	}
+	else if (n || !tag) {
+		begin_async_output();
+		regs_print(tag);
+		end_async_output();
+	}
+}
+
+/* Only the values of the registers changed since the last stop */
+static void regs_changed(char *reply, long tag)
+{
+	static strbuf_t sb;
+	int n;
+
+	if (!regs_known())
+		return;
+	strbuf_reset(&sb);
+	strbuf_puts(&sb, "interpreter mi \"-data-list-register-values x");
+	if ((n = regs_new_stop(reply, &sb)) < 0) {
+		/* No registers: the program is not running */
+		if (!tag)
+			regs_fetched(reply, 0);
+		return;
+	}
+	/* Nothing has changed since gdb was last asked */
+	if (!n) {
+		if (!tag)
+			regs_fetched("^done", 0);
+		return;
+	}
+	strbuf_putc(&sb, '\"');
+	queue_internal_cmd(sb.str, GDB_STATE_MI, regs_fetched, tag);
+}
+
+static void gv_cmd_regs(char *args)
+{
+	if (!strcmp(args, "on")) {
+		if (regs_on)
+			return;
+		regs_on = 1;
+		if (!regs_known())
+			queue_internal_cmd(REGS_NAMES, GDB_STATE_MI, regs_named,
+					   0);
+		queue_internal_cmd(REGS_CHANGED, GDB_STATE_MI, regs_changed,
+				   0);
+		if (gdb_is_ready())
+			flush_pending_queue();
+	}
+	else if (!strcmp(args, "off"))
+		regs_on = regs_wanted = 0;
+	else if (*args)
+		printf("\"on\" or \"off\" expected.\n");
+	else if (!regs_on)
+		printf("The register panel is off.\n");
+	else
+		regs_print(0);
+}
+
+static void bkpt_synced(char *reply, long tag)
+{
+	bkpt_info_t *list;
+
+	bkpt_syncing = 0;
+	/* Not asked again and again if gdb's answer can not be read */
+	if (parse_internal_reply(reply)) {
+		bkpt_sync_wanted = 0;
+		bkpt_stale = 1;
+		return;
+	}
+	bkpt_stale = 0;
+	list = mi_get_bkpt_table(gdbmi_out_ptr);
+	bkpt_table_load(list);
+	free_bkpt_info(list);
+	release_internal_reply();
+}
+
+static void gv_cmd_break(char *args)
+{
+	if (bkpt_sync_wanted || bkpt_syncing)
+		printf("Breakpoints have changed, gdb is to be asked.\n");
+	else if (bkpt_stale)
+		printf("The breakpoint table of gdb could not be read.\n");
+	else
+		bkpt_table_print();
+}
+
+static void queue_load_window(void);
+
+/* Each -break-insert of a file being loaded, tag is its line number */
+static void bkpt_loaded(char *reply, long tag)
+{
+	char *str = NULL;
+
+	if (create_mi_parsetree(reply) < 0)
+		load_failed++;
+	else if (str = mi_get_error_result_record(gdbmi_out_ptr)) {
+		if (load_failed++ < LOAD_ERRORS_MAX) {
+			begin_async_output();
+			printf("%s:%ld: %s\n", load_file, tag, str);
+			end_async_output();
+		}
+		free(str);
+	}
+	else {
+		note_bkpt_changes(gdbmi_out_ptr);
+		load_done++;
+	}
+	if (gdbmi_out_ptr)
+		release_internal_reply();
+
+	/* The next window goes as soon as this batch is over */
+	if (--load_window == 0)
+		queue_load_window();
+}
+
+static void report_load(void)
+{
+	struct timeval now;
+	long ms;
+
+	gettimeofday(&now, NULL);
+	ms = (now.tv_sec - load_start.tv_sec) * 1000 +
+	     (now.tv_usec - load_start.tv_usec) / 1000;
+	begin_async_output();
+	if (load_failed > LOAD_ERRORS_MAX)
+		printf("... and %d more errors\n",
+		       load_failed - LOAD_ERRORS_MAX);
+	printf("%s: %d breakpoints set, %d failed, in %ld.%03ld s\n",
+	       load_file, load_done, load_failed, ms / 1000, ms % 1000);
+	end_async_output();
+	free(load_file);
+	load_file = NULL;
+}
+
+/*
+ * The replies of a window are read one by one as they come, while the
+ * next window waits for the end of the batch. Windows are kept small,
+ * so gdb never blocks on its output while gdbvim is still writing.
+ */
+static void queue_load_window(void)
+{
+	static strbuf_t sb;
+	cmd_entry_t *e;
+	char *loc;
+
+	while (load_window < LOAD_WINDOW && (e = cmd_queue_pop(&load_locs))) {
+		loc = e->line;
+		if (!strncmp(loc, "tbreak ", 7)) {
+			make_internal_mi_cmd(&sb, "-break-insert -t", loc + 7);
+		}
+		else {
+			if (!strncmp(loc, "break ", 6))
+				loc += 6;
+			make_internal_mi_cmd(&sb, "-break-insert", loc);
+		}
+		queue_internal_cmd(sb.str, GDB_STATE_MI, bkpt_loaded, e->tag);
+		free_cmd_entry(e);
+		load_window++;
+	}
+	if (!load_window)
+		report_load();
+}
+
+/*
+ * One location per line, as for the break command; "break " or
+ * "tbreak " in front is allowed, so a gdb script of breakpoints can
+ * be loaded too. Empty lines and lines from a '#' on are skipped.
+ */
+static void gv_cmd_load(char *args)
+{
+	char line[LOAD_LINE_SIZE], *s;
+	cmd_entry_t *e;
+	long lineno = 0;
+	FILE *fp;
+
+	if (load_file) {
+		printf("%s is being loaded.\n", load_file);
+		return;
+	}
+	if (!(fp = fopen(args, "r"))) {
+		printf("Cannot open %s.\n", args);
+		return;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		lineno++;
+		line[strcspn(line, "#\r\n")] = '\0';
+		s = stripws(line);
+		if (!*s)
+			continue;
+		if (!(e = cmd_queue_push(&load_locs, s, 0, GDB_STATE_MI)))
+			break;
+		e->tag = lineno;
+	}
+	fclose(fp);
+	if (!load_locs.count) {
+		printf("No breakpoints in %s.\n", args);
+		return;
+	}
+	if (!(load_file = strdup(args))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		cmd_queue_clear(&load_locs);
+		return;
+	}
+	load_done = load_failed = 0;
+	gettimeofday(&load_start, NULL);
+	queue_load_window();
+	if (gdb_is_ready())
+		flush_pending_queue();
+}
+
+static void gv_cmd_libs(char *args)
+{
+	lib_entry_t *lib;
+	unsigned long addr;
+
+	if (strncmp(args, "0x", 2)) {
+		inferior_print_libs(*args ? args : NULL);
+		return;
+	}
+	addr = strtoul(args, NULL, 16);
+	if (lib = inferior_lib_at(addr))
+		printf("0x%lx is in %s\n", addr, lib->name);
+	else
+		printf("No shared library at 0x%lx.\n", addr);
+}
+
+static void gv_cmd_threads(char *args)
+{
+	inferior_print_threads();
+}
+
+static void profile_stack(char *reply, long tag)
+{
+	profile_add_stack(reply);
+}
+
+/*
+ * *stopped,reason="exited",exit-code="01", or "exited-normally", or
+ * "exited-signalled" with the signal-name
+ */
+static void print_exit(const char *stop)
+{
+	const char *s;
+
+	if (s = strstr(stop, "exit-code=\""))
+		printf("The program exited with code %.*s.\n",
+		       (int)strcspn(s + 11, "\""), s + 11);
+	else if (s = strstr(stop, "signal-name=\""))
+		printf("The program was terminated by %.*s.\n",
+		       (int)strcspn(s + 13, "\""), s + 13);
+	else
+		printf("The program exited normally.\n");
+}
+
+/* The last stop of a profile is shown as any other stop */
+static void end_profile(char *stop)
+{
+	begin_async_output();
+	profile_write(profile_file);
+	profile_stop();
+	free(profile_file);
+	profile_file = NULL;
+	if (stop && !create_mi_parsetree(stop)) {
+		parse_mi_parsetree(gdbmi_out_ptr);
+		release_internal_reply();
+	}
+	end_async_output();
+}
+
+static void profile_continued(char *reply, long tag);
+
+/*
+ * The stacks of all threads are asked and the program is continued in
+ * one batch; the next one is sent when it stops again.
+ */
+static void queue_profile_sample(void)
+{
+	static strbuf_t sb;
+	int ids[PROFILE_THREADS_MAX];
+	int i, n;
+
+	/* Threads are not known after an attach from the command line */
+	if (!(n = inferior_threads(ids, PROFILE_THREADS_MAX)))
+		queue_internal_cmd("interpreter mi \"-stack-list-frames\"",
+				   GDB_STATE_MI, profile_stack, 0);
+	for (i = 0; i < n; i++) {
+		strbuf_reset(&sb);
+		strbuf_printf(&sb, "interpreter mi \"-stack-list-frames "
+			      "--thread %d\"", ids[i]);
+		queue_internal_cmd(sb.str, GDB_STATE_MI, profile_stack, ids[i]);
+	}
+	queue_internal_cmd(PROFILE_CONT, GDB_STATE_MI, profile_continued, 0);
+}
+
+/* Both the ^running of -exec-continue and the *stopped that follows */
+static void profile_continued(char *reply, long tag)
+{
+	char *str;
+
+	/* Threads come and go while it is profiled */
+	inferior_scan(reply);
+	if (!strncmp(reply, "^error", 6)) {
+		if (!create_mi_parsetree(reply)) {
+			if (str = mi_get_error_result_record(gdbmi_out_ptr)) {
+				printf("%s\n", str);
+				free(str);
+			}
+			release_internal_reply();
+		}
+		end_profile(NULL);
+		return;
+	}
+	if (!strstr(reply, "*stopped")) {
+		profile_resumed();
+		internal_more = 1;
+		return;
+	}
+	/* There is no frame to show, only how it ended */
+	if (strstr(reply, "reason=\"exited")) {
+		prog_running = 0;
+		print_exit(reply);
+		end_profile(NULL);
+		return;
+	}
+	if (profile_over()) {
+		end_profile(reply);
+		return;
+	}
+	queue_profile_sample();
+}
+
+static void gv_cmd_profile(char *args)
+{
+	char file[LOAD_LINE_SIZE] = PROF_DEFAULT_FILE;
+	int hz = PROF_DEFAULT_HZ, seconds = PROF_DEFAULT_SECONDS;
+
+	if (profile_active()) {
+		printf("Profiling to %s, ^C stops it.\n", profile_file);
+		return;
+	}
+	if ((*args && sscanf(args, "%d %d %1023s", &hz, &seconds, file) < 1) ||
+	    hz <= 0 || hz > 1000 || seconds <= 0) {
+		printf("Rate in Hz and duration in seconds expected.\n");
+		return;
+	}
+	if (!gdb_is_ready()) {
+		printf("gdb is busy.\n");
+		return;
+	}
+	if (!(profile_file = strdup(file))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return;
+	}
+	profile_start(hz, seconds);
+	/* It runs, nothing asked at this stop holds any more */
+	cancel_stop_work();
+	stop_cache_running();
+	printf("Profiling at %d Hz for %d s, ^C stops it.\n", hz, seconds);
+	do_internal_cmd(PROFILE_CONT, GDB_STATE_MI, profile_continued);
+}
+
+static void stack_page_fetched(char *reply, long tag);
+
+static void queue_stack_page(int page)
+{
+	static strbuf_t sb;
+
+	strbuf_reset(&sb);
+	strbuf_printf(&sb, "interpreter mi \"-stack-list-frames %d %d\"",
+		      page * FRAME_PAGE_SIZE, (page + 1) * FRAME_PAGE_SIZE - 1);
+	queue_internal_cmd(sb.str, GDB_STATE_MI, stack_page_fetched, page);
+}
+
+/* The pages of the screen not kept yet are asked if fetch is set */
+static int stack_pages_missing(int fetch)
+{
+	int page, last, missing = 0, depth = frame_win_depth();
+
+	/* Past the bottom, which was not known: the last screen instead */
+	if (depth >= 0 && stack_top >= depth)
+		stack_top = depth > STACK_SCREEN ? depth - STACK_SCREEN : 0;
+	last = stack_top + STACK_SCREEN - 1;
+	if (depth >= 0 && last >= depth)
+		last = depth - 1;
+	for (page = stack_top / FRAME_PAGE_SIZE;
+	     page <= last / FRAME_PAGE_SIZE; page++) {
+		if (frame_win_has(page))
+			continue;
+		if (fetch && frame_win_ask(page))
+			queue_stack_page(page);
+		missing++;
+	}
+
+	return missing;
+}
+
+static void show_stack(void)
+{
+	stack_page_t *p = NULL;
+	int level, depth = frame_win_depth();
+
+	for (level = stack_top; level < stack_top + STACK_SCREEN; level++) {
+		if (!p || level % FRAME_PAGE_SIZE == 0)
+			p = frame_win_page(level / FRAME_PAGE_SIZE);
+		if (!p || level % FRAME_PAGE_SIZE >= p->count)
+			break;
+		printf("%s\n", p->lines[level % FRAME_PAGE_SIZE]);
+	}
+	if (level == stack_top)
+		printf("No stack.\n");
+	else if (depth < 0)
+		printf("Frames %d-%d, \"gv stack +\" for more\n", stack_top,
+		       level - 1);
+	else
+		printf("Frames %d-%d of %d\n", stack_top, level - 1, depth);
+}
+
+/*
+ * The screen is shown now if its pages are kept, or else when the last
+ * of them comes. The page after it is asked ahead when the screen gets
+ * near its end, so scrolling on does not wait for gdb.
+ */
+static void show_stack_when_fetched(int async)
+{
+	int next, depth;
+
+	if (!(stack_show_wanted = stack_pages_missing(1) > 0)) {
+		if (async)
+			begin_async_output();
+		show_stack();
+		if (async)
+			end_async_output();
+	}
+	next = (stack_top + 2 * STACK_SCREEN - 1) / FRAME_PAGE_SIZE;
+	depth = frame_win_depth();
+	if ((depth < 0 || next * FRAME_PAGE_SIZE < depth) &&
+	    frame_win_ask(next))
+		queue_stack_page(next);
+}
+
+/* Shows the error of a reply gdb gave instead of the frames */
+static void stack_fetch_failed(char *reply)
+{
+	stack_show_wanted = stack_bottom_wanted = 0;
+	begin_async_output();
+	if (!parse_internal_reply(reply))
+		release_internal_reply();
+	end_async_output();
+}
+
+static void stack_depth_known(char *reply, long tag);
+
+static void stack_page_fetched(char *reply, long tag)
+{
+	/* Asked before the program ran, or another frame was selected */
+	if (frame_win_sync(stop_cache_epoch())) {
+		stack_show_wanted = 0;
+		return;
+	}
+	if (frame_win_store(tag, reply) < 0) {
+		if (!stack_show_wanted || stack_bottom_wanted)
+			return;
+		if (frame_win_depth() >= 0)
+			show_stack_when_fetched(1);
+		else if (strstr(reply, "Not enough frames")) {
+			/* Scrolled past the bottom, the last screen instead */
+			stack_bottom_wanted = 1;
+			queue_internal_cmd(STACK_DEPTH, GDB_STATE_MI,
+					   stack_depth_known, 0);
+		}
+		else
+			stack_fetch_failed(reply);
+		return;
+	}
+	/* The bottom may have turned up, the screen may need other pages */
+	if (stack_show_wanted && !stack_bottom_wanted &&
+	    !stack_pages_missing(1)) {
+		stack_show_wanted = 0;
+		begin_async_output();
+		show_stack();
+		end_async_output();
+	}
+}
+
+static void stack_depth_known(char *reply, long tag)
+{
+	char *str;
+
+	if (frame_win_sync(stop_cache_epoch()) || !stack_bottom_wanted)
+		return;
+	if (!(str = strstr(reply, "depth=\""))) {
+		stack_fetch_failed(reply);
+		return;
+	}
+	stack_bottom_wanted = 0;
+	frame_win_set_depth(atoi(str + 7));
+	stack_top = frame_win_depth();
+	show_stack_when_fetched(1);
+}
+
+static void gv_cmd_stack(char *args)
+{
+	if (prog_running) {
+		printf("The program is running.\n");
+		return;
+	}
+	/* A new stop, or another thread: it starts at the top again */
+	if (frame_win_sync(stop_cache_epoch()))
+		stack_top = 0;
+	stack_bottom_wanted = 0;
+	if (!strcmp(args, "+"))
+		stack_top += STACK_SCREEN;
+	else if (!strcmp(args, "-"))
+		stack_top = stack_top > STACK_SCREEN ?
+			    stack_top - STACK_SCREEN : 0;
+	else if (!strcmp(args, "$") && frame_win_depth() >= 0)
+		stack_top = frame_win_depth();
+	else if (!strcmp(args, "$"))
+		stack_bottom_wanted = 1;
+	else if (isdigit((unsigned char)*args))
+		stack_top = atoi(args);
+	else if (*args) {
+		printf("A frame level, +, - or $ expected.\n");
+		return;
+	}
+
+	if (stack_bottom_wanted) {
+		/* Unwinding a deep stack to its bottom takes gdb a while */
+		stack_show_wanted = 1;
+		queue_internal_cmd(STACK_DEPTH, GDB_STATE_MI, stack_depth_known,
+				   0);
+	}
+	else
+		show_stack_when_fetched(0);
+	if (gdb_is_ready())
+		flush_pending_queue();
+}
+
+static void mem_chunk_fetched(char *reply, long tag);
+
+static void queue_mem_chunk(unsigned long addr)
+{
+	static strbuf_t sb;
+
+	strbuf_reset(&sb);
+	strbuf_printf(&sb, "interpreter mi \"-data-read-memory-bytes 0x%lx "
+		      "%d\"", addr, MEM_CHUNK_SIZE);
+	queue_internal_cmd(sb.str, GDB_STATE_MI, mem_chunk_fetched,
+			   (long)addr);
+}
+
+static int mem_screen_size(void)
+{
+	return MEM_SCREEN_LINES * (mem_ascii ? MEM_ASCII_LINE : MEM_HEX_LINE);
+}
+
+/* The chunks of the screen not kept yet are asked if fetch is set */
+static int mem_chunks_missing(int fetch)
+{
+	unsigned long c, last = mem_addr + mem_screen_size() - 1;
+	int missing = 0;
+
+	/* The screen may end past the last address */
+	if (last < mem_addr)
+		last = ~0UL;
+	for (c = mem_addr / MEM_CHUNK_SIZE; c <= last / MEM_CHUNK_SIZE; c++) {
+		if (memview_has(c * MEM_CHUNK_SIZE))
+			continue;
+		if (fetch && memview_ask(c * MEM_CHUNK_SIZE))
+			queue_mem_chunk(c * MEM_CHUNK_SIZE);
+		missing++;
+	}
+
+	return missing;
+}
+
+static void show_mem(int async)
+{
+	if (async)
+		begin_async_output();
+	memview_print(mem_addr, mem_screen_size(), mem_ascii);
+	if (async)
+		end_async_output();
+}
+
+/*
+ * The screen is shown now if its chunks are kept, or else when the
+ * last of them comes. The chunk of the next screen is read ahead.
+ */
+static void show_mem_when_fetched(int async)
+{
+	unsigned long next = mem_addr + 2 * mem_screen_size() - 1;
+
+	if (!(mem_show_wanted = mem_chunks_missing(1) > 0))
+		show_mem(async);
+	if (next > mem_addr && memview_ask(next))
+		queue_mem_chunk(next - next % MEM_CHUNK_SIZE);
+}
+
+static void mem_chunk_fetched(char *reply, long tag)
+{
+	/* Read before the program ran, or memory was changed */
+	if (memview_sync(stop_cache_epoch())) {
+		mem_show_wanted = 0;
+		return;
+	}
+	memview_store((unsigned long)tag, reply);
+	if (mem_show_wanted && !mem_chunks_missing(1)) {
+		mem_show_wanted = 0;
+		show_mem(1);
+	}
+}
+
+/* The value of (unsigned long)(EXPR), for gv mem &buf or gv mem $sp */
+static void mem_addr_known(char *reply, long tag)
+{
+	char *str;
+
+	if (!(str = strstr(reply, "value=\""))) {
+		begin_async_output();
+		if (!parse_internal_reply(reply))
+			release_internal_reply();
+		end_async_output();
+		return;
+	}
+	mem_addr = strtoul(str + 7, NULL, 0);
+	mem_shown = 1;
+	memview_sync(stop_cache_epoch());
+	show_mem_when_fetched(1);
+}
+
+static void gv_cmd_mem(char *args)
+{
+	static strbuf_t sb, expr_sb;
+	char *end;
+
+	if (prog_running) {
+		printf("The program is running.\n");
+		return;
+	}
+	memview_sync(stop_cache_epoch());
+	if (*args == '/') {
+		if ((args[1] != 'a' && args[1] != 'x') ||
+		    (args[2] && args[2] != ' ')) {
+			printf("/x or /a expected.\n");
+			return;
+		}
+		mem_ascii = args[1] == 'a';
+		for (args += 2; *args == ' '; args++)
+			;
+	}
+	if (!*args && !mem_shown) {
+		printf("An address expected.\n");
+		return;
+	}
+	if (!strcmp(args, "+"))
+		mem_addr += mem_screen_size();
+	else if (!strcmp(args, "-"))
+		mem_addr = mem_addr > mem_screen_size() ?
+			   mem_addr - mem_screen_size() : 0;
+	else if (*args) {
+		mem_addr = strtoul(args, &end, 0);
+		/* Not a number: gdb tells the address */
+		if (*end) {
+			strbuf_reset(&expr_sb);
+			strbuf_printf(&expr_sb, "(unsigned long)(%s)", args);
+			make_internal_mi_cmd(&sb, "-data-evaluate-expression",
+					     expr_sb.str);
+			do_internal_cmd(sb.str, GDB_STATE_MI, mem_addr_known);
+			return;
+		}
+		mem_shown = 1;
+	}
+	show_mem_when_fetched(0);
+	if (gdb_is_ready())
+		flush_pending_queue();
+}
+
+static void disas_fetched(char *reply, long tag);
+
+static void queue_disas(unsigned long lo, unsigned long hi)
+{
+	static strbuf_t sb;
+
+	strbuf_reset(&sb);
+	strbuf_printf(&sb, "interpreter mi \"-data-disassemble -s 0x%lx "
+		      "-e 0x%lx -- 2\"", lo, hi);
+	queue_internal_cmd(sb.str, GDB_STATE_MI, disas_fetched, (long)lo);
+}
+
+/* The code from lo is asked DISASM_CHUNK bytes at a time */
+static void queue_disas_chunk(unsigned long lo)
+{
+	unsigned long hi = lo + DISASM_CHUNK;
+
+	queue_disas(lo, hi > lo ? hi : ~0UL);
+}
+
+/* The code of the screen not kept yet is asked; 0 if all of it is */
+static int disas_missing(void)
+{
+	unsigned long gap;
+	int n;
+
+	gap = disasm_walk(disas_addr, DISASM_SCREEN, &n);
+	if (n == DISASM_SCREEN)
+		return 0;
+	if (disasm_ask(gap))
+		queue_disas_chunk(gap);
+
+	return 1;
+}
+
+/*
+ * The screen is shown now if its code is kept, or else when it comes.
+ * The code of the next screen is read ahead.
+ */
+static void show_disas_when_fetched(int async)
+{
+	unsigned long ahead;
+	int n;
+
+	if (!(disas_show_wanted = disas_missing())) {
+		if (async)
+			begin_async_output();
+		disasm_print(disas_addr, DISASM_SCREEN, disas_pc);
+		if (async)
+			end_async_output();
+	}
+	ahead = disasm_walk(disas_addr, 2 * DISASM_SCREEN, &n);
+	if (n < 2 * DISASM_SCREEN && disasm_ask(ahead))
+		queue_disas_chunk(ahead);
+}
+
+/* A few instructions above the pc are shown too, if they are kept */
+static void show_disas_at_pc(int async)
+{
+	int n;
+
+	disas_addr = disasm_back(disas_pc, DISASM_ABOVE_PC, &n);
+	show_disas_when_fetched(async);
+}
+
+/* The code may be elsewhere once the program starts again */
+static void disas_forget(void)
+{
+	disasm_clear();
+	disas_show_wanted = disas_back_wanted = 0;
+}
+
+static void disas_fetched(char *reply, long tag)
+{
+	unsigned long gap;
+	int n = disasm_store((unsigned long)tag, reply), k;
+
+	if (disas_back_wanted && (unsigned long)tag == disas_back_lo) {
+		disas_back_wanted = 0;
+		if (n < 0) {
+			begin_async_output();
+			if (!parse_internal_reply(reply))
+				release_internal_reply();
+			end_async_output();
+			return;
+		}
+		disas_addr = disasm_back(disas_addr, DISASM_SCREEN, &k);
+		show_disas_when_fetched(1);
+		return;
+	}
+	if (!disas_show_wanted)
+		return;
+	/* Another part came, the one the screen waits for is still due */
+	gap = disasm_walk(disas_addr, DISASM_SCREEN, &k);
+	if (n >= 0 && k < DISASM_SCREEN && gap != (unsigned long)tag) {
+		if (disasm_ask(gap))
+			queue_disas_chunk(gap);
+		return;
+	}
+	disas_show_wanted = 0;
+	begin_async_output();
+	if (n < 0 && !k) {
+		if (!parse_internal_reply(reply))
+			release_internal_reply();
+	}
+	else
+		disasm_print(disas_addr, DISASM_SCREEN, disas_pc);
+	end_async_output();
+}
+
+/* The value of (unsigned long)(EXPR), for gv disas main or gv disas $pc */
+static void disas_addr_known(char *reply, long tag)
+{
+	char *str;
+
+	if (!(str = strstr(reply, "value=\""))) {
+		begin_async_output();
+		if (!parse_internal_reply(reply))
+			release_internal_reply();
+		end_async_output();
+		return;
+	}
+	disas_addr = strtoul(str + 7, NULL, 0);
+	show_disas_when_fetched(1);
+}
+
+/*
+ * Above the code kept, gdb is asked from the start of the function up
+ * to the screen, or from where the code kept from there ends.
+ */
+static int disas_ask_back(unsigned long top)
+{
+	disasm_insn_t *insn;
+	unsigned long lo;
+	int n;
+
+	if (!(insn = disasm_find(top)) || insn->offset <= 0 ||
+	    insn->offset > top)
+		return 0;
+	lo = disasm_walk(top - insn->offset, DISASM_INSNS_MAX, &n);
+	if (lo >= top || !disasm_ask(lo))
+		return 0;
+	queue_disas(lo, top);
+	disas_back_lo = lo;
+	disas_back_wanted = 1;
+
+	return 1;
+}
+
+static void gv_cmd_disas(char *args)
+{
+	static strbuf_t sb, expr_sb;
+	unsigned long top;
+	char *end;
+	int n;
+
+	if (prog_running) {
+		printf("The program is running.\n");
+		return;
+	}
+	if (!strcmp(args, "off")) {
+		disas_on = disas_wanted = 0;
+		return;
+	}
+	if (!strcmp(args, "on"))
+		disas_on = 1;
+	if (!*args || !strcmp(args, "on")) {
+		if (!disas_pc) {
+			printf("The program is not stopped.\n");
+			return;
+		}
+		show_disas_at_pc(0);
+	}
+	else if (!strcmp(args, "+")) {
+		disas_addr = disasm_walk(disas_addr, DISASM_SCREEN, &n);
+		show_disas_when_fetched(0);
+	}
+	else if (!strcmp(args, "-")) {
+		top = disasm_back(disas_addr, DISASM_SCREEN, &n);
+		if (n == DISASM_SCREEN || !disas_ask_back(top)) {
+			disas_addr = top;
+			show_disas_when_fetched(0);
+		}
+	}
+	else {
+		disas_addr = strtoul(args, &end, 0);
+		/* Not a number: gdb tells the address */
+		if (*end) {
+			strbuf_reset(&expr_sb);
+			strbuf_printf(&expr_sb, "(unsigned long)(%s)", args);
+			make_internal_mi_cmd(&sb, "-data-evaluate-expression",
+					     expr_sb.str);
+			do_internal_cmd(sb.str, GDB_STATE_MI,
+					disas_addr_known);
+			return;
+		}
+		show_disas_when_fetched(0);
+	}
+	if (gdb_is_ready())
+		flush_pending_queue();
+}
+
+static void gv_cmd_watch(char *args)
+{
+	static strbuf_t sb;
+
+	if (!*args) {
+		watch_print(0);
+		return;
+	}
+	/* Floating: it is evaluated in the selected frame, as display is */
+	make_internal_mi_cmd(&sb, "-var-create - @", args);
+	if (!cmd_queue_push(&watch_exps, args, 0, GDB_STATE_MI))
+		return;
+	do_internal_cmd(sb.str, GDB_STATE_MI, watch_created);
+}
+
+static void gv_cmd_unwatch(char *args)
+{
+	static strbuf_t sb;
+	watch_var_t *w;
+
+	if (!*args) {
+		while (w = watch_lookup("1")) {
+			strbuf_reset(&sb);
+			strbuf_printf(&sb, "interpreter mi \"-var-delete %s\"",
+				      w->name);
+			do_internal_cmd(sb.str, GDB_STATE_MI, discard_reply);
+			watch_remove(w);
+		}
+		return;
+	}
+	if (!(w = watch_lookup(args)) || w->parent) {
+		printf("No watch %s.\n", args);
+		return;
+	}
+	strbuf_reset(&sb);
+	strbuf_printf(&sb, "interpreter mi \"-var-delete %s\"", w->name);
+	do_internal_cmd(sb.str, GDB_STATE_MI, discard_reply);
+	watch_remove(w);
+}
+
+/* "2", "s.next +", "a 5000": a watch and the first of its children shown */
+static void gv_cmd_expand(char *args)
+{
+	watch_var_t *w;
+	char *from_arg;
+	int from;
+
+	if (from_arg = strchr(args, ' ')) {
+		*from_arg++ = '\0';
+		while (*from_arg == ' ')
+			from_arg++;
+	}
+	if (!(w = watch_lookup(args))) {
+		printf("No watch %s.\n", args);
+		return;
+	}
+	if (!w->numchild) {
+		printf("%s has no children.\n", args);
+		return;
+	}
+	from = w->child_from;
+	if (!from_arg || !*from_arg)
+		;
+	else if (!strcmp(from_arg, "+"))
+		from += WATCH_PAGE_SIZE;
+	else if (!strcmp(from_arg, "-"))
+		from = from > WATCH_PAGE_SIZE ? from - WATCH_PAGE_SIZE : 0;
+	else if (isdigit((unsigned char)*from_arg))
+		from = atoi(from_arg);
+	else {
+		printf("A child index, + or - expected.\n");
+		return;
 	}
-	strncpy(*cmd, line, cmd_len);
-	/* cmd_len - 1 is the last element */
-	(*cmd)[cmd_len - 1] = '\0';
-
-	if (*str == ' ')
-		++str;
-	*args = strdup(str);
+	if (from >= w->numchild)
+		from = w->numchild > WATCH_PAGE_SIZE ?
+		       w->numchild - WATCH_PAGE_SIZE : 0;
+	/* Shown before, or at this stop already */
+	if (watch_show_page(w, from)) {
+		watch_print(0);
+		return;
+	}
+	queue_watch_children(w, from, 1);
+	if (gdb_is_ready())
+		flush_pending_queue();
 }
 
-/* Called when EOF or newline is encountered */
-void do_gdb_cmd(char *line)
+static void gv_cmd_collapse(char *args)
 {
-	static gdb_cmd_type_t prev_cmd_type = GDB_CMD_CLI;
-	char gdb_cmd_buf[GDB_CMD_SIZE];
-	const gdb_mi_cmd_t *mi_cmd_ptr;
-	char *stripped_line;
-	char *cmd = NULL, *args = NULL;
-	int cmd_len;
-
-	/* Check if it is EOF: C-d */
-	if (line) {
-		/*
-		 * Remove leading and trailing whitespace(s) from the line.
-		 *
-		 * line == ""	      means newline   -> stripped_line = ""
-		 * line == " /t/t   " means all blank -> stripped_line = ""
-		 */
-		if (*line && *(stripped_line = stripws(line))) {
-			/* Tokenize gdb line to cmd and args */
-			tokenize_gdb_line(stripped_line, &cmd, &args);
-			cmd_len = strlen(cmd);
-
-			/*
-			 * Command or more precisely line is added to the
-			 * history when it is first encountered. It may
-			 * come here second time after the command type
-			 * could not be decided but in this case it is not
-			 * added so as not to have duplicate entries.
-			 */
-			if (gdbstatus != GDB_STATE_CHECK_CMD)
-				add_history(stripped_line);
-		}
+	watch_var_t *w;
 
-		/*
-		 * When readline library gives the line to the application,
-		 * it strips newline. However, gdb commands should be ended
-		 * with a newline so we set it again.
-		 */
-		if (!*line || !*stripped_line) { /* previous command */
-			/* readline gives: line = "" */
-			if (prev_cmd_type == GDB_CMD_MI)
-				gdbstatus = GDB_STATE_MI;
-			else
-				gdbstatus = GDB_STATE_CLI;
-			erase_line(gdb_ptym);
-			/* newline produces n\n as echo */
-			gdb_cmd_len = 1;
-			write(gdb_ptym, "\n", 1);
-		}
-		else if ((mi_cmd_ptr = is_gdb_mi_cmd(cmd, cmd_len)) != NULL) {
-			prev_cmd_type = GDB_CMD_MI;
-			gdbstatus = GDB_STATE_MI;
-			do_gdb_mi_cmd(mi_cmd_ptr->code, args);
-		}
-		else if (gdbstatus == GDB_STATE_CLI) {
-			/*
-			 * We need one more step to decide if it is a
-			 * gdb/cli or gdb/mi cmd. For this, we are
-			 * sending a req to gdb to learn the type of
-			 * cmd.
-			 */
-			gdbstatus = GDB_STATE_CHECK_CMD;
-			erase_line(gdb_ptym);
-			current_gdb_line = strdup(stripped_line);
-			sprintf(gdb_cmd_buf, "server complete %s\n", cmd);
-			gdb_cmd_len = strlen(gdb_cmd_buf);
-			write(gdb_ptym, gdb_cmd_buf, gdb_cmd_len);
-		}
-		else { /* gdb/cli command */
-			/* readline gives: line = file'\0' */
-			prev_cmd_type = GDB_CMD_CLI;
-			gdbstatus = GDB_STATE_CLI;
-			erase_line(gdb_ptym);
-			sprintf(gdb_cmd_buf, "%s\n", stripped_line);
-			gdb_cmd_len = strlen(gdb_cmd_buf);
-			write(gdb_ptym, gdb_cmd_buf, gdb_cmd_len);
-		}
-		gdb_out = GDB_OUT_ECHO_INCLUDED;
+	if (!(w = watch_lookup(args))) {
+		printf("No watch %s.\n", args);
+		return;
+	}
+	watch_collapse(w);
+}
 
-		free(line);
-		if (cmd)
-			free(cmd);
-		if (args)
-			free(args);
+/* gdb has nothing to do, the user has not asked anything either */
+static void run_idle_work(void)
+{
+	/* What is due goes as one batch, the slow symbol index after it */
+	if (prefetch_wanted) {
+		prefetch_wanted = 0;
+		prefetch_stop();
 	}
-	else { /* EOF */
-		//FIXME: Handle EOF
+	if (watch_wanted) {
+		watch_wanted = 0;
+		queue_internal_cmd(WATCH_UPDATE, GDB_STATE_MI, watch_updated,
+				   0);
+	}
+	if (regs_wanted) {
+		regs_wanted = 0;
+		queue_internal_cmd(REGS_CHANGED, GDB_STATE_MI, regs_changed, 1);
+	}
+	if (disas_wanted) {
+		disas_wanted = 0;
+		show_disas_at_pc(1);
+	}
+	if (bkpt_sync_wanted) {
+		bkpt_sync_wanted = 0;
+		bkpt_syncing = 1;
+		queue_internal_cmd(BKPT_LIST, GDB_STATE_MI, bkpt_synced, 0);
+	}
+	if (pending_queue.count) {
+		flush_pending_queue();
+		return;
+	}
+	if (symidx_wanted || inferior_lib_gen() != symidx_lib_gen) {
+		symidx_wanted = 0;
+		symidx_lib_gen = inferior_lib_gen();
+		request_symbol_index();
 	}
 }
 
-void reconstruct_gdb_line(char *new_cmd)
+/*
+ * The output of a command Vim asked for is shown in the console too,
+ * in place of the prompt line. What the user has been typing comes
+ * back when the batch is done.
+ */
+static void show_vim_output(const char *line, const char *output, int len)
 {
-	char *cmd, *args;
-	int cmd_len, args_len, new_cmd_len;
+	begin_async_output();
+	printf("[vim] %s\n", line);
+	fflush(stdout);
+	write(STDOUT_FILENO, output, len);
+	end_async_output();
+}
 
-	tokenize_gdb_line(current_gdb_line, &cmd, &args);
+/* Reply to a gdb/cli command from Vim: "Breakpoint 1 at ..." */
+static void vim_cli_reply(char *reply, long id)
+{
+	int len = strlen(reply);
 
-	cmd_len = strlen(cmd);
-	new_cmd_len = strlen(new_cmd);
+	/* The prompt is not part of the output */
+	if (len >= 6 && !strcmp(reply + len - 6, "(gdb) "))
+		reply[len -= 6] = '\0';
+	show_vim_output(active_reply->line, reply, len);
+	vim_channel_reply(id, "done", "output", reply);
+}
 
-	/*
-	 * If the new_cmd is the same as with the given one, then there
-	 * is no need to reconstruct current_gdb_line.
-	 */
-	if (new_cmd_len != cmd_len) {
-		free(current_gdb_line);
-		if (args)
-			args_len = strlen(args);
-		else {
-			args_len = 0;
-			args = "";
-		}
-		/* +2 for separator(space) and null char */
-		current_gdb_line = (char *)malloc(new_cmd_len + args_len + 2);
-		if (!current_gdb_line) {
-			fprintf(stderr, "Cannot allocate memory\n");
-			exit(EXIT_FAILURE);
-		}
-		sprintf(current_gdb_line, "%s %s", new_cmd, args);
-		free(cmd);
-		if (args && *args)
-			free(args);
+/* "clear LOC" has found no breakpoint, so one is set there */
+static void vim_toggle_reply(char *reply, long id)
+{
+	strbuf_t *sb = &gdb_cmd_sb;
+
+	if (!strstr(reply, "No breakpoint at")) {
+		vim_cli_reply(reply, id);
+		return;
 	}
+	strbuf_reset(sb);
+	strbuf_printf(sb, "break %s", active_reply->line + 6);
+	queue_internal_cmd(sb->str, GDB_STATE_CLI, vim_cli_reply, id);
 }
 
-char *parse_check_cmd_output(char *cmd_list_buf)
+/* A query from Vim, its output is kept until the program runs */
+static void vim_query_reply(char *reply, long id)
 {
-	char *cmd;
-	char *cmd_iter;
-	int cmd_len;
+	int len = strlen(reply);
 
-	/* not a valid cmd: (gdb)[space] */
-	if (!(cmd_iter = strchr(cmd_list_buf, '\n')))
-		return NULL;
+	if (len >= 6 && !strcmp(reply + len - 6, "(gdb) "))
+		reply[len -= 6] = '\0';
+	stop_cache_store(active_reply->line, reply);
+	vim_cli_reply(reply, id);
+}
 
-	cmd_iter++;
+static void vim_eval_answer(const char *reply, long id)
+{
+	char *str;
 
-	/* unambiguous cmd: break\n(gdb)[space] */
-	if (!strncmp(cmd_iter, "(gdb) ", 6)) {
-		cmd_len = cmd_iter - cmd_list_buf;
-		if (!(cmd = (char *)malloc(cmd_len))) {
-			fprintf(stderr, "Cannot allocate memory\n");
-			return NULL;
-		}
-		strncpy(cmd, cmd_list_buf, cmd_len);
-		cmd[cmd_len - 1] = '\0';
-		return cmd;
+	if (create_mi_parsetree((char *)reply) < 0) {
+		vim_channel_reply(id, "error", "msg", "Unexpected reply");
+		return;
 	}
-	/* ambiguous cmd: backtrace\nbreak\nbt\n(gdb)[space] */
+	if (str = mi_get_error_result_record(gdbmi_out_ptr))
+		vim_channel_reply(id, "error", "msg", str);
+	else if (str = mi_get_done_result(gdbmi_out_ptr, "value"))
+		vim_channel_reply(id, "done", "value", str);
+	else
+		vim_channel_reply(id, "error", "msg", "No value");
+	free(str);
+	destroy_gdbmi_output();
+	gdbmi_out_ptr = NULL;
+}
 
-	return NULL;
+/* The gdb/mi output is cached, not the value, errors are the same */
+static void vim_eval_reply(char *reply, long id)
+{
+	stop_cache_store(active_reply->line, reply);
+	vim_eval_answer(reply, id);
 }
 
-gdb_mi_cmd_state_t handle_mi_output(char *gdbbuf)
+/* The results of ^done as they are, "stack=[frame={level=...}]" */
+static void vim_list_answer(const char *reply, long id)
 {
-	gdb_mi_cmd_state_t mi_cmd_status;
-	char *ans_ptr;
+	static strbuf_t sb;
+	const char *res, *end;
 
-	if (gdb_out == GDB_OUT_ECHO_INCLUDED) {
-		/* This means echo'ing will be cut */
-		ans_ptr = kill_echo(gdbbuf, 1);
-		gdb_out = GDB_OUT_ECHO_TRIMMED;
+	if (!(res = strstr(reply, "^done,"))) {
+		vim_eval_answer(reply, id);
+		return;
 	}
-	else
-		ans_ptr = gdbbuf;
+	res += 6;
+	if (!(end = strchr(res, '\n')))
+		end = res + strlen(res);
+	strbuf_reset(&sb);
+	strbuf_append(&sb, res, end - res);
+	vim_channel_reply(id, "done", "value", sb.str);
+}
 
-	if (!create_mi_parsetree(ans_ptr)) {
-		/* There is a valid parse tree */
-		mi_cmd_status = parse_mi_parsetree();
-		destroy_gdbmi_output();
-		gdbmi_out_ptr = NULL;
+static void vim_list_reply(char *reply, long id)
+{
+	stop_cache_store(active_reply->line, reply);
+	vim_list_answer(reply, id);
+}
 
-		return mi_cmd_status;
+/* Vim has asked where the signs go, after the mirror was read again */
+static void vim_bkpt_lines(char *reply, long id)
+{
+	static strbuf_t sb;
+	cmd_entry_t *file = cmd_queue_pop(&bkpt_files);
+
+	bkpt_synced(reply, 0);
+	strbuf_reset(&sb);
+	if (file) {
+		bkpt_table_file_lines(file->line, &sb);
+		free_cmd_entry(file);
 	}
-	/* Parse tree could not be created */
+	vim_channel_reply(id, "done", "value", sb.len ? sb.str : "");
+}
 
-	return GDB_MI_CMD_COMPLETED;
+/* "Breakpoint 3 at 0x401136: file a.c, line 42." as gdb/cli says */
+static void vim_bkpt_inserted(char *reply, long id)
+{
+	static strbuf_t sb;
+	bkpt_info_t *changes;
+	char *str;
+
+	if (create_mi_parsetree(reply) < 0) {
+		vim_channel_reply(id, "error", "msg", "Unexpected reply");
+		return;
+	}
+	strbuf_reset(&sb);
+	if (str = mi_get_error_result_record(gdbmi_out_ptr)) {
+		strbuf_printf(&sb, "%s\n", str);
+		show_vim_output(active_reply->line, sb.str, sb.len);
+		vim_channel_reply(id, "error", "msg", str);
+		free(str);
+	}
+	else if (changes = mi_get_bkpt_changes(gdbmi_out_ptr)) {
+		bkpt_table_apply(changes);
+		strbuf_printf(&sb, "Breakpoint %d at %s", changes->number,
+			      changes->addr ? changes->addr : "<PENDING>");
+		if (changes->file)
+			strbuf_printf(&sb, ": file %s, line %d.",
+				      changes->file, changes->line);
+		strbuf_putc(&sb, '\n');
+		show_vim_output(active_reply->line, sb.str, sb.len);
+		vim_channel_reply(id, "done", "output", sb.str);
+		free_bkpt_info(changes);
+	}
+	else
+		vim_channel_reply(id, "error", "msg", "No breakpoint");
+	destroy_gdbmi_output();
+	gdbmi_out_ptr = NULL;
 }
 
-void handle_cli_output(char *gdbbuf)
+/* -break-delete is answered with a bare ^done, the mirror follows it */
+static void vim_bkpt_deleted(char *reply, long id)
 {
-	char *ans_ptr = kill_echo(gdbbuf, 1);
+	static strbuf_t sb;
+	char *num, *end;
 
-	write(STDOUT_FILENO, ans_ptr, strlen(ans_ptr));
-	gdb_out = GDB_OUT_ECHO_TRIMMED;
+	strbuf_reset(&sb);
+	if (strncmp(reply, "^done", 5)) {
+		bkpt_sync_wanted = 1;
+		vim_cli_reply(reply, id);
+		return;
+	}
+	/* interpreter mi "-break-delete 3 7" */
+	num = strstr(active_reply->line, "-break-delete") + 13;
+	strbuf_puts(&sb, strchr(num + 1, ' ') ? "Deleted breakpoints" :
+		    "Deleted breakpoint");
+	while (*num == ' ') {
+		bkpt_table_delete(strtol(num, &end, 10));
+		strbuf_append(&sb, num, end - num);
+		num = end;
+	}
+	strbuf_puts(&sb, " \n");
+	show_vim_output(active_reply->line, sb.str, sb.len);
+	vim_channel_reply(id, "done", "output", sb.str);
 }
 
-void handle_check_cmd_output(char *gdbbuf)
+/*
+ * "toggle FILE:LINE" is decided from the mirror: the breakpoints there
+ * are deleted by number, or one is inserted. Returns -1 if the mirror
+ * can not tell, then "clear" finds out.
+ */
+static int toggle_from_mirror(long id, char *loc)
 {
-	char *ans_ptr = kill_echo(gdbbuf, 1);
-	char *completed_cmd = parse_check_cmd_output(ans_ptr);
+	strbuf_t *sb = &gdb_cmd_sb;
+	int numbers[BKPT_AT_MAX];
+	char *colon;
+	int i, n;
+
+	if (bkpt_sync_wanted || bkpt_syncing || bkpt_stale)
+		return -1;
+	if (!(colon = strrchr(loc, ':')) || colon == loc || !colon[1] ||
+	    colon[1 + strspn(colon + 1, "0123456789")] != '\0')
+		return -1;
 
-	if (completed_cmd)
-		reconstruct_gdb_line(completed_cmd);
+	*colon = '\0';
+	n = bkpt_table_at(loc, atoi(colon + 1), numbers, BKPT_AT_MAX);
+	*colon = ':';
+	if (n) {
+		strbuf_reset(sb);
+		strbuf_puts(sb, "interpreter mi \"-break-delete");
+		for (i = 0; i < n; i++)
+			strbuf_printf(sb, " %d", numbers[i]);
+		strbuf_putc(sb, '\"');
+		queue_internal_cmd(sb->str, GDB_STATE_MI, vim_bkpt_deleted,
+				   id);
+	}
+	else {
+		make_internal_mi_cmd(sb, "-break-insert", loc);
+		queue_internal_cmd(sb->str, GDB_STATE_MI, vim_bkpt_inserted,
+				   id);
+	}
 
-	do_gdb_cmd(current_gdb_line);
+	return 0;
 }
 
-void handle_completion_output(char *gdbbuf)
+/*
+ * A request from Vim. They are queued as they come and go to gdb as one
+ * batch once the whole read has been handled, see main_loop.
+ *
+ *	eval EXPR	value of EXPR, not shown in the console
+ *	toggle LOC	clears the breakpoints at LOC, or sets one
+ *	breakpoints FILE
+ *			"LINE NUMBER ENABLED" lines, where the signs go
+ *	stack, locals	the frames and the locals as gdb/mi results,
+ *			prefetched on stops if asked for
+ *	until LOC	execution commands run as if typed, the stop
+ *			moves Vim
+ *	anything else	a gdb/cli command, its output is the result
+ */
+static void do_vim_request(long id, char *req)
 {
-	char *char_ptr, *ans_ptr;
-	int nread;
+	strbuf_t *sb = &gdb_cmd_sb;
+	const char *cached, *line;
+	char *args;
+	int cmd_len;
 
-	nread = read(gdb_ptym, gdbbuf, GDB_BUF_SIZE);
-	gdbbuf[nread] = '\0';
-	ans_ptr = kill_echo(gdbbuf, 0);
-	if (ans_ptr == (gdbbuf + nread)) {
-		/* Answer does not contain echo */
-		ans_ptr = gdbbuf;
-	}
+	tokenize_gdb_line(req, &cmd_len, &args);
 
-	if (*ans_ptr == '\a')
-		write(STDOUT_FILENO, "\a", 1);
-	else if ((char_ptr = strchr(ans_ptr, '\a')) != NULL) {
-		if (!*++char_ptr) /* \a is at the end. no change */
-			write(STDOUT_FILENO, "\a", 1);
+	if (cmd_len == 4 && !strncmp(req, "eval", 4) && args) {
+		make_internal_mi_cmd(sb, "-data-evaluate-expression", args);
+		if (!stop_cache_is_pure(args))
+			stop_cache_invalidate();
+		else if (!pending_queue.count &&
+			 (cached = stop_cache_lookup(sb->str))) {
+			vim_eval_answer(cached, id);
+			return;
+		}
+		queue_internal_cmd(sb->str, GDB_STATE_MI, vim_eval_reply, id);
+	}
+	else if ((cmd_len == 5 && !strncmp(req, "stack", 5)) ||
+		 (cmd_len == 6 && !strncmp(req, "locals", 6))) {
+		line = *req == 's' ? PREFETCH_FRAMES : PREFETCH_LOCALS;
+		if (!pending_queue.count && (cached = stop_cache_lookup(line)))
+			vim_list_answer(cached, id);
+		else
+			queue_internal_cmd(line, GDB_STATE_MI, vim_list_reply,
+					   id);
+	}
+	else if (cmd_len == 11 && !strncmp(req, "breakpoints", 11) && args) {
+		if (bkpt_sync_wanted || bkpt_syncing || bkpt_stale) {
+			if (!cmd_queue_push(&bkpt_files, args, 0, GDB_STATE_MI))
+				return;
+			bkpt_sync_wanted = 0;
+			bkpt_syncing = 1;
+			queue_internal_cmd(BKPT_LIST, GDB_STATE_MI,
+					   vim_bkpt_lines, id);
+		}
 		else {
-			rl_insert_text(char_ptr);
-			rl_redisplay();
-			write(STDOUT_FILENO, "\a", 1);
+			strbuf_reset(sb);
+			bkpt_table_file_lines(args, sb);
+			vim_channel_reply(id, "done", "value",
+					  sb->len ? sb->str : "");
 		}
 	}
-	else if (*ans_ptr != '\n') { /* completion is successful */
-			rl_delete_text(0, rl_end);
-			rl_point = 0;
-			rl_insert_text(ans_ptr);
-			rl_redisplay();
+	else if (cmd_len == 6 && !strncmp(req, "toggle", 6) && args) {
+		if (!toggle_from_mirror(id, args))
+			return;
+		/* Whatever it does, the mirror is to be read again */
+		bkpt_sync_wanted = 1;
+		strbuf_reset(sb);
+		strbuf_printf(sb, "clear %s", args);
+		queue_internal_cmd(sb->str, GDB_STATE_CLI, vim_toggle_reply,
+				   id);
+	}
+	else if (is_gdb_mi_cmd(req, cmd_len)) {
+		if (gdb_is_ready()) {
+			/* Shown after a fresh prompt */
+			write(STDOUT_FILENO, "\r\033[K", 4);
+			write(STDOUT_FILENO, rl_prompt, strlen(rl_prompt));
+		}
+		cmd_queue_push(&pending_queue, req, 0, GDB_STATE_CLI);
+		vim_channel_reply(id, "running", NULL, NULL);
+	}
+	else if (is_gdbvim_cmd(req, cmd_len))
+		vim_channel_reply(id, "error", "msg",
+				  "gdbvim commands are not taken from Vim");
+	else if (stop_cache_is_query(req, cmd_len, args)) {
+		/* Not ahead of the requests still waiting for gdb */
+		if (!pending_queue.count && (cached = stop_cache_lookup(req))) {
+			show_vim_output(req, cached, strlen(cached));
+			vim_channel_reply(id, "done", "output", cached);
+		}
+		else
+			queue_internal_cmd(req, GDB_STATE_CLI, vim_query_reply,
+					   id);
+	}
+	else {
+		note_cmd_effects(req, cmd_len, args, NULL);
+		queue_internal_cmd(req, GDB_STATE_CLI, vim_cli_reply, id);
 	}
-	else
-		write(STDOUT_FILENO, ans_ptr, strlen(ans_ptr));
-
-	gdbstatus = GDB_STATE_CLI;
 }
 
+/*
+ * While gdb loads the symbols of the target, the prompt shows how far
+ * it has got: "[Reading symbols from /usr/lib/libfoo.so...] (gdb) ".
+ */
+static void show_startup_status(void)
+{
+	static char status[STATUS_SIZE];
+	char prompt[STATUS_SIZE + 16];
+	char *s, *last = NULL;
+	int len;
+
+	for (s = gdb_acc + startup_scanned;
+	     s = strstr(s, "Reading symbols from "); s++)
+		last = s;
+	startup_scanned = gdb_acc_len;
+	if (!last)
+		return;
 
-void handle_user_input(char *inbuf)
+	len = strcspn(last, "\n");
+	if (len >= STATUS_SIZE)
+		len = STATUS_SIZE - 1;
+	if (!strncmp(status, last, len) && !status[len])
+		return;
+	strncpy(status, last, len);
+	status[len] = '\0';
+
+	sprintf(prompt, "[%s] (gdb) ", status);
+	rl_set_prompt(prompt);
+	write(STDOUT_FILENO, "\r\033[K", 4);
+	rl_forced_update_display();
+}
+
+/*
+ * The first prompt: symbols are loaded and gdb reads commands from now
+ * on. Whatever gdb has printed until now replaces the status line.
+ */
+static void handle_startup_output(char *gdbbuf)
 {
-	int nread;
+	/* Without "(gdb) ", readline prints the prompt */
+	int len = strlen(gdbbuf) - 6;
 
-	/* gdb or prog input */
-	if (gdbstatus == GDB_STATE_CLI) { /* input for gdb */
-		nread = read(STDIN_FILENO, inbuf, IN_BUF_SIZE);
-		if (*inbuf != '\t')
-			prev_key = KEY_OTHER;
-		write(readline_ptym, inbuf, nread);
-	}
-	else { /* input for prog */
-		/*
-		 * The only possibility for a program to get input is the
-		 * state of already being run, and a program is
-		 * in that condition only if execution control commands
-		 * are being executed. That means that gdb must be operating
-		 * in the mi state.
-		 */
-		nread = read(STDIN_FILENO, inbuf, IN_BUF_SIZE);
-		write(prog_ptym, inbuf, nread);
-	}
+	rl_set_prompt("(gdb) ");
+	write(STDOUT_FILENO, "\r\033[K", 4);
+	write(STDOUT_FILENO, gdbbuf, len);
+	gdbstatus = GDB_STATE_CLI;
+
+	if (pending_queue.count)
+		write(STDOUT_FILENO, "(gdb) ", 6);
+	else
+		rl_forced_update_display();
 }
 
-int get_gdb_output(char *gdbbuf, char *pattern)
+/*
+ * Reads what gdb has written and handles every whole reply in it. The
+ * state tells what kind of reply is expected next.
+ */
+static void handle_gdb_output(void)
 {
-	static int nread_total = 0;
-	int nread;
-	char *next_slice;
-	int plen = strlen(pattern);
+	gdb_state_t prev_state;
+	char *reply;
+
+	if (read_gdb_output() <= 0)
+		return;
+
+	while (1) {
+		prev_state = gdbstatus;
+		if (active_reply && active_reply->handler) {
+			if (!(reply = get_gdb_reply(
+				      gdbstatus == GDB_STATE_MI ?
+				      "(gdb) \n" : "(gdb) ")))
+				return;
+			handle_internal_output(reply);
+		}
+		else if (gdbstatus == GDB_STATE_STARTUP) {
+			show_startup_status();
+			if (!(reply = get_gdb_reply("(gdb) ")))
+				return;
+			handle_startup_output(reply);
+		}
+		else if (gdbstatus == GDB_STATE_CLI) {
+			if (!(reply = get_gdb_reply("(gdb) ")))
+				return;
+			handle_cli_output(reply);
+		}
+		else if (gdbstatus == GDB_STATE_CHECK_CMD) {
+			if (!(reply = get_gdb_reply("(gdb) ")))
+				return;
+			handle_check_cmd_output(reply);
+		}
+		else if (gdbstatus == GDB_STATE_COMPLETION) {
+			if (!(reply = get_gdb_reply("(gdb) ")))
+				return;
+			handle_completion_output(reply);
+		}
+		else if (gdbstatus == GDB_STATE_MI) {
+			/*
+			 * Before giving the buffer for parsing, we must
+			 * ensure that it contains valid gdb/mi output.
+			 * If there ara some data and we pass it
+			 * immediately there is a high chance that it
+			 * has not been complete yet. (gdb) \n notation
+			 * represents the end of gdb/mi output. The space
+			 * between ')' and '\n' is not mentioned in the
+			 * documentation but we verified that it is there.
+			 */
+			if (!(reply = get_gdb_reply("(gdb) \n")))
+				return;
+			if (handle_mi_output(reply) == GDB_MI_CMD_COMPLETED)
+				gdbstatus = GDB_STATE_CLI;
+			else
+				gdbstatus = GDB_STATE_MI;
+		}
+		else
+			return;
+		release_gdb_reply();
 
-	next_slice = gdbbuf + nread_total;
-	nread = read(gdb_ptym, next_slice, GDB_BUF_SIZE);
-	if (!strncmp(&next_slice[nread - plen], pattern, plen)) {
+		/* The reply is complete unless more gdb/mi output is due */
+		if (gdbstatus != GDB_STATE_CLI)
+			continue;
 		/*
-		 * It covers two situation: If the last or
-		 * the only block is pattern.
+		 * A command sent directly is not done yet: the prompt
+		 * follows its gdb/mi output, and a check has just sent
+		 * the command itself. In a batch, the prompt is an entry
+		 * of its own.
 		 */
-		nread_total += nread;
-		/* null terminated */
-		gdbbuf[nread_total] = '\0';
-		/* logged for debugging purposes */
-		if (logger(gdbbuf, nread_total, 1) < 0)
-			return -1;
-		/* Reset the buffer head */
-		nread_total = 0;
-
-		return 0;
-	}
-	else {
-		/* gdb output is accumulated */
-		nread_total += nread;
+		if (!active_reply && (prev_state == GDB_STATE_MI ||
+				      prev_state == GDB_STATE_CHECK_CMD))
+			continue;
+		gdb_direct_busy = 0;
+		next_reply();
+		/* Nothing is due from gdb and the user has not asked */
+		if (gdb_is_ready() && !gdb_acc_len)
+			run_idle_work();
 	}
-
-	return nread;
 }
 
 int main_loop(void)
 {
 	char inbuf[IN_BUF_SIZE];
-	char outbuf[OUT_BUF_SIZE];
-	char gdbbuf[GDB_BUF_SIZE];
 	char progbuf[PROG_BUF_SIZE];
-	struct pollfd fds[5];
-	int nread;
+	struct pollfd fds[8];
+	int nread, timeout;
 	int ret;
 
 	/* The descriptors to be listened */
@@ -680,10 +3347,31 @@ int main_loop(void)
 	fds[4].fd = readline_ptym;
 	fds[4].events = POLLIN;
 
+	/* Vim, if it has connected; poll skips a negative fd */
+	fds[5].fd = vim_channel_listen_fd();
+	fds[5].events = POLLIN;
+
+	fds[7].fd = sig_pipe[0];
+	fds[7].events = POLLIN;
+
 	/* The main loop */
 	while (1) {
-		/* Wait for indefinetely */
-		if ((ret = poll(fds, 5, -1)) <= 0) {
+		fds[6].fd = vim_channel_fd();
+		fds[6].events = vim_channel_events();
+
+		/*
+		 * Wait for indefinetely, or until the latest stop is to
+		 * be sent to Vim
+		 */
+		timeout = vim_channel_timeout();
+		/* Or until a profiled program is to be stopped */
+		if ((ret = profile_timeout()) >= 0 &&
+		    (timeout < 0 || ret < timeout))
+			timeout = ret;
+		if ((ret = poll(fds, 8, timeout)) < 0) {
+			/* ^C, its byte is in sig_pipe */
+			if (errno == EINTR)
+				continue;
 			fprintf(stderr, "Poll error\n");
 			perror(__FUNCTION__);
 			return ret;
@@ -695,49 +3383,34 @@ int main_loop(void)
 		if (fds[3].revents == POLLIN) /* readline input */
 			rl_callback_read_char();
 
-		if (fds[4].revents == POLLIN) { /* readline output */
-			nread = read(fds[4].fd, outbuf, OUT_BUF_SIZE);
-			write(STDOUT_FILENO, outbuf, nread);
-		}
+		if (fds[4].revents == POLLIN) /* readline output */
+			relay_readline_output();
 
 		if (fds[2].revents == POLLIN) { /* prog output */
 			nread = read(fds[2].fd, progbuf, PROG_BUF_SIZE);
 			write(STDOUT_FILENO, progbuf, nread);
 		}
 
-		if (fds[1].revents == POLLIN) { /* gdb output */
-			if (gdbstatus == GDB_STATE_CLI) {
-				if (!get_gdb_output(gdbbuf, "(gdb) "))
-					handle_cli_output(gdbbuf);
-			}
-			else if (gdbstatus == GDB_STATE_COMPLETION)
-				handle_completion_output(gdbbuf);
-			else if (gdbstatus == GDB_STATE_CHECK_CMD) {
-				if (!get_gdb_output(gdbbuf, "(gdb) "))
-					handle_check_cmd_output(gdbbuf);
-			}
-			else { /* GDB_STATE_MI */
-				/*
-				 * Before giving the buffer for parsing, we must
-				 * ensure that it contains valid gdb/mi output.
-				 * If there ara some data and we pass it
-				 * immediately there is a high chance that it
-				 * has not been complete yet. So for every read
-				 * we should compare its last 7 characters to
-				 * (gdb) \n. (gdb) \n notation represents the
-				 * end of gdb/mi output. The space between ')'
-				 * and '\n' is not mentioned in the documentation
-				 * but we verified that it is there.
-				 */
-				if (!get_gdb_output(gdbbuf, "(gdb) \n")) {
-					if (handle_mi_output(gdbbuf) ==
-					    GDB_MI_CMD_COMPLETED)
-						gdbstatus = GDB_STATE_CLI;
-					else
-						gdbstatus = GDB_STATE_MI;
-				}
-			}
-		}
+		if (fds[7].revents == POLLIN) /* ^C, before gdb output */
+			handle_interrupt();
+
+		if (profile_sample_due())
+			signal_program(1);
+
+		if (fds[1].revents == POLLIN) /* gdb output */
+			handle_gdb_output();
+		else if (fds[1].revents & (POLLHUP | POLLERR))
+			return 0; /* gdb has quit */
+
+		if (fds[5].revents == POLLIN) /* Vim connects */
+			vim_channel_accept();
+
+		/* Vim channel, its requests go to gdb as one batch */
+		if (fds[6].revents && vim_channel_handle(fds[6].revents) &&
+		    gdb_is_ready())
+			flush_pending_queue();
+
+		vim_channel_flush();
 	}
 
 	return 0;
@@ -745,10 +3418,24 @@ int main_loop(void)
 
 static char *prog_name = "gdbvim";
 static char *gdb_bin_name;
+/* Program to debug and its core file or process id, if given */
+static char **gdb_prog_args;
+static int gdb_prog_nargs;
+/* Vim connects here, $TMPDIR/gdbvim-<pid>.sock unless given */
+static char *vim_sock_path;
+/* Core dump triage: the list of programs and cores, and what to ask */
+static char *triage_list;
+static int triage_jobs;
+static char *triage_exprs[TRIAGE_EXPRS_MAX];
+static int triage_expr_count;
+static char *triage_dir = ".";
 
 static void show_help(void)
 {
-	printf("Usage: %s -x gdb_bin_name\n", prog_name);
+	printf("Usage: %s [-p] [-t] [-x gdb_bin_name] [-s vim_socket] "
+	       "[prog [core|pid]]\n", prog_name);
+	printf("       %s -T list [-j jobs] [-e expr]... [-o dir] "
+	       "[-x gdb_bin_name]\n", prog_name);
 	printf("for help, type -h\n");
 }
 
@@ -774,7 +3461,7 @@ static int parse_args(int argc, char *argv[])
 	/* Option processing */
 	opterr = 0;
 	while (1) {
-		c = getopt(argc, argv, "hx:");
+		c = getopt(argc, argv, "hptx:s:T:j:e:o:");
 		if (c == -1)
 			break;
 
@@ -783,6 +3470,32 @@ static int parse_args(int argc, char *argv[])
 			gdb_bin_name = optarg;
 			//FIXME: check if gdb_bin_name is in the path
 			break;
+		case 's':
+			vim_sock_path = optarg;
+			break;
+		case 'p':
+			prefetch_on = 1;
+			break;
+		case 't':
+			typeahead_on = 1;
+			break;
+		case 'T':
+			triage_list = optarg;
+			break;
+		case 'j':
+			triage_jobs = atoi(optarg);
+			break;
+		case 'e':
+			if (triage_expr_count == TRIAGE_EXPRS_MAX) {
+				fprintf(stderr, "%s: At most %d expressions\n",
+					prog_name, TRIAGE_EXPRS_MAX);
+				return -1;
+			}
+			triage_exprs[triage_expr_count++] = optarg;
+			break;
+		case 'o':
+			triage_dir = optarg;
+			break;
 		case 'h':
 			show_help();
 			return -1;
@@ -796,13 +3509,15 @@ static int parse_args(int argc, char *argv[])
 			return -1;
 		}
 	}
-	if (optind < argc) { /* Non-option encountered */
-		fprintf(stderr, "%s: Missing option argument or "
-			"unknown option\n", prog_name);
+	/* Non-options are passed to gdb: prog [core|pid] */
+	if (argc - optind > 2) {
+		fprintf(stderr, "%s: Too many arguments\n", prog_name);
 		return -1;
 	}
+	gdb_prog_args = &argv[optind];
+	gdb_prog_nargs = argc - optind;
 
-	if (argc == 1 && !gdb_bin_name) {
+	if (!gdb_bin_name) {
 		printf("Warning: No gdb executable specified, assuming "
 		       "\"gdb\" as the default back-end\n");
 		gdb_bin_name = "gdb";
@@ -849,14 +3564,13 @@ void tty_reset(int fd)
 	tcsetattr(fd, TCSAFLUSH, &save_termios);
 }
 
+/* Only async-signal-safe calls here, see handle_interrupt() */
 void sigint (int s)
 {
-	tty_reset(STDIN_FILENO);
-	close(readline_ptym);
-	close(readline_ptys);
-	close(gdb_ptym);
+	int saved_errno = errno;
 
-	exit(0);
+	write(sig_pipe[1], "", 1);
+	errno = saved_errno;
 }
 
 static void custom_deprep_term_function(void) {}
@@ -864,9 +3578,14 @@ static void custom_deprep_term_function(void) {}
 static int init_readline (void)
 {
 	FILE *input, *output;
+	struct winsize ws;
 	int ret;
 
-	ret = openpty(&readline_ptym, &readline_ptys, NULL, NULL, NULL);
+	/* readline wraps long prompts by the width of the terminal */
+	if (ioctl(STDIN_FILENO, TIOCGWINSZ, &ws) < 0)
+		ret = openpty(&readline_ptym, &readline_ptys, NULL, NULL, NULL);
+	else
+		ret = openpty(&readline_ptym, &readline_ptys, NULL, NULL, &ws);
 	if (ret == -1)
 		return -1;
 
@@ -904,13 +3623,26 @@ int main(int argc, char *argv[])
 	gdbvim_t *gv_h;
 	struct termios stermios;
 	char gdb_args[GDB_ARGS_SIZE];
+	char *gdb_argv[GDB_ARGV_SIZE];
+	char sock_path[SOCK_PATH_SIZE];
+	char *tmpdir;
 	int ret = 0;
+	int i;
 
 	/* Before going further, parse arguments */
 	ret = parse_args(argc, argv);
 	if (ret < 0)
 		return -1;
 
+	/* Batch triage of cores, without a terminal */
+	if (triage_list) {
+		if (triage_jobs <= 0)
+			triage_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+		ret = triage_run(gdb_bin_name, triage_list, triage_jobs,
+				 triage_exprs, triage_expr_count, triage_dir);
+		return ret < 0 ? -1 : ret > 0;
+	}
+
 	/* Allocate the handle */
 	if (!(gv_h = (gdbvim_t *)malloc(sizeof(gdbvim_t)))) {
 		fprintf(stderr, "Cannot allocate memory\n");
@@ -924,6 +3656,13 @@ int main(int argc, char *argv[])
 	if (tty_cbreak(STDIN_FILENO) < 0)
 		return -1;
 
+	/* Both ends nonblocking: a burst of ^C never blocks the handler */
+	if (pipe(sig_pipe) < 0 ||
+	    fcntl(sig_pipe[0], F_SETFL, O_NONBLOCK) < 0 ||
+	    fcntl(sig_pipe[1], F_SETFL, O_NONBLOCK) < 0) {
+		fprintf(stderr, "Cannot create pipe\n");
+		goto err_out;
+	}
 	signal(SIGINT, sigint);
 
 	//FIXME: Close an open pseudo terminal
@@ -950,7 +3689,13 @@ int main(int argc, char *argv[])
 	 * this command is intermixed. gdb command prompt shows
 	 * this annoying output.
 	 */
-	sprintf(gdb_args, "--tty=%s", ptsname(prog_ptys));
+	sprintf(gdb_args, "--tty=%s", ttyname(prog_ptys));
+
+	gdb_argv[0] = gdb_bin_name;
+	gdb_argv[1] = gdb_args;
+	for (i = 0; i < gdb_prog_nargs; i++)
+		gdb_argv[i + 2] = gdb_prog_args[i];
+	gdb_argv[i + 2] = NULL;
 
 	/* Child is created with a pseudo controlling terminal */
 	gv_h->gdb_pid = forkpty(&gdb_ptym, NULL, NULL, NULL);
@@ -968,10 +3713,27 @@ int main(int argc, char *argv[])
 		tcsetattr(STDIN_FILENO, TCSANOW, &stermios);
 
 		/*execlp(gdb_bin_name, gdb_bin_name, "--interpreter=mi", NULL);*/
-		execlp(gdb_bin_name, gdb_bin_name, gdb_args, NULL);
+		execvp(gdb_bin_name, gdb_argv);
 	}
 	/* Parent */
 
+	/* Opened here, gdb does not inherit it */
+	if (!vim_sock_path) {
+		if (!(tmpdir = getenv("TMPDIR")))
+			tmpdir = "/tmp";
+		snprintf(sock_path, SOCK_PATH_SIZE, "%s/gdbvim-%d.sock",
+			 tmpdir, getpid());
+		vim_sock_path = sock_path;
+	}
+	if (!vim_channel_open(vim_sock_path, do_vim_request))
+		printf("Vim channel: unix:%s\n", vim_sock_path);
+
+	/*
+	 * The prompt is shown at once. Until gdb has loaded the symbols,
+	 * the lines entered are queued and the status is in the prompt.
+	 */
+	show_prompt();
+
 	/*
 	 * Direction of transfers:
 	 *	stdin -> gdb_ptym or prog_ptym,
@@ -979,6 +3741,7 @@ int main(int argc, char *argv[])
 	 */
 	main_loop();
 
+	vim_channel_close();
 	tty_reset(STDIN_FILENO);
 err_out:
 	free(gv_h);
@@ -19,18 +19,21 @@ typedef enum gdb_cmd_type {
 	GDB_CMD_MI
 } gdb_cmd_type_t;
 
-typedef enum gdb_mi_cmd_state {
-	GDB_MI_CMD_COMPLETED,
-	GDB_MI_CMD_INCOMPLETED,
-} gdb_mi_cmd_state_t;
-
 typedef enum gdb_state {
+	GDB_STATE_STARTUP,
 	GDB_STATE_CHECK_CMD,
 	GDB_STATE_CLI,
 	GDB_STATE_MI,
 	GDB_STATE_COMPLETION
 } gdb_state_t;
 
+/* gdbvim's own commands: "gdbvim <name> [args]", or "gv" for short */
+typedef struct gv_cmd {
+	char *name;
+	void (*handler)(char *args);
+	char *help;
+} gv_cmd_t;
+
 typedef struct gdbvim {
 	pid_t gdb_pid;
 } gdbvim_t;
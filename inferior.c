@@ -0,0 +1,438 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "inferior.h"
+#include "mi_raw.h"
+
+static lib_entry_t **lib_buckets;
+static int lib_size, lib_count;
+static lib_entry_t **lib_sorted;	/* by address, made when asked */
+static int lib_sorted_ok;
+static thread_entry_t *threads;		/* indexed by the thread id */
+static int thread_size, thread_count;
+static group_entry_t *groups;
+static unsigned long lib_gen;		/* advances as the set changes */
+
+static int grow_lib_buckets(void)
+{
+	lib_entry_t **new_buckets, *lib, *next;
+	int new_size = lib_size ? lib_size * 2 : LIB_HASH_MIN;
+	unsigned int h;
+	int i;
+
+	new_buckets = (lib_entry_t **)calloc(new_size, sizeof(lib_entry_t *));
+	if (!new_buckets) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return -1;
+	}
+	for (i = 0; i < lib_size; i++) {
+		for (lib = lib_buckets[i]; lib; lib = next) {
+			next = lib->hnext;
+			h = mi_raw_hash(lib->name) & (new_size - 1);
+			lib->hnext = new_buckets[h];
+			new_buckets[h] = lib;
+		}
+	}
+	free(lib_buckets);
+	lib_buckets = new_buckets;
+	lib_size = new_size;
+
+	return 0;
+}
+
+static lib_entry_t **find_lib(const char *name)
+{
+	lib_entry_t **pp;
+
+	pp = &lib_buckets[mi_raw_hash(name) & (lib_size - 1)];
+	for (; *pp; pp = &(*pp)->hnext)
+		if (!strcmp((*pp)->name, name))
+			break;
+
+	return pp;
+}
+
+/* The lowest from and the highest to of ranges=[{from=..,to=..},..] */
+static void get_ranges(const char *rec, const char *end, lib_entry_t *lib)
+{
+	char buf[32];
+	unsigned long addr;
+	const char *s;
+
+	lib->lo = lib->hi = 0;
+	for (s = rec; s = mi_raw_field(s, end, "from", buf, sizeof(buf)); ) {
+		addr = strtoul(buf, NULL, 16);
+		if (!lib->lo || addr < lib->lo)
+			lib->lo = addr;
+		if (!(s = mi_raw_field(s, end, "to", buf, sizeof(buf))))
+			break;
+		if ((addr = strtoul(buf, NULL, 16)) > lib->hi)
+			lib->hi = addr;
+	}
+}
+
+static void library_loaded(const char *rec, const char *end)
+{
+	char name[1024];
+	lib_entry_t **pp, *lib;
+
+	if (!mi_raw_field(rec, end, "id", name, sizeof(name)))
+		return;
+	if (lib_count >= lib_size && grow_lib_buckets() < 0)
+		return;
+	/* gdb may say it again, e.g. once the symbols are loaded */
+	if (!(lib = *(pp = find_lib(name)))) {
+		if (!(lib = (lib_entry_t *)calloc(1, sizeof(lib_entry_t))) ||
+		    !(lib->name = strdup(name))) {
+			fprintf(stderr, "Cannot allocate memory\n");
+			free(lib);
+			return;
+		}
+		*pp = lib;
+		lib_count++;
+		lib_gen++;
+	}
+	mi_raw_field(rec, end, "thread-group", lib->group, sizeof(lib->group));
+	get_ranges(rec, end, lib);
+	lib_sorted_ok = 0;
+}
+
+static void free_lib(lib_entry_t **pp)
+{
+	lib_entry_t *lib = *pp;
+
+	*pp = lib->hnext;
+	free(lib->name);
+	free(lib);
+	lib_count--;
+	lib_gen++;
+	lib_sorted_ok = 0;
+}
+
+static void library_unloaded(const char *rec, const char *end)
+{
+	char name[1024];
+	lib_entry_t **pp;
+
+	if (lib_size && mi_raw_field(rec, end, "id", name, sizeof(name)) &&
+	    *(pp = find_lib(name)))
+		free_lib(pp);
+}
+
+static thread_entry_t *get_thread(const char *rec, const char *end,
+				  int create)
+{
+	thread_entry_t *new_threads;
+	int new_size = thread_size ? thread_size : THREAD_TAB_MIN;
+	char buf[16];
+	int id;
+
+	if (!mi_raw_field(rec, end, "id", buf, sizeof(buf)) ||
+	    (id = atoi(buf)) <= 0)
+		return NULL;
+	if (id < thread_size)
+		return &threads[id];
+	if (!create)
+		return NULL;
+
+	while (new_size <= id)
+		new_size *= 2;
+	new_threads = (thread_entry_t *)realloc(threads,
+					new_size * sizeof(thread_entry_t));
+	if (!new_threads) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return NULL;
+	}
+	memset(&new_threads[thread_size], 0,
+	       (new_size - thread_size) * sizeof(thread_entry_t));
+	threads = new_threads;
+	thread_size = new_size;
+
+	return &threads[id];
+}
+
+static void thread_created(const char *rec, const char *end)
+{
+	thread_entry_t *t;
+
+	if (!(t = get_thread(rec, end, 1)))
+		return;
+	mi_raw_field(rec, end, "group-id", t->group, sizeof(t->group));
+	if (!t->alive)
+		thread_count++;
+	t->alive = 1;
+}
+
+static void thread_exited(const char *rec, const char *end)
+{
+	thread_entry_t *t;
+
+	if ((t = get_thread(rec, end, 0)) && t->alive) {
+		t->alive = 0;
+		thread_count--;
+	}
+}
+
+static group_entry_t *get_group(const char *rec, const char *end)
+{
+	group_entry_t *g;
+	char id[16];
+
+	if (!mi_raw_field(rec, end, "id", id, sizeof(id)))
+		return NULL;
+	for (g = groups; g; g = g->next)
+		if (!strcmp(g->id, id))
+			return g;
+	if (!(g = (group_entry_t *)calloc(1, sizeof(group_entry_t)))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return NULL;
+	}
+	strcpy(g->id, id);
+	g->next = groups;
+	groups = g;
+
+	return g;
+}
+
+/* What is left of the group's last process goes, its libraries too */
+static void forget_group(const char *id)
+{
+	lib_entry_t **pp;
+	int i;
+
+	for (i = 0; i < thread_size; i++) {
+		if (threads[i].alive && !strcmp(threads[i].group, id)) {
+			threads[i].alive = 0;
+			thread_count--;
+		}
+	}
+	for (i = 0; i < lib_size; i++) {
+		for (pp = &lib_buckets[i]; *pp; ) {
+			if (!strcmp((*pp)->group, id))
+				free_lib(pp);
+			else
+				pp = &(*pp)->hnext;
+		}
+	}
+}
+
+static void thread_group_started(const char *rec, const char *end)
+{
+	group_entry_t *g;
+	char buf[16];
+
+	if (!(g = get_group(rec, end)))
+		return;
+	forget_group(g->id);
+	g->pid = mi_raw_field(rec, end, "pid", buf, sizeof(buf)) ?
+		 atoi(buf) : 0;
+	g->exit_code = 0;
+}
+
+static void thread_group_exited(const char *rec, const char *end)
+{
+	group_entry_t *g;
+	char buf[16];
+
+	if (!(g = get_group(rec, end)))
+		return;
+	g->pid = 0;
+	g->exit_code = mi_raw_field(rec, end, "exit-code", buf, sizeof(buf)) ?
+		       strtol(buf, NULL, 8) : 0;
+}
+
+/*
+ * rec is a notify record past its '=', end is past its line. Returns 0
+ * for the records the parser is to see, 1 for those taken here. The
+ * ones neither side knows, e.g. =cmd-param-changed, are dropped since
+ * the grammar would reject the whole reply for them.
+ */
+static int note_record(const char *rec, const char *end)
+{
+	int len = strcspn(rec, ",\r\n");
+
+	if (len > 11 && !strncmp(rec, "breakpoint-", 11))
+		return 0;
+
+	if (len == 14 && !strncmp(rec, "library-loaded", len))
+		library_loaded(rec + len, end);
+	else if (len == 16 && !strncmp(rec, "library-unloaded", len))
+		library_unloaded(rec + len, end);
+	else if (len == 14 && !strncmp(rec, "thread-created", len))
+		thread_created(rec + len, end);
+	else if (len == 13 && !strncmp(rec, "thread-exited", len))
+		thread_exited(rec + len, end);
+	else if (len == 20 && !strncmp(rec, "thread-group-started", len))
+		thread_group_started(rec + len, end);
+	else if (len == 19 && !strncmp(rec, "thread-group-exited", len))
+		thread_group_exited(rec + len, end);
+
+	return 1;
+}
+
+/*
+ * Takes the notify records it knows out of a gdb/mi reply, in place,
+ * in one pass over it. Returns the number of records taken.
+ */
+int inferior_scan(char *reply)
+{
+	char *src, *dst, *rec, *end;
+	int n = 0;
+
+	/* Most replies have none, and are not to be copied at all */
+	if (!strchr(reply, '='))
+		return 0;
+
+	for (src = dst = reply; *src; src = end) {
+		if (!(end = strchr(src, '\n')))
+			end = src + strlen(src);
+		else
+			end++;
+		rec = src + strspn(src, "0123456789");
+		if (*rec == '=' && note_record(rec + 1, end)) {
+			n++;
+			continue;
+		}
+		if (dst != src)
+			memmove(dst, src, end - src);
+		dst += end - src;
+	}
+	*dst = '\0';
+
+	return n;
+}
+
+static int cmp_lib(const void *a, const void *b)
+{
+	unsigned long lo_a = (*(lib_entry_t **)a)->lo;
+	unsigned long lo_b = (*(lib_entry_t **)b)->lo;
+
+	return lo_a < lo_b ? -1 : lo_a > lo_b;
+}
+
+/* Made again only when a library has come or gone since last time */
+static int sort_libs(void)
+{
+	lib_entry_t *lib;
+	int i, n = 0;
+
+	if (lib_sorted_ok)
+		return 0;
+	free(lib_sorted);
+	lib_sorted = NULL;
+	if (!lib_count)
+		return 0;
+	if (!(lib_sorted = (lib_entry_t **)malloc(lib_count *
+						  sizeof(lib_entry_t *)))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return -1;
+	}
+	for (i = 0; i < lib_size; i++)
+		for (lib = lib_buckets[i]; lib; lib = lib->hnext)
+			lib_sorted[n++] = lib;
+	qsort(lib_sorted, n, sizeof(lib_entry_t *), cmp_lib);
+	lib_sorted_ok = 1;
+
+	return 0;
+}
+
+/* The library whose ranges take in addr, by a binary search */
+lib_entry_t *inferior_lib_at(unsigned long addr)
+{
+	int lo = 0, hi = lib_count - 1, mid;
+
+	if (sort_libs() < 0 || !lib_count)
+		return NULL;
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (lib_sorted[mid]->lo <= addr)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	if (lib_sorted[lo]->lo <= addr && addr < lib_sorted[lo]->hi)
+		return lib_sorted[lo];
+
+	return NULL;
+}
+
+/* The process of the program, 0 if gdb has not told us of one */
+int inferior_pid(void)
+{
+	group_entry_t *g;
+
+	for (g = groups; g; g = g->next)
+		if (g->pid)
+			return g->pid;
+
+	return 0;
+}
+
+/*
+ * Advances whenever a library is loaded or unloaded; loading the same
+ * libraries again, when the program is run again, leaves it as it is.
+ */
+unsigned long inferior_lib_gen(void)
+{
+	return lib_gen;
+}
+
+/* The ids of the live threads, up to max of them */
+int inferior_threads(int *ids, int max)
+{
+	int i, n = 0;
+
+	for (i = 0; i < thread_size && n < max; i++)
+		if (threads[i].alive)
+			ids[n++] = i;
+
+	return n;
+}
+
+/* Laid out as "info sharedlibrary" does, the names with filter in them */
+void inferior_print_libs(const char *filter)
+{
+	lib_entry_t *lib;
+	int i, n = 0;
+
+	if (sort_libs() < 0)
+		return;
+	if (!lib_count) {
+		printf("No shared libraries loaded at this time.\n");
+		return;
+	}
+	printf("From                To                  "
+	       "Shared Object Library\n");
+	for (i = 0; i < lib_count; i++) {
+		lib = lib_sorted[i];
+		if (filter && !strstr(lib->name, filter))
+			continue;
+		if (n++ < LIB_LIST_MAX)
+			printf("0x%016lx  0x%016lx  %s\n", lib->lo, lib->hi,
+			       lib->name);
+	}
+	if (n > LIB_LIST_MAX)
+		printf("... and %d more\n", n - LIB_LIST_MAX);
+	printf("%d of %d libraries\n", n, lib_count);
+}
+
+void inferior_print_threads(void)
+{
+	group_entry_t *g;
+	int i, n = 0;
+
+	for (g = groups; g; g = g->next) {
+		if (g->pid)
+			printf("Thread group %s: process %d\n", g->id, g->pid);
+		else
+			printf("Thread group %s: not running (exit code %d)\n",
+			       g->id, g->exit_code);
+	}
+	for (i = 0; i < thread_size && n < thread_count; i++) {
+		if (!threads[i].alive)
+			continue;
+		printf("  Thread %d in %s\n", i, threads[i].group);
+		n++;
+	}
+	printf("%d thread%s\n", thread_count, thread_count == 1 ? "" : "s");
+}
@@ -0,0 +1,50 @@
+#ifndef __INFERIOR_H__
+#define __INFERIOR_H__
+
+/*
+ * Libraries and threads of the program, taken from the notify records
+ * that come in floods when a big process is started or attached:
+ *
+ *	=thread-group-started,id="i1",pid="4242"
+ *	=thread-created,id="7",group-id="i1"
+ *	=library-loaded,id="/lib/libc.so.6",...,ranges=[{from="0x..",to="0x.."}]
+ *
+ * They are recognized by their class, right after the '=', and only
+ * the fields needed here are copied out; no parse tree is built. The
+ * lines are then cut out of the reply, so the parser only sees the
+ * =breakpoint-* records among the notifications, which it knows about.
+ */
+typedef struct lib_entry {
+	char *name;
+	char group[16];		/* thread group (inferior): i1 */
+	unsigned long lo;	/* lowest address of its ranges */
+	unsigned long hi;	/* the highest, as gdb gives it */
+	struct lib_entry *hnext;
+} lib_entry_t;
+
+typedef struct thread_entry {
+	int alive;
+	char group[16];
+} thread_entry_t;
+
+typedef struct group_entry {
+	char id[16];
+	int pid;		/* 0 while not started */
+	int exit_code;
+	struct group_entry *next;
+} group_entry_t;
+
+#define LIB_HASH_MIN	256
+#define THREAD_TAB_MIN	64
+#define LIB_LIST_MAX	50
+
+/* Function prototypes */
+int inferior_scan(char *reply);
+lib_entry_t *inferior_lib_at(unsigned long addr);
+int inferior_pid(void);
+int inferior_threads(int *ids, int max);
+unsigned long inferior_lib_gen(void);
+void inferior_print_libs(const char *filter);
+void inferior_print_threads(void);
+
+#endif /* __INFERIOR_H__ */
@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include "memview.h"
+#include "slot_cache.h"
+
+#define ONES	0x0101010101010101ULL
+#define HIGHS	0x8080808080808080ULL
+/* Bytes of x, all below 0x80, with m < byte < n get their high bit set */
+#define BETWEEN(x, m, n) \
+	((ONES * (127 + (n)) - ((x) & ~HIGHS)) & ~(x) & \
+	 (((x) & ~HIGHS) + ONES * (127 - (m))) & HIGHS)
+
+static mem_chunk_t chunks[MEM_CHUNKS_MAX];
+static slot_cache_t cache = {
+	.slots = MEM_CHUNKS_MAX,
+	.asked_max = MEM_ASKED_MAX
+};
+static unsigned long mv_fetched, mv_hits, mv_evicted, mv_bytes;
+static signed char hex_val[256];
+static int hex_val_ready;
+
+static void free_chunk(mem_chunk_t *c)
+{
+	free(c->data);
+	free(c->valid);
+	c->data = c->valid = NULL;
+	slot_cache_free(&cache, c - chunks);
+}
+
+/* Drops the chunks of an older epoch; 1 if there was one */
+int memview_sync(unsigned long epoch)
+{
+	int i;
+
+	if (!slot_cache_sync(&cache, epoch))
+		return 0;
+	for (i = 0; i < MEM_CHUNKS_MAX; i++)
+		free_chunk(&chunks[i]);
+
+	return 1;
+}
+
+static mem_chunk_t *find_chunk(unsigned long addr)
+{
+	int i;
+
+	addr -= addr % MEM_CHUNK_SIZE;
+	for (i = 0; i < MEM_CHUNKS_MAX; i++)
+		if (chunks[i].data && chunks[i].addr == addr)
+			return &chunks[i];
+
+	return NULL;
+}
+
+/* Whether the chunk with addr in it is kept */
+int memview_has(unsigned long addr)
+{
+	return find_chunk(addr) != NULL;
+}
+
+/* 1 if the chunk with addr is to be asked: neither kept nor asked */
+int memview_ask(unsigned long addr)
+{
+	addr -= addr % MEM_CHUNK_SIZE;
+
+	return !find_chunk(addr) && slot_cache_ask(&cache, addr);
+}
+
+static void init_hex_val(void)
+{
+	int c;
+
+	hex_val_ready = 1;
+	memset(hex_val, -1, sizeof(hex_val));
+	for (c = '0'; c <= '9'; c++)
+		hex_val[c] = c - '0';
+	for (c = 'a'; c <= 'f'; c++)
+		hex_val[c] = hex_val[toupper(c)] = c - 'a' + 10;
+}
+
+/*
+ * Decodes len hex digits to len / 2 bytes at out; -1 if one is not a
+ * hex digit. Eight digits are done at a time in a 64-bit word, each
+ * byte of it holding one: a digit's value is its low nibble, plus 9
+ * for a letter, which has bit 6 set. The pairs are then packed into
+ * four bytes. A big-endian host and the tail go one digit at a time.
+ */
+int memview_hex_decode(const char *hex, int len, unsigned char *out)
+{
+	const char *end = hex + len;
+	unsigned char *start = out;
+	uint64_t x, lower, nib;
+	uint32_t packed;
+	int hi, lo;
+
+	if (!hex_val_ready)
+		init_hex_val();
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	for (; end - hex >= 8; hex += 8, out += 4) {
+		memcpy(&x, hex, 8);
+		lower = x | 0x2020202020202020ULL;
+		if ((x & HIGHS) || ((BETWEEN(x, '0' - 1, '9' + 1) |
+		     BETWEEN(lower, 'a' - 1, 'f' + 1)) != HIGHS))
+			return -1;
+		nib = (x & 0x0f0f0f0f0f0f0f0fULL) + ((x >> 6) & ONES) * 9;
+		/* The first digit of a pair is the high nibble */
+		nib = ((nib & 0x00ff00ff00ff00ffULL) << 4) |
+		      ((nib >> 8) & 0x00ff00ff00ff00ffULL);
+		nib = (nib | (nib >> 8)) & 0x0000ffff0000ffffULL;
+		packed = (uint32_t)(nib | (nib >> 16));
+		memcpy(out, &packed, 4);
+	}
+#endif
+	for (; end - hex >= 2; hex += 2) {
+		if ((hi = hex_val[(unsigned char)hex[0]]) < 0 ||
+		    (lo = hex_val[(unsigned char)hex[1]]) < 0)
+			return -1;
+		*out++ = hi << 4 | lo;
+	}
+
+	return out - start;
+}
+
+/* A free slot, or the one looked at least recently */
+static mem_chunk_t *get_slot(void)
+{
+	mem_chunk_t *c = &chunks[slot_cache_pick(&cache)];
+
+	if (c->data) {
+		free_chunk(c);
+		mv_evicted++;
+	}
+
+	return c;
+}
+
+/*
+ * Keeps the reply of "-data-read-memory-bytes ADDR 4096", read as it
+ * is, with one block for each readable range:
+ *
+ *	^done,memory=[{begin="0x601000",offset="0x0",end="0x601100",
+ *		       contents="7f454c46..."}]
+ *
+ * An error, nothing could be read, keeps a chunk of unreadable bytes
+ * so it is not asked again. A chunk asked before the epoch changed is
+ * dropped. Returns the number of bytes read.
+ */
+int memview_store(unsigned long addr, const char *reply)
+{
+	mem_chunk_t *c;
+	const char *s, *hex, *quote;
+	unsigned long begin;
+	int n = 0, len;
+
+	if (!slot_cache_take(&cache, addr))
+		return 0;
+	c = get_slot();
+	c->data = (unsigned char *)malloc(MEM_CHUNK_SIZE);
+	c->valid = (unsigned char *)calloc(1, MEM_CHUNK_SIZE);
+	if (!c->data || !c->valid) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		free_chunk(c);
+		return -1;
+	}
+	c->addr = addr;
+	slot_cache_touch(&cache, c - chunks);
+	mv_fetched++;
+	if (strncmp(reply, "^done", 5))
+		return 0;
+
+	for (s = reply; s = strstr(s, "begin=\""); s = quote) {
+		begin = strtoul(s + 7, NULL, 16);
+		if (!(hex = strstr(s, "contents=\"")) ||
+		    !(quote = strchr(hex += 10, '"')))
+			break;
+		len = (quote - hex) / 2;
+		if (begin < addr || begin - addr + len > MEM_CHUNK_SIZE)
+			continue;
+		if (memview_hex_decode(hex, len * 2,
+				       c->data + (begin - addr)) != len)
+			continue;
+		memset(c->valid + (begin - addr), 1, len);
+		n += len;
+	}
+	mv_bytes += n;
+
+	return n;
+}
+
+static int byte_at(unsigned long addr, mem_chunk_t **cp)
+{
+	if (!*cp || addr - (*cp)->addr >= MEM_CHUNK_SIZE) {
+		if (*cp = find_chunk(addr)) {
+			slot_cache_touch(&cache, *cp - chunks);
+			mv_hits++;
+		}
+	}
+	if (!*cp || !(*cp)->valid[addr - (*cp)->addr])
+		return -1;
+
+	return (*cp)->data[addr - (*cp)->addr];
+}
+
+/*
+ * len bytes from addr, as a hex dump with the characters on the right,
+ * or only as characters, MEM_ASCII_LINE a line. The chunks are kept.
+ */
+void memview_print(unsigned long addr, int len, int ascii)
+{
+	int per_line = ascii ? MEM_ASCII_LINE : MEM_HEX_LINE;
+	char chars[MEM_ASCII_LINE + 1];
+	mem_chunk_t *c = NULL;
+	int i, b;
+
+	for (; len > 0; addr += per_line, len -= per_line) {
+		printf("0x%016lx:", addr);
+		for (i = 0; i < per_line && i < len; i++) {
+			b = byte_at(addr + i, &c);
+			chars[i] = b < 0 ? ' ' : isprint(b) ? b : '.';
+			if (ascii)
+				continue;
+			if (b < 0)
+				printf(" ??");
+			else
+				printf(" %02x", b);
+		}
+		chars[i] = '\0';
+		if (ascii)
+			printf(" %s\n", chars);
+		else
+			printf("%*s  |%s|\n", 3 * (per_line - i), "", chars);
+	}
+}
+
+void memview_print_stats(void)
+{
+	int i, n = 0;
+
+	for (i = 0; i < MEM_CHUNKS_MAX; i++)
+		if (chunks[i].data)
+			n++;
+	printf("Memory view: %d of %d chunks of %d bytes\n", n,
+	       MEM_CHUNKS_MAX, MEM_CHUNK_SIZE);
+	printf("%lu chunks fetched, %lu bytes read, %lu hits, %lu evicted\n",
+	       mv_fetched, mv_bytes, mv_hits, mv_evicted);
+}
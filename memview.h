@@ -0,0 +1,37 @@
+#ifndef __MEMVIEW_H__
+#define __MEMVIEW_H__
+
+/*
+ * A view of the program's memory, a screen at a time. Memory is read
+ * in chunks of MEM_CHUNK_SIZE bytes, "-data-read-memory-bytes ADDR
+ * 4096", as the screens are looked at. The hex contents of a reply are
+ * decoded straight into the chunk, eight digits at a time; at most
+ * MEM_CHUNKS_MAX chunks are kept and the one looked at least recently
+ * goes first. Bytes gdb could not read are shown as "??".
+ *
+ * As the stack window, the chunks belong to an epoch of the stop cache
+ * and are dropped when it changes.
+ */
+#define MEM_CHUNK_SIZE	4096
+#define MEM_CHUNKS_MAX	64
+#define MEM_ASKED_MAX	16
+#define MEM_HEX_LINE	16
+#define MEM_ASCII_LINE	64
+#define MEM_SCREEN_LINES	16
+
+typedef struct mem_chunk {
+	unsigned long addr;	/* a multiple of MEM_CHUNK_SIZE */
+	unsigned char *data;	/* NULL if the slot is free */
+	unsigned char *valid;	/* 1 for each byte gdb could read */
+} mem_chunk_t;
+
+/* Function prototypes */
+int memview_sync(unsigned long epoch);
+int memview_has(unsigned long addr);
+int memview_ask(unsigned long addr);
+int memview_store(unsigned long addr, const char *reply);
+int memview_hex_decode(const char *hex, int len, unsigned char *out);
+void memview_print(unsigned long addr, int len, int ascii);
+void memview_print_stats(void);
+
+#endif /* __MEMVIEW_H__ */
@@ -0,0 +1,456 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "mi_batch.h"
+
+static mi_batch_file_t *files;
+static int file_count, files_size;
+static mi_batch_chunk_t *chunks;
+static int chunk_count, chunks_size;
+static int failed;
+
+static int read_full(int fd, void *buf, int len)
+{
+	int n, done = 0;
+
+	while (done < len) {
+		if ((n = read(fd, (char *)buf + done, len - done)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (!n)
+			break;
+		done += n;
+	}
+
+	return done;
+}
+
+static int write_full(int fd, const void *buf, int len)
+{
+	int n, done = 0;
+
+	while (done < len) {
+		if ((n = write(fd, (const char *)buf + done, len - done)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		done += n;
+	}
+
+	return 0;
+}
+
+static int add_chunk(int file, off_t lo, off_t hi)
+{
+	mi_batch_chunk_t *c;
+	int size;
+
+	if (chunk_count == chunks_size) {
+		size = chunks_size ? chunks_size * 2 : 64;
+		c = (mi_batch_chunk_t *)realloc(chunks, size * sizeof(*c));
+		if (!c) {
+			fprintf(stderr, "Cannot allocate memory\n");
+			return -1;
+		}
+		chunks = c;
+		chunks_size = size;
+	}
+	c = &chunks[chunk_count++];
+	c->file = file;
+	c->lo = lo;
+	c->hi = hi;
+
+	return 0;
+}
+
+static int add_file(const char *path, off_t size)
+{
+	mi_batch_file_t *f;
+	off_t lo;
+	int n;
+
+	if (file_count == files_size) {
+		n = files_size ? files_size * 2 : 64;
+		f = (mi_batch_file_t *)realloc(files, n * sizeof(*f));
+		if (!f) {
+			fprintf(stderr, "Cannot allocate memory\n");
+			return -1;
+		}
+		files = f;
+		files_size = n;
+	}
+	f = &files[file_count];
+	if (!(f->path = strdup(path))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return -1;
+	}
+	f->size = size;
+	for (lo = 0; lo < size; lo += MI_BATCH_CHUNK_SIZE)
+		if (add_chunk(file_count, lo, lo + MI_BATCH_CHUNK_SIZE < size ?
+			      lo + MI_BATCH_CHUNK_SIZE : size) < 0)
+			return -1;
+	file_count++;
+
+	return 0;
+}
+
+/*
+ * A file, or those of a directory and of the ones in it, by name. A
+ * link to a directory is followed only if it was named, one found in a
+ * directory could lead back up to it.
+ */
+static int add_path(const char *path, int named)
+{
+	struct dirent **names;
+	struct stat st, lst;
+	strbuf_t sub = { 0 };
+	int i, n, ret = 0;
+
+	if (stat(path, &st) < 0) {
+		perror(path);
+		failed++;
+		return 0;
+	}
+	if (S_ISREG(st.st_mode))
+		return add_file(path, st.st_size);
+	if (!S_ISDIR(st.st_mode))
+		return 0;
+	if (!named && (lstat(path, &lst) < 0 || S_ISLNK(lst.st_mode)))
+		return 0;
+	if ((n = scandir(path, &names, NULL, alphasort)) < 0) {
+		perror(path);
+		failed++;
+		return 0;
+	}
+	for (i = 0; i < n; i++) {
+		/* Neither . and .. nor hidden files */
+		if (!ret && names[i]->d_name[0] != '.') {
+			strbuf_reset(&sub);
+			strbuf_printf(&sub, "%s/%s", path, names[i]->d_name);
+			ret = add_path(sub.str, 0);
+		}
+		free(names[i]);
+	}
+	free(names);
+	strbuf_free(&sub);
+
+	return ret;
+}
+
+/*
+ * Where the first prompt line starting at or past x ends, the size of
+ * the file if there is none: a chunk from x starts there, and one up to
+ * x ends there. buf is for the reading.
+ */
+static off_t prompt_after(int fd, off_t x, off_t size, strbuf_t *buf)
+{
+	char *line, *eol, *end;
+	off_t pos;
+	int n, skip = 1;
+
+	if (x <= 0 || x >= size)
+		return x <= 0 ? 0 : size;
+	strbuf_reset(buf);
+	/* The byte before x tells if a line starts at x */
+	pos = x - 1;
+	for (;;) {
+		if (strbuf_reserve(buf, MI_BATCH_READ_SIZE) < 0)
+			return -1;
+		n = pread(fd, buf->str + buf->len, MI_BATCH_READ_SIZE,
+			  pos + buf->len);
+		if (n < 0)
+			return -1;
+		if (!n)
+			return size;
+		buf->len += n;
+		line = buf->str;
+		end = buf->str + buf->len;
+		if (skip) {
+			if (!(eol = memchr(line, '\n', end - line))) {
+				pos += buf->len;
+				buf->len = 0;
+				continue;
+			}
+			line = eol + 1;
+			skip = 0;
+		}
+		for (; (eol = memchr(line, '\n', end - line)); line = eol + 1)
+			if (mi_is_prompt(line, eol - line))
+				return pos + (eol + 1 - buf->str);
+		/* The line not read whole yet, if it can be a prompt */
+		if (end - line > MI_BATCH_PROMPT_MAX) {
+			line = end;
+			skip = 1;
+		}
+		n = line - buf->str;
+		memmove(buf->str, line, end - line);
+		buf->len -= n;
+		pos += n;
+	}
+}
+
+static int convert_chunk(const mi_batch_chunk_t *c, strbuf_t *in,
+			 strbuf_t *out, mi_format_t fmt)
+{
+	const mi_batch_file_t *f = &files[c->file];
+	off_t lo, hi;
+	int fd, n;
+
+	if ((fd = open(f->path, O_RDONLY)) < 0) {
+		perror(f->path);
+		return -1;
+	}
+	lo = prompt_after(fd, c->lo, f->size, in);
+	hi = prompt_after(fd, c->hi, f->size, in);
+	strbuf_reset(in);
+	if (lo < 0 || hi < 0 || strbuf_reserve(in, hi - lo) < 0) {
+		perror(f->path);
+		close(fd);
+		return -1;
+	}
+	/* An earlier chunk may have taken it all */
+	while (lo + in->len < hi) {
+		n = pread(fd, in->str + in->len, hi - lo - in->len,
+			  lo + in->len);
+		if (n <= 0)
+			break;
+		in->len += n;
+	}
+	close(fd);
+	if (lo + in->len < hi) {
+		fprintf(stderr, "%s: Cannot read to %ld\n", f->path, (long)hi);
+		return -1;
+	}
+
+	if ((n = mi_serialize_text(out, in->str, in->len, fmt)) < 0)
+		return -1;
+	/* The end of the file, after its last prompt */
+	if (n < in->len)
+		return mi_serialize_raw(out, in->str + n, in->len - n, fmt);
+
+	return 0;
+}
+
+/* Converts the chunks it is told, and sends back their length and bytes */
+static void run_worker(int from_parent, int to_parent, mi_format_t fmt)
+{
+	strbuf_t in = { 0 }, out = { 0 };
+	int chunk, len;
+
+	while (read_full(from_parent, &chunk, sizeof(chunk)) ==
+	       sizeof(chunk)) {
+		strbuf_reset(&out);
+		len = convert_chunk(&chunks[chunk], &in, &out, fmt) < 0 ?
+		      -1 : out.len;
+		if (write_full(to_parent, &len, sizeof(len)) < 0 ||
+		    (len > 0 && write_full(to_parent, out.str, len) < 0))
+			break;
+	}
+	_exit(0);
+}
+
+static int start_worker(mi_batch_worker_t *all, int k, mi_format_t fmt)
+{
+	mi_batch_worker_t *w = &all[k];
+	int in[2], out[2], i;
+
+	if (pipe(in) < 0)
+		return -1;
+	if (pipe(out) < 0) {
+		close(in[0]);
+		close(in[1]);
+		return -1;
+	}
+	if ((w->pid = fork()) < 0) {
+		close(in[0]);
+		close(in[1]);
+		close(out[0]);
+		close(out[1]);
+		return -1;
+	}
+	if (!w->pid) {
+		/* The others must see the end when the parent closes */
+		for (i = 0; i < k; i++) {
+			close(all[i].to_worker);
+			close(all[i].from_worker);
+		}
+		close(in[1]);
+		close(out[0]);
+		run_worker(in[0], out[1], fmt);
+	}
+	close(in[0]);
+	close(out[1]);
+	w->to_worker = in[1];
+	w->from_worker = out[0];
+	w->chunk = -1;
+
+	return 0;
+}
+
+/*
+ * What a worker has sent back into its slot; -1 if it is gone, and its
+ * chunk is lost.
+ */
+static int read_result(mi_batch_worker_t *w, strbuf_t *slot)
+{
+	int len, status;
+
+	if (read_full(w->from_worker, &len, sizeof(len)) == sizeof(len)) {
+		if (len < 0)
+			return 0;
+		strbuf_reset(slot);
+		if (!strbuf_reserve(slot, len) &&
+		    read_full(w->from_worker, slot->str, len) == len) {
+			slot->len = len;
+			slot->str[len] = '\0';
+			return 1;
+		}
+	}
+	fprintf(stderr, "A worker exited on %s\n",
+		files[chunks[w->chunk].file].path);
+	close(w->to_worker);
+	close(w->from_worker);
+	waitpid(w->pid, &status, 0);
+	w->pid = 0;
+
+	return -1;
+}
+
+/*
+ * Converts the transcripts under paths to stdout with jobs workers.
+ * Returns the number of files and chunks that could not be converted,
+ * -1 on error.
+ */
+int mi_batch_convert(char **paths, int path_count, int jobs,
+		     mi_format_t fmt)
+{
+	mi_batch_worker_t *workers;
+	struct pollfd *fds;
+	mi_batch_worker_t **busy;
+	strbuf_t *slots;
+	char *done;
+	struct timeval start, end;
+	long long bytes = 0;
+	int i, n, window, next = 0, written = 0, alive, ret;
+
+	for (i = 0; i < path_count; i++)
+		if (add_path(paths[i], 1) < 0)
+			return -1;
+	if (!chunk_count)
+		return failed;
+	if (jobs < 1)
+		jobs = 1;
+	if (jobs > chunk_count)
+		jobs = chunk_count;
+	window = jobs * MI_BATCH_AHEAD;
+	workers = (mi_batch_worker_t *)calloc(jobs, sizeof(*workers));
+	busy = (mi_batch_worker_t **)malloc(jobs * sizeof(*busy));
+	fds = (struct pollfd *)malloc(jobs * sizeof(*fds));
+	slots = (strbuf_t *)calloc(window, sizeof(*slots));
+	done = (char *)calloc(window, 1);
+	if (!workers || !busy || !fds || !slots || !done) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return -1;
+	}
+	/* A worker that dies is seen as the end of its output */
+	signal(SIGPIPE, SIG_IGN);
+	gettimeofday(&start, NULL);
+	for (alive = 0; alive < jobs; alive++) {
+		if (start_worker(workers, alive, fmt) < 0) {
+			perror(__FUNCTION__);
+			break;
+		}
+	}
+
+	for (ret = 0; written < chunk_count && !ret; ) {
+		for (i = 0, n = 0; i < alive; i++) {
+			if (!workers[i].pid)
+				continue;
+			/* The next chunk, if there is room for its result */
+			if (workers[i].chunk < 0 && next < chunk_count &&
+			    next < written + window) {
+				if (write_full(workers[i].to_worker, &next,
+					       sizeof(next)) < 0)
+					continue;
+				workers[i].chunk = next++;
+			}
+			if (workers[i].chunk >= 0) {
+				busy[n] = &workers[i];
+				fds[n].fd = workers[i].from_worker;
+				fds[n++].events = POLLIN;
+			}
+		}
+		if (!n) {
+			fprintf(stderr, "No worker is left\n");
+			ret = -1;
+			break;
+		}
+		if (poll(fds, n, -1) < 0) {
+			/* revents are left from the poll before */
+			if (errno == EINTR)
+				continue;
+			perror(__FUNCTION__);
+			ret = -1;
+			break;
+		}
+		for (i = 0; i < n; i++) {
+			if (!fds[i].revents)
+				continue;
+			if (read_result(busy[i],
+					&slots[busy[i]->chunk % window]) <= 0)
+				failed++;
+			done[busy[i]->chunk % window] = 1;
+			busy[i]->chunk = -1;
+		}
+		/* What has come in order */
+		for (; written < next && done[written % window]; written++) {
+			i = written % window;
+			if (write_full(1, slots[i].str, slots[i].len) < 0) {
+				perror("write");
+				ret = -1;
+				break;
+			}
+			bytes += slots[i].len;
+			strbuf_reset(&slots[i]);
+			done[i] = 0;
+		}
+	}
+
+	for (i = 0; i < alive; i++) {
+		if (!workers[i].pid)
+			continue;
+		close(workers[i].to_worker);
+		close(workers[i].from_worker);
+		waitpid(workers[i].pid, &n, 0);
+	}
+	gettimeofday(&end, NULL);
+	fprintf(stderr, "%d files, %d chunks, %d failed, %lld bytes written "
+		"by %d workers in %.1f seconds\n", file_count, chunk_count,
+		failed, bytes, alive, end.tv_sec - start.tv_sec +
+		(end.tv_usec - start.tv_usec) / 1e6);
+	for (i = 0; i < window; i++)
+		strbuf_free(&slots[i]);
+	for (i = 0; i < file_count; i++)
+		free(files[i].path);
+	free(files);
+	free(chunks);
+	free(workers);
+	free(busy);
+	free(fds);
+	free(slots);
+	free(done);
+
+	return ret < 0 ? -1 : failed;
+}
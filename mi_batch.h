@@ -0,0 +1,44 @@
+#ifndef __MI_BATCH_H__
+#define __MI_BATCH_H__
+
+#include <sys/types.h>
+#include "strbuf.h"
+#include "mi_serialize.h"
+
+/*
+ * Conversion of many transcripts, or of large ones, by worker
+ * processes. The files, those of directories in name order, are cut into
+ * chunks of about MI_BATCH_CHUNK_SIZE bytes; a worker takes the next
+ * chunk whenever it is done with one, moves its ends to the prompts
+ * after them, so that an output is never cut in two, and sends back its
+ * serialized outputs. They are written in the order of the files and of
+ * the chunks in them, whatever the order they come in.
+ */
+#define MI_BATCH_CHUNK_SIZE	(4 * 1024 * 1024)
+#define MI_BATCH_READ_SIZE	(64 * 1024)
+#define MI_BATCH_AHEAD		4	/* chunks done early, per worker */
+#define MI_BATCH_PROMPT_MAX	256	/* a longer line is not a prompt */
+
+typedef struct mi_batch_file {
+	char *path;
+	off_t size;
+} mi_batch_file_t;
+
+typedef struct mi_batch_chunk {
+	int file;
+	off_t lo;		/* where it would start and end, before */
+	off_t hi;		/* they are moved to the prompts */
+} mi_batch_chunk_t;
+
+typedef struct mi_batch_worker {
+	pid_t pid;		/* 0 once it is gone */
+	int to_worker;
+	int from_worker;
+	int chunk;		/* the one it is on, -1 if none */
+} mi_batch_worker_t;
+
+/* Function prototypes */
+int mi_batch_convert(char **paths, int path_count, int jobs,
+		     mi_format_t fmt);
+
+#endif /* __MI_BATCH_H__ */
@@ -1,9 +1,33 @@
 #ifndef __MI_CMD_LIST__
 #define __MI_CMD_LIST__
 
+struct gdbmi_output;
+
+typedef enum gdb_mi_cmd_state {
+	GDB_MI_CMD_COMPLETED,
+	GDB_MI_CMD_INCOMPLETED,
+} gdb_mi_cmd_state_t;
+
+/* What the cli arguments turn into */
+typedef enum gdb_mi_args_rule {
+	GDB_MI_ARGS_NONE,	/* ignored */
+	GDB_MI_ARGS_OPTIONAL,	/* appended to the mi command if given */
+	GDB_MI_ARGS_REQUIRED	/* appended, refused locally if missing */
+} gdb_mi_args_rule_t;
+
+/* Reads the parse tree of a reply, tells if more output is due */
+typedef gdb_mi_cmd_state_t (*gdb_mi_handler_t)(struct gdbmi_output *out);
+
+/*
+ * One row of cmd_mapping.gperf: cli alias, mi command, argument rule
+ * and the handler of its result.
+ */
 typedef struct gdb_mi_cmd {
 	char *name;
 	int code;
+	char *mi_cmd;
+	int args_rule;
+	gdb_mi_handler_t handler;
 } gdb_mi_cmd_t;
 
 typedef enum gdb_mi_cmd_code {
@@ -23,4 +47,7 @@ typedef enum gdb_mi_cmd_code {
 	GDB_MI_EXEC_END
 } gdb_mi_cmd_code_t;
 
+/* Result handlers referred to by the table */
+gdb_mi_cmd_state_t parse_mi_parsetree(struct gdbmi_output *out);
+
 #endif /* __MI_CMD_LIST__ */
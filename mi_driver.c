@@ -1,5 +1,14 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include "mi_parser.h"
+#include "mi_serialize.h"
+#include "mi_batch.h"
+
+#define CONVERT_READ_SIZE	(1024 * 1024)
+#define CONVERT_FLUSH_SIZE	(64 * 1024)
 
 /* Extern declarations */
 typedef struct yy_buffer_state *YY_BUFFER_STATE;
@@ -88,27 +97,217 @@ void read_from_memory()
 
 }
 
+static int write_all(int fd, const char *buf, int len)
+{
+	int n;
+
+	while (len > 0) {
+		if ((n = write(fd, buf, len)) < 0) {
+			perror("write");
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/* Reads all of fd into sb */
+static int read_all(int fd, strbuf_t *sb)
+{
+	int n;
+
+	for (;;) {
+		if (strbuf_reserve(sb, CONVERT_READ_SIZE) < 0)
+			return -1;
+		if ((n = read(fd, sb->str + sb->len, CONVERT_READ_SIZE)) < 0) {
+			perror("read");
+			return -1;
+		}
+		if (!n)
+			return 0;
+		sb->len += n;
+		sb->str[sb->len] = '\0';
+	}
+}
+
+/* Through the grammar, whole: the parse tree of each output */
+static int convert_tree(strbuf_t *in, strbuf_t *out, mi_format_t fmt)
+{
+	YY_BUFFER_STATE scanner_state;
+	gdbmi_output_t *o;
+	int ret = 0;
+
+	scanner_state = yy_scan_string(in->str);
+	yyparse();
+	yy_delete_buffer(scanner_state);
+	if (!gdbmi_out_ptr) {
+		fprintf(stderr, "Partial or wrong gdbmi output\n");
+		return -1;
+	}
+	for (o = gdbmi_out_ptr; o && ret >= 0; o = o->next) {
+		mi_serialize_output(out, o, fmt);
+		if (out->len >= CONVERT_FLUSH_SIZE || !o->next) {
+			ret = write_all(1, out->str, out->len);
+			strbuf_reset(out);
+		}
+	}
+	destroy_gdbmi_output();
+	gdbmi_out_ptr = NULL;
+
+	return ret;
+}
+
+/*
+ * Straight from the text, as it is read: each output, up to a prompt,
+ * is serialized once its prompt has come, and what is serialized is
+ * written in batches.
+ */
+static int convert_raw(int fd, strbuf_t *in, strbuf_t *out, mi_format_t fmt)
+{
+	int n, done = 0;
+
+	while (!done) {
+		if (strbuf_reserve(in, CONVERT_READ_SIZE) < 0)
+			return -1;
+		if ((n = read(fd, in->str + in->len, CONVERT_READ_SIZE)) < 0) {
+			perror("read");
+			return -1;
+		}
+		in->len += n;
+		done = !n;
+		if ((n = mi_serialize_text(out, in->str, in->len, fmt)) < 0)
+			return -1;
+		/* What is left has no prompt yet */
+		if (done && n < in->len)
+			mi_serialize_raw(out, in->str + n, in->len - n, fmt);
+		else if (n) {
+			memmove(in->str, in->str + n, in->len - n);
+			in->len -= n;
+		}
+		if (out->len >= CONVERT_FLUSH_SIZE || done) {
+			if (write_all(1, out->str, out->len) < 0)
+				return -1;
+			strbuf_reset(out);
+		}
+	}
+
+	return 0;
+}
+
+static int convert(mi_format_t fmt, int use_tree, const char *path)
+{
+	strbuf_t in = { 0 }, out = { 0 };
+	int fd = 0, ret;
+
+	if (path && (fd = open(path, O_RDONLY)) < 0) {
+		perror(path);
+		return -1;
+	}
+	if (use_tree) {
+		ret = read_all(fd, &in);
+		if (!ret)
+			ret = convert_tree(&in, &out, fmt);
+	}
+	else
+		ret = convert_raw(fd, &in, &out, fmt);
+	if (fd)
+		close(fd);
+	strbuf_free(&in);
+	strbuf_free(&out);
+
+	return ret;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: parser -m|-k [-s]\n");
+	fprintf(stderr, "       parser -c json|bin [-t] [-j JOBS] [PATH...]\n");
+	fprintf(stderr, "-m means from memory\n");
+	fprintf(stderr, "-k means from stdin\n");
+	fprintf(stderr, "-s prints memory statistics at the end\n");
+	fprintf(stderr, "-c converts the files, those of the directories, "
+		"or stdin, to JSON or binary\n");
+	fprintf(stderr, "-t converts one file through the parse tree\n");
+	fprintf(stderr, "-j converts with JOBS workers, one per processor "
+		"by default\n");
+}
+
+/* parser -c json|bin [-t] [-j JOBS] [PATH...] */
+static int convert_main(int argc, char *argv[])
+{
+	mi_format_t fmt;
+	int i, use_tree = 0, jobs = 0;
+
+	if (!strcmp(argv[2], "json"))
+		fmt = MI_FORMAT_JSON;
+	else if (!strcmp(argv[2], "bin"))
+		fmt = MI_FORMAT_BINARY;
+	else {
+		fprintf(stderr, "Unknown format %s\n", argv[2]);
+		return -1;
+	}
+	for (i = 3; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+		if (!strcmp(argv[i], "-t"))
+			use_tree = 1;
+		else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+			jobs = atoi(argv[++i]);
+		else {
+			usage();
+			return -1;
+		}
+	}
+
+	/* The parser has one tree for all: the whole input, in order */
+	if (use_tree) {
+		if (argc - i > 1) {
+			usage();
+			return -1;
+		}
+		return convert(fmt, 1, i < argc ? argv[i] : NULL) < 0 ? -1 : 0;
+	}
+	if (i == argc)
+		return convert(fmt, 0, NULL) < 0 ? -1 : 0;
+	if (!jobs)
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return mi_batch_convert(argv + i, argc - i, jobs, fmt) ? -1 : 0;
+}
+
 int main(int argc, char *argv[])
 {
-	if (argc != 2) {
+	int show_stats = 0;
+
+	if (argc >= 3 && !strcmp(argv[1], "-c"))
+		return convert_main(argc, argv);
+
+	if (argc != 2 && argc != 3) {
 		fprintf(stderr, "Wrong number of arguments\n");
 		return -1;
 	}
 
+	if (argc == 3) {
+		if (strcmp(argv[2], "-s")) {
+			usage();
+			return -1;
+		}
+		show_stats = 1;
+	}
+
 	if (!strcmp(argv[1], "-m")) {
 		read_from_memory();
-		return 0;
 	}
 	else if (!strcmp(argv[1], "-k")) {
 		read_from_stdin();
-		return 0;
 	}
 	else {
-		fprintf(stderr, "Usage: parser -m|-k\n");
-		fprintf(stderr, "-m means from memory\n");
-		fprintf(stderr, "-k means from stdin\n");
+		usage();
 		return -1;
 	}
 
+	if (show_stats)
+		mi_print_mem_stats();
+
 	return 0;
 }
@@ -57,6 +57,9 @@ extern char *yytext;
 %token TOKEN_RESULT_ERROR	"error"
 %token TOKEN_RESULT_EXIT	"exit"
 %token TOKEN_ASYNC_STOPPED	"stopped"
+%token TOKEN_ASYNC_BKPT_CREATED	"breakpoint-created"
+%token TOKEN_ASYNC_BKPT_MODIFIED	"breakpoint-modified"
+%token TOKEN_ASYNC_BKPT_DELETED	"breakpoint-deleted"
 
 %token <char_ptr> TOKEN_DIGITS
 %token TOKEN_NEWLINE		/* '\n' '\r\n' '\r' */
@@ -108,6 +111,9 @@ result_class:	"done" {$$ = RESULT_DONE;}
 	 |	"exit" {$$ = RESULT_EXIT;}
 ;
 async_class:	"stopped" {$$ = ASYNC_STOPPED;}
+	|	"breakpoint-created" {$$ = ASYNC_BREAKPOINT_CREATED;}
+	|	"breakpoint-modified" {$$ = ASYNC_BREAKPOINT_MODIFIED;}
+	|	"breakpoint-deleted" {$$ = ASYNC_BREAKPOINT_DELETED;}
 ;
 stream_record:	console_stream_output {$$ = create_stream_record(CONSOLE_STREAM, $1);}
 	|	target_stream_output {$$ = create_stream_record(TARGET_STREAM, $1);}
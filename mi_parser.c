@@ -13,27 +13,46 @@ frame_info_t *alloc_frame_info(void)
 		fprintf(stderr, "Cannot allocate memory\n");
 		return NULL;
 	}
+	mi_mem_account(MI_NODE_FRAME_INFO, 1, sizeof(frame_info_t));
 
 	return f;
 }
 
+/* The strings hanging off a frame_info_t */
+static long frame_info_str_bytes(frame_info_t *finfo_ptr)
+{
+	return mi_str_bytes(finfo_ptr->addr) + mi_str_bytes(finfo_ptr->func) +
+	       mi_str_bytes(finfo_ptr->args) + mi_str_bytes(finfo_ptr->file) +
+	       mi_str_bytes(finfo_ptr->fullname) +
+	       mi_str_bytes(finfo_ptr->line) + mi_str_bytes(finfo_ptr->from);
+}
+
+/* Frees the frames it was called from too, if it is in a list */
 void free_frame_info(frame_info_t *finfo_ptr)
 {
-	if (finfo_ptr->addr)
-		free(finfo_ptr->addr);
-	if (finfo_ptr->func)
-		free(finfo_ptr->func);
-	if (finfo_ptr->args)
-		free(finfo_ptr->args);
-	if (finfo_ptr->file)
-		free(finfo_ptr->file);
-	if (finfo_ptr->fullname)
-		free(finfo_ptr->fullname);
-	if (finfo_ptr->line)
-		free(finfo_ptr->line);
-	if (finfo_ptr->from)
-		free(finfo_ptr->from);
-	free(finfo_ptr);
+	frame_info_t *next;
+
+	for (; finfo_ptr; finfo_ptr = next) {
+		next = finfo_ptr->next;
+		mi_mem_account(MI_NODE_FRAME_INFO, -1,
+			       -(long)sizeof(frame_info_t) -
+			       frame_info_str_bytes(finfo_ptr));
+		if (finfo_ptr->addr)
+			free(finfo_ptr->addr);
+		if (finfo_ptr->func)
+			free(finfo_ptr->func);
+		if (finfo_ptr->args)
+			free(finfo_ptr->args);
+		if (finfo_ptr->file)
+			free(finfo_ptr->file);
+		if (finfo_ptr->fullname)
+			free(finfo_ptr->fullname);
+		if (finfo_ptr->line)
+			free(finfo_ptr->line);
+		if (finfo_ptr->from)
+			free(finfo_ptr->from);
+		free(finfo_ptr);
+	}
 }
 
 /*
@@ -145,6 +164,372 @@ char *mi_get_error_result_record(gdbmi_output_t *gdbmi_out_ptr)
 	return NULL;
 }
 
+/*
+ * The cstring value of a result in a done result record, e.g. "42" for
+ * ^done,value="42". NULL if there is not such a result.
+ */
+char *mi_get_done_result(gdbmi_output_t *gdbmi_out_ptr, const char *var)
+{
+	result_record_t *rr = gdbmi_out_ptr->result_rec_ptr;
+	value_t *v;
+
+	if (!rr || rr->rclass != RESULT_DONE)
+		return NULL;
+	if (!(v = mi_lookup_var(rr->result_ptr, var)) || v->vtype != CSTRING)
+		return NULL;
+
+	return mi_get_val_cstr(v);
+}
+
+/* Returns 1 if one of the outputs has a ^running result record */
+int mi_is_running(gdbmi_output_t *gdbmi_out_ptr)
+{
+	gdbmi_output_t *out_cur;
+
+	for (out_cur = gdbmi_out_ptr; out_cur; out_cur = out_cur->next)
+		if (out_cur->result_rec_ptr &&
+		    out_cur->result_rec_ptr->rclass == RESULT_RUNNING)
+			return 1;
+
+	return 0;
+}
+
+/*
+ * The cstring value of a result in an async record, e.g. "2" for
+ * thread-id of *stopped. NULL if there is not such a result.
+ */
+char *mi_get_async_result(async_record_t *async_rec_ptr, const char *var)
+{
+	async_output_t *aout = async_rec_ptr->async_out_ptr;
+	value_t *v;
+
+	if (!(v = mi_lookup_var(aout->result_ptr, var)) || v->vtype != CSTRING)
+		return NULL;
+
+	return mi_get_val_cstr(v);
+}
+
+/* The cstring of a result, NULL if it is missing or not a cstring */
+static char *mi_get_result_cstr(result_t *r)
+{
+	if (!r->val_ptr || r->val_ptr->vtype != CSTRING)
+		return NULL;
+
+	return mi_get_val_cstr(r->val_ptr);
+}
+
+/*
+ * The fields of a variable object, as -var-create gives them at the top
+ * level, -var-list-children in each child={...} and -var-update in each
+ * tuple of changelist=[...].
+ */
+static varobj_info_t *mi_parse_varobj(result_t *r)
+{
+	varobj_info_t *vo;
+	char *str;
+
+	if (!(vo = (varobj_info_t *)calloc(1, sizeof(varobj_info_t)))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return NULL;
+	}
+	vo->in_scope = 1;
+	vo->new_num_children = -1;
+
+	for (; r; r = r->next) {
+		if (!strcmp(r->identifier, "name"))
+			vo->name = mi_get_result_cstr(r);
+		else if (!strcmp(r->identifier, "exp"))
+			vo->exp = mi_get_result_cstr(r);
+		else if (!strcmp(r->identifier, "value"))
+			vo->value = mi_get_result_cstr(r);
+		else if (!strcmp(r->identifier, "type"))
+			vo->type = mi_get_result_cstr(r);
+		else if (!(str = mi_get_result_cstr(r)))
+			continue;
+		else {
+			if (!strcmp(r->identifier, "numchild"))
+				vo->numchild = atoi(str);
+			else if (!strcmp(r->identifier, "new_num_children"))
+				vo->new_num_children = atoi(str);
+			else if (!strcmp(r->identifier, "in_scope"))
+				vo->in_scope = !strcmp(str, "true") ? 1 :
+					       !strcmp(str, "false") ? 0 : -1;
+			else if (!strcmp(r->identifier, "type_changed"))
+				vo->type_changed = !strcmp(str, "true");
+			free(str);
+		}
+	}
+	if (!vo->name) {
+		free_varobj_info(vo);
+		return NULL;
+	}
+
+	return vo;
+}
+
+/* The variable object -var-create has made, NULL on ^error */
+varobj_info_t *mi_get_varobj(gdbmi_output_t *gdbmi_out_ptr)
+{
+	result_record_t *rr = gdbmi_out_ptr->result_rec_ptr;
+
+	if (!rr || rr->rclass != RESULT_DONE)
+		return NULL;
+
+	return mi_parse_varobj(rr->result_ptr);
+}
+
+/*
+ * The variable objects listed in var of a done result record, in
+ * order. The list is either of tuples, changelist=[{...},{...}], or of
+ * results, children=[child={...},child={...}].
+ */
+varobj_info_t *mi_get_varobj_list(gdbmi_output_t *gdbmi_out_ptr,
+				  const char *var)
+{
+	result_record_t *rr = gdbmi_out_ptr->result_rec_ptr;
+	varobj_info_t *head = NULL, **tail = &head;
+	value_t *v;
+	result_t *r;
+
+	if (!rr || rr->rclass != RESULT_DONE)
+		return NULL;
+	if (!(v = mi_lookup_var(rr->result_ptr, var)) || v->vtype != LIST ||
+	    !v->data.list_ptr)
+		return NULL;
+
+	if (v->data.list_ptr->ltype == VALUE) {
+		for (v = mi_get_val_list_by_value(v); v; v = v->next) {
+			if (v->vtype != TUPLE || !v->data.tuple_ptr)
+				continue;
+			if (*tail = mi_parse_varobj(mi_get_val_tuple(v)))
+				tail = &(*tail)->next;
+		}
+	}
+	else {
+		for (r = mi_get_val_list_by_result(v); r; r = r->next) {
+			v = r->val_ptr;
+			if (v->vtype != TUPLE || !v->data.tuple_ptr)
+				continue;
+			if (*tail = mi_parse_varobj(mi_get_val_tuple(v)))
+				tail = &(*tail)->next;
+		}
+	}
+
+	return head;
+}
+
+void free_varobj_info(varobj_info_t *vo)
+{
+	varobj_info_t *next;
+
+	for (; vo; vo = next) {
+		next = vo->next;
+		free(vo->name);
+		free(vo->exp);
+		free(vo->value);
+		free(vo->type);
+		free(vo);
+	}
+}
+
+/*
+ * A bkpt={...} tuple of -break-insert, -break-list or a breakpoint
+ * notification. A breakpoint with several locations has them in
+ * locations=[{...},{...}], each parsed the same way into locs.
+ */
+static bkpt_info_t *mi_parse_bkpt(result_t *r)
+{
+	bkpt_info_t *bi, **tail;
+	value_t *v;
+	char *str;
+
+	if (!(bi = (bkpt_info_t *)calloc(1, sizeof(bkpt_info_t)))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return NULL;
+	}
+	bi->enabled = 1;
+
+	for (; r; r = r->next) {
+		v = r->val_ptr;
+		if (!strcmp(r->identifier, "locations")) {
+			if (v->vtype != LIST || !v->data.list_ptr ||
+			    v->data.list_ptr->ltype != VALUE)
+				continue;
+			tail = &bi->locs;
+			for (v = mi_get_val_list_by_value(v); v; v = v->next) {
+				if (v->vtype != TUPLE || !v->data.tuple_ptr)
+					continue;
+				if (*tail = mi_parse_bkpt(mi_get_val_tuple(v)))
+					tail = &(*tail)->next;
+			}
+			continue;
+		}
+		if (!(str = mi_get_result_cstr(r)))
+			continue;
+		if (!strcmp(r->identifier, "number"))
+			bi->number = atoi(str);
+		else if (!strcmp(r->identifier, "enabled"))
+			bi->enabled = *str == 'y';
+		else if (!strcmp(r->identifier, "disp"))
+			bi->temporary = !strcmp(str, "del");
+		else if (!strcmp(r->identifier, "line"))
+			bi->line = atoi(str);
+		else if (!strcmp(r->identifier, "times"))
+			bi->times = atoi(str);
+		else if (!strcmp(r->identifier, "type") && !bi->type) {
+			bi->type = str;
+			continue;
+		}
+		else if (!strcmp(r->identifier, "addr") && !bi->addr) {
+			bi->addr = str;
+			continue;
+		}
+		else if (!strcmp(r->identifier, "func") && !bi->func) {
+			bi->func = str;
+			continue;
+		}
+		else if (!strcmp(r->identifier, "cond") && !bi->cond) {
+			bi->cond = str;
+			continue;
+		}
+		/* The full name is preferred, file is what is left */
+		else if (!strcmp(r->identifier, "fullname")) {
+			free(bi->file);
+			bi->file = str;
+			continue;
+		}
+		else if (!strcmp(r->identifier, "file") && !bi->file) {
+			bi->file = str;
+			continue;
+		}
+		else if ((!strcmp(r->identifier, "original-location") ||
+			  !strcmp(r->identifier, "what")) && !bi->what) {
+			bi->what = str;
+			continue;
+		}
+		free(str);
+	}
+
+	return bi;
+}
+
+static bkpt_info_t *mi_lookup_bkpt(result_t *rlist)
+{
+	value_t *v;
+
+	if (!(v = mi_lookup_var(rlist, "bkpt")) || v->vtype != TUPLE ||
+	    !v->data.tuple_ptr)
+		return NULL;
+
+	return mi_parse_bkpt(mi_get_val_tuple(v));
+}
+
+/* A =breakpoint-* notification, NULL for the other async records */
+static bkpt_info_t *mi_parse_bkpt_notify(async_record_t *ar)
+{
+	bkpt_info_t *bi;
+	char *str;
+
+	if (ar->atype != NOTIFY_ASYNC)
+		return NULL;
+
+	switch (ar->async_out_ptr->aclass) {
+	case ASYNC_BREAKPOINT_CREATED:
+	case ASYNC_BREAKPOINT_MODIFIED:
+		return mi_lookup_bkpt(ar->async_out_ptr->result_ptr);
+	case ASYNC_BREAKPOINT_DELETED:
+		if (!(str = mi_get_async_result(ar, "id")))
+			return NULL;
+		if (bi = (bkpt_info_t *)calloc(1, sizeof(bkpt_info_t))) {
+			bi->number = atoi(str);
+			bi->deleted = 1;
+		}
+		else
+			fprintf(stderr, "Cannot allocate memory\n");
+		free(str);
+		return bi;
+	default:
+		return NULL;
+	}
+}
+
+/*
+ * What a reply tells about breakpoints, in order: the notifications,
+ * =breakpoint-created etc., and the bkpt={...} of ^done, which is
+ * what -break-insert answers instead of a notification. A deleted
+ * breakpoint has only its number and deleted set.
+ */
+bkpt_info_t *mi_get_bkpt_changes(gdbmi_output_t *gdbmi_out_ptr)
+{
+	bkpt_info_t *head = NULL, **tail = &head;
+	gdbmi_output_t *out_cur;
+	oob_record_t *oob;
+	result_record_t *rr;
+
+	for (out_cur = gdbmi_out_ptr; out_cur; out_cur = out_cur->next) {
+		for (oob = out_cur->oob_rec_ptr; oob; oob = oob->next) {
+			if (oob->rtype == ASYNC_RECORD &&
+			    (*tail = mi_parse_bkpt_notify(oob->r.async_rec_ptr)))
+				tail = &(*tail)->next;
+		}
+		rr = out_cur->result_rec_ptr;
+		if (rr && rr->rclass == RESULT_DONE &&
+		    (*tail = mi_lookup_bkpt(rr->result_ptr)))
+			tail = &(*tail)->next;
+	}
+
+	return head;
+}
+
+/*
+ * The breakpoints of -break-list, in the body of the table:
+ * ^done,BreakpointTable={nr_rows="2",hdr=[...],body=[bkpt={...},...]}
+ */
+bkpt_info_t *mi_get_bkpt_table(gdbmi_output_t *gdbmi_out_ptr)
+{
+	result_record_t *rr = gdbmi_out_ptr->result_rec_ptr;
+	bkpt_info_t *head = NULL, **tail = &head;
+	value_t *v;
+	result_t *r;
+
+	if (!rr || rr->rclass != RESULT_DONE)
+		return NULL;
+	if (!(v = mi_lookup_var(rr->result_ptr, "BreakpointTable")) ||
+	    v->vtype != TUPLE || !v->data.tuple_ptr)
+		return NULL;
+	if (!(v = mi_lookup_var(mi_get_val_tuple(v), "body")) ||
+	    v->vtype != LIST || !v->data.list_ptr ||
+	    v->data.list_ptr->ltype != RESULT)
+		return NULL;
+
+	for (r = mi_get_val_list_by_result(v); r; r = r->next) {
+		v = r->val_ptr;
+		if (v->vtype != TUPLE || !v->data.tuple_ptr)
+			continue;
+		if (*tail = mi_parse_bkpt(mi_get_val_tuple(v)))
+			tail = &(*tail)->next;
+	}
+
+	return head;
+}
+
+void free_bkpt_info(bkpt_info_t *bi)
+{
+	bkpt_info_t *next;
+
+	for (; bi; bi = next) {
+		next = bi->next;
+		free_bkpt_info(bi->locs);
+		free(bi->type);
+		free(bi->addr);
+		free(bi->func);
+		free(bi->file);
+		free(bi->cond);
+		free(bi->what);
+		free(bi);
+	}
+}
+
 /* For debugging purposes */
 void mi_print_frame_info(frame_info_t *finfo_ptr)
 {
@@ -171,6 +556,40 @@ void mi_print_frame_info(frame_info_t *finfo_ptr)
 	logger(str, strlen(str), 0);
 }
 
+/* The fields of a frame={...} tuple */
+static frame_info_t *mi_parse_frame_tuple(result_t *r)
+{
+	frame_info_t *finfo_ptr;
+	char *str;
+
+	if (!(finfo_ptr = alloc_frame_info()))
+		return NULL;
+
+	while (r) {
+		if (!strcmp(r->identifier, "addr"))
+			finfo_ptr->addr = mi_get_val_cstr(r->val_ptr);
+		if (!strcmp(r->identifier, "func"))
+			finfo_ptr->func = mi_get_val_cstr(r->val_ptr);
+		if (!strcmp(r->identifier, "file"))
+			finfo_ptr->file = mi_get_val_cstr(r->val_ptr);
+		if (!strcmp(r->identifier, "fullname"))
+			finfo_ptr->fullname = mi_get_val_cstr(r->val_ptr);
+		if (!strcmp(r->identifier, "line"))
+			finfo_ptr->line = mi_get_val_cstr(r->val_ptr);
+		if (!strcmp(r->identifier, "from"))
+			finfo_ptr->from = mi_get_val_cstr(r->val_ptr);
+		if (!strcmp(r->identifier, "level") &&
+		    (str = mi_get_result_cstr(r))) {
+			finfo_ptr->level = atoi(str);
+			free(str);
+		}
+		r = r->next;
+	}
+	mi_mem_account(MI_NODE_FRAME_INFO, 0, frame_info_str_bytes(finfo_ptr));
+
+	return finfo_ptr;
+}
+
 /*
  * For a given result_list, it finds the frame variable and after getting
  * its value, fills in the frame structure.
@@ -178,8 +597,6 @@ void mi_print_frame_info(frame_info_t *finfo_ptr)
 static frame_info_t *mi_parse_frame(result_t *rlist)
 {
 	value_t *v;
-	result_t *r;
-	frame_info_t *finfo_ptr;
 
 	/* Argument validity */
 	if (!rlist)
@@ -194,25 +611,95 @@ static frame_info_t *mi_parse_frame(result_t *rlist)
 	 * In the below line, we are getting the head of the result list
 	 * in that tuple.
 	 */
-	r = mi_get_val_tuple(v);
-	if (!(finfo_ptr = alloc_frame_info()))
+	return mi_parse_frame_tuple(mi_get_val_tuple(v));
+}
+
+/*
+ * The frames listed in var of a done result record, innermost first:
+ * stack=[frame={level="0",...},frame={level="1",...}] of
+ * -stack-list-frames.
+ */
+frame_info_t *mi_get_frame_list(gdbmi_output_t *gdbmi_out_ptr,
+				const char *var)
+{
+	result_record_t *rr = gdbmi_out_ptr->result_rec_ptr;
+	frame_info_t *head = NULL, **tail = &head;
+	value_t *v;
+	result_t *r;
+
+	if (!rr || rr->rclass != RESULT_DONE)
+		return NULL;
+	if (!(v = mi_lookup_var(rr->result_ptr, var)) || v->vtype != LIST ||
+	    !v->data.list_ptr || v->data.list_ptr->ltype != RESULT)
 		return NULL;
 
-	while (r) {
-		if (!strcmp(r->identifier, "addr"))
-			finfo_ptr->addr = mi_get_val_cstr(r->val_ptr);
-		if (!strcmp(r->identifier, "func"))
-			finfo_ptr->func = mi_get_val_cstr(r->val_ptr);
-		if (!strcmp(r->identifier, "file"))
-			finfo_ptr->file = mi_get_val_cstr(r->val_ptr);
-		if (!strcmp(r->identifier, "fullname"))
-			finfo_ptr->fullname = mi_get_val_cstr(r->val_ptr);
-		if (!strcmp(r->identifier, "line"))
-			finfo_ptr->line = mi_get_val_cstr(r->val_ptr);
-		r = r->next;
+	for (r = mi_get_val_list_by_result(v); r; r = r->next) {
+		v = r->val_ptr;
+		if (strcmp(r->identifier, "frame") || v->vtype != TUPLE ||
+		    !v->data.tuple_ptr)
+			continue;
+		if (*tail = mi_parse_frame_tuple(mi_get_val_tuple(v)))
+			tail = &(*tail)->next;
 	}
 
-	return finfo_ptr;
+	return head;
+}
+
+/*
+ * The threads of -thread-info, in order:
+ * ^done,threads=[{id="1",target-id="LWP 42",name="prog",...},...]
+ */
+thread_info_t *mi_get_thread_list(gdbmi_output_t *gdbmi_out_ptr)
+{
+	result_record_t *rr = gdbmi_out_ptr->result_rec_ptr;
+	thread_info_t *head = NULL, **tail = &head, *ti;
+	value_t *v;
+	result_t *r;
+
+	if (!rr || rr->rclass != RESULT_DONE)
+		return NULL;
+	if (!(v = mi_lookup_var(rr->result_ptr, "threads")) ||
+	    v->vtype != LIST || !v->data.list_ptr ||
+	    v->data.list_ptr->ltype != VALUE)
+		return NULL;
+
+	for (v = mi_get_val_list_by_value(v); v; v = v->next) {
+		if (v->vtype != TUPLE || !v->data.tuple_ptr)
+			continue;
+		if (!(ti = (thread_info_t *)calloc(1, sizeof(thread_info_t)))) {
+			fprintf(stderr, "Cannot allocate memory\n");
+			break;
+		}
+		for (r = mi_get_val_tuple(v); r; r = r->next) {
+			if (!strcmp(r->identifier, "id"))
+				ti->id = mi_get_result_cstr(r);
+			else if (!strcmp(r->identifier, "target-id"))
+				ti->target_id = mi_get_result_cstr(r);
+			else if (!strcmp(r->identifier, "name"))
+				ti->name = mi_get_result_cstr(r);
+		}
+		if (!ti->id) {
+			free_thread_info(ti);
+			continue;
+		}
+		*tail = ti;
+		tail = &ti->next;
+	}
+
+	return head;
+}
+
+void free_thread_info(thread_info_t *ti)
+{
+	thread_info_t *next;
+
+	for (; ti; ti = next) {
+		next = ti->next;
+		free(ti->id);
+		free(ti->target_id);
+		free(ti->name);
+		free(ti);
+	}
 }
 
 /*
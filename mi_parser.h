@@ -13,16 +13,70 @@ typedef struct frame_info {
 	char *fullname;
 	char *line;
 	char *from;
+	struct frame_info *next;	/* the frame it was called from */
 } frame_info_t;
 
+/* A thread, as -thread-info lists it */
+typedef struct thread_info {
+	char *id;
+	char *target_id;	/* "Thread 0x7ffff7d8a740 (LWP 4242)" */
+	char *name;
+	struct thread_info *next;
+} thread_info_t;
+
+/* A gdb/mi variable object, or a change to one */
+typedef struct varobj_info {
+	char *name;		/* var1, var1.next */
+	char *exp;
+	char *value;
+	char *type;
+	int numchild;
+	int in_scope;		/* 1, 0, or -1 if it is invalid */
+	int type_changed;
+	int new_num_children;	/* -1 if it has not changed */
+	struct varobj_info *next;
+} varobj_info_t;
+
+/* A breakpoint, or one location of a breakpoint with several */
+typedef struct bkpt_info {
+	int number;
+	char *type;		/* breakpoint, hw watchpoint, ... */
+	int temporary;
+	int enabled;
+	char *addr;
+	char *func;
+	char *file;		/* the full name if gdb knows it */
+	int line;
+	char *cond;
+	int times;
+	char *what;		/* original location, or watched expression */
+	int deleted;		/* only number is set then */
+	struct bkpt_info *locs;
+	struct bkpt_info *next;
+} bkpt_info_t;
+
 /* Function prototypes */
 char *mi_get_error_result_record(gdbmi_output_t *gdbmi_out_ptr);
+char *mi_get_done_result(gdbmi_output_t *gdbmi_out_ptr, const char *var);
+int mi_is_running(gdbmi_output_t *gdbmi_out_ptr);
 
 void mi_print_console_stream(gdbmi_output_t *gdbmi_out_ptr);
 
 async_record_t *mi_get_exec_async_record(gdbmi_output_t *gdbmi_out_ptr);
 frame_info_t *mi_get_frame(async_record_t *async_rec_ptr);
+frame_info_t *mi_get_frame_list(gdbmi_output_t *gdbmi_out_ptr,
+				const char *var);
+thread_info_t *mi_get_thread_list(gdbmi_output_t *gdbmi_out_ptr);
+void free_thread_info(thread_info_t *ti);
+char *mi_get_async_result(async_record_t *async_rec_ptr, const char *var);
 void mi_print_frame_info(frame_info_t *finfo_ptr);
+varobj_info_t *mi_get_varobj(gdbmi_output_t *gdbmi_out_ptr);
+varobj_info_t *mi_get_varobj_list(gdbmi_output_t *gdbmi_out_ptr,
+				  const char *var);
+void free_varobj_info(varobj_info_t *vo);
+bkpt_info_t *mi_get_bkpt_changes(gdbmi_output_t *gdbmi_out_ptr);
+bkpt_info_t *mi_get_bkpt_table(gdbmi_output_t *gdbmi_out_ptr);
+void free_bkpt_info(bkpt_info_t *bi);
 frame_info_t *alloc_frame_info(void);
 void free_frame_info(frame_info_t *finfo_ptr);
 
@@ -1,7 +1,104 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "mi_parsetree.h"
 
+gdbmi_output_t *gdbmi_out_ptr;
+
+/* Memory accounting of parse tree nodes and frame information */
+static mi_mem_stats_t mi_mem_stats;
+
+static const char *mi_node_names[MI_NODE_TYPE_MAX] = {
+	"gdbmi_output",
+	"oob_record",
+	"stream_record",
+	"async_record",
+	"async_output",
+	"result_record",
+	"result",
+	"value",
+	"tuple",
+	"list",
+	"frame_info"
+};
+
+/*
+ * Every create_* and destroy_* pair reports here. nodes and bytes are
+ * negative when a node is freed. The strings strdup'ed by the grammar
+ * are charged to the node owning them.
+ */
+void mi_mem_account(mi_node_type_t ntype, int nodes, long bytes)
+{
+	mi_mem_stats_t *m = &mi_mem_stats;
+
+	m->nodes[ntype] += nodes;
+	m->bytes[ntype] += bytes;
+	if (nodes > 0)
+		m->total_nodes[ntype] += nodes;
+	if (bytes > 0)
+		m->total_bytes[ntype] += bytes;
+
+	m->live_nodes += nodes;
+	m->live_bytes += bytes;
+	if (m->live_nodes > m->peak_nodes)
+		m->peak_nodes = m->live_nodes;
+	if (m->live_bytes > m->peak_bytes)
+		m->peak_bytes = m->live_bytes;
+}
+
+long mi_str_bytes(const char *str)
+{
+	return str ? strlen(str) + 1 : 0;
+}
+
+const mi_mem_stats_t *mi_get_mem_stats(void)
+{
+	return &mi_mem_stats;
+}
+
+/*
+ * Called after the whole tree is destroyed. Any parse tree node still
+ * alive at that point can not be reached anymore, e.g. the partial trees
+ * left behind by a syntax error. They are counted once as leaks and
+ * taken out of the live counters.
+ */
+static void mi_mem_check_leaks(void)
+{
+	mi_mem_stats_t *m = &mi_mem_stats;
+	int i;
+
+	m->leak_checks++;
+	for (i = 0; i < MI_NODE_TYPE_MAX; i++) {
+		if (i == MI_NODE_FRAME_INFO || !m->nodes[i])
+			continue;
+		m->leaked_nodes += m->nodes[i];
+		m->leaked_bytes += m->bytes[i];
+		m->live_nodes -= m->nodes[i];
+		m->live_bytes -= m->bytes[i];
+		m->nodes[i] = 0;
+		m->bytes[i] = 0;
+	}
+}
+
+void mi_print_mem_stats(void)
+{
+	mi_mem_stats_t *m = &mi_mem_stats;
+	int i;
+
+	printf("%-14s %10s %12s %12s %14s\n", "type", "live",
+	       "live bytes", "allocated", "alloc bytes");
+	for (i = 0; i < MI_NODE_TYPE_MAX; i++)
+		printf("%-14s %10ld %12ld %12ld %14ld\n", mi_node_names[i],
+		       m->nodes[i], m->bytes[i], m->total_nodes[i],
+		       m->total_bytes[i]);
+	printf("live nodes: %ld, peak nodes: %ld\n", m->live_nodes,
+	       m->peak_nodes);
+	printf("live bytes: %ld, peak bytes: %ld\n", m->live_bytes,
+	       m->peak_bytes);
+	printf("leaks: %ld nodes, %ld bytes in %ld checks\n",
+	       m->leaked_nodes, m->leaked_bytes, m->leak_checks);
+}
+
 list_t *create_list(list_type_t ltype, void *data)
 {
 	list_t *list_ptr;
@@ -10,6 +107,7 @@ list_t *create_list(list_type_t ltype, void *data)
 		fprintf(stderr, "Cannot allocate memory\n");
 		return NULL;
 	}
+	mi_mem_account(MI_NODE_LIST, 1, sizeof(list_t));
 
 	list_ptr->ltype = ltype;
 	switch (ltype) {
@@ -32,6 +130,7 @@ tuple_t *create_tuple(result_t *result_ptr)
 		fprintf(stderr, "Cannot allocate memory\n");
 		return NULL;
 	}
+	mi_mem_account(MI_NODE_TUPLE, 1, sizeof(tuple_t));
 
 	tuple_ptr->result_ptr = result_ptr;
 
@@ -47,10 +146,13 @@ value_t *create_value(value_type_t vtype, void *data)
 		return NULL;
 	}
 
+	mi_mem_account(MI_NODE_VALUE, 1, sizeof(value_t));
+
 	val_ptr->vtype = vtype;
 	switch (vtype) {
 	case CSTRING:
 		val_ptr->data.cstr = (char *)data;
+		mi_mem_account(MI_NODE_VALUE, 0, mi_str_bytes(data));
 		break;
 	case TUPLE:
 		val_ptr->data.tuple_ptr = (tuple_t *)data;
@@ -72,6 +174,9 @@ result_t *create_result(char *identifier, value_t *val_ptr)
 		return NULL;
 	}
 
+	mi_mem_account(MI_NODE_RESULT, 1,
+		       sizeof(result_t) + mi_str_bytes(identifier));
+
 	res->identifier = identifier;
 	res->val_ptr = val_ptr;
 
@@ -113,6 +218,8 @@ async_record_t *create_async_record(async_type_t atype, char *token,
 		fprintf(stderr, "Cannot allocate memory\n");
 		return NULL;
 	}
+	mi_mem_account(MI_NODE_ASYNC_RECORD, 1,
+		       sizeof(async_record_t) + mi_str_bytes(token));
 	async_rec_ptr->atype = atype;
 	async_rec_ptr->token = token;
 	async_rec_ptr->async_out_ptr = async_out_ptr;
@@ -129,6 +236,8 @@ stream_record_t *create_stream_record(stream_type_t stype, char *str)
 		fprintf(stderr, "Cannot allocate memory\n");
 		return NULL;
 	}
+	mi_mem_account(MI_NODE_STREAM_RECORD, 1,
+		       sizeof(stream_record_t) + mi_str_bytes(str));
 	stream_rec_ptr->stype = stype;
 	stream_rec_ptr->cstr = str;
 
@@ -144,6 +253,7 @@ async_output_t *create_async_output(async_class_t aclass, result_t *result_ptr)
 		fprintf(stderr, "Cannot allocate memory\n");
 		return NULL;
 	}
+	mi_mem_account(MI_NODE_ASYNC_OUTPUT, 1, sizeof(async_output_t));
 	ao->aclass = aclass;
 	ao->result_ptr = result_ptr;
 
@@ -160,6 +270,8 @@ result_record_t *create_result_record(char *token, result_class_t rclass,
 		fprintf(stderr, "Cannot allocate memory\n");
 		return NULL;
 	}
+	mi_mem_account(MI_NODE_RESULT_RECORD, 1,
+		       sizeof(result_record_t) + mi_str_bytes(token));
 	rr->token = token;
 	rr->rclass = rclass;
 	rr->result_ptr = result_ptr;
@@ -190,6 +302,8 @@ oob_record_t *create_oob_record(record_type_t rtype, void *data)
 		return NULL;
 	}
 
+	mi_mem_account(MI_NODE_OOB_RECORD, 1, sizeof(oob_record_t));
+
 	if (rtype == STREAM_RECORD)
 		rec->r.stream_rec_ptr = (stream_record_t *)data;
 	else if (rtype == ASYNC_RECORD)
@@ -221,6 +335,8 @@ gdbmi_output_t *create_gdbmi_output(oob_record_t *oob_rec_ptr,
 		return NULL;
 	}
 
+	mi_mem_account(MI_NODE_GDBMI_OUTPUT, 1, sizeof(gdbmi_output_t));
+
 	go->oob_rec_ptr = oob_rec_ptr;
 	go->result_rec_ptr = result_rec_ptr;
 
@@ -245,6 +361,7 @@ void destroy_list(list_t *list_ptr)
 			}
 			break;
 		}
+		mi_mem_account(MI_NODE_LIST, -1, -(long)sizeof(list_t));
 		free(list_ptr);
 	}
 }
@@ -282,6 +399,7 @@ void destroy_tuple(tuple_t *tuple_ptr)
 	/* If it is not empty */
 	if (tuple_ptr) {
 		destroy_result_list(tuple_ptr->result_ptr);
+		mi_mem_account(MI_NODE_TUPLE, -1, -(long)sizeof(tuple_t));
 		free(tuple_ptr);
 	}
 }
@@ -303,6 +421,8 @@ void destroy_value(value_t *value_ptr)
 {
 	switch (value_ptr->vtype) {
 	case CSTRING:
+		mi_mem_account(MI_NODE_VALUE, 0,
+			       -mi_str_bytes(value_ptr->data.cstr));
 		free(value_ptr->data.cstr);
 		break;
 	case TUPLE:
@@ -312,6 +432,7 @@ void destroy_value(value_t *value_ptr)
 		destroy_list(value_ptr->data.list_ptr);
 		break;
 	}
+	mi_mem_account(MI_NODE_VALUE, -1, -(long)sizeof(value_t));
 	free(value_ptr);
 }
 
@@ -355,6 +476,8 @@ void print_value_list(value_t *value_ptr)
 
 void destroy_result(result_t *result_ptr)
 {
+	mi_mem_account(MI_NODE_RESULT, -1, -(long)sizeof(result_t) -
+		       mi_str_bytes(result_ptr->identifier));
 	free(result_ptr->identifier);
 	destroy_value(result_ptr->val_ptr);
 	free(result_ptr);
@@ -393,6 +516,7 @@ void print_result_list(result_t *result_ptr)
 void destroy_async_output(async_output_t *async_out_ptr)
 {
 	destroy_result_list(async_out_ptr->result_ptr);
+	mi_mem_account(MI_NODE_ASYNC_OUTPUT, -1, -(long)sizeof(async_output_t));
 	free(async_out_ptr);
 }
 
@@ -402,6 +526,15 @@ void print_async_output(async_output_t *async_out_ptr)
 	case ASYNC_STOPPED:
 		printf("stopped");
 		break;
+	case ASYNC_BREAKPOINT_CREATED:
+		printf("breakpoint-created");
+		break;
+	case ASYNC_BREAKPOINT_MODIFIED:
+		printf("breakpoint-modified");
+		break;
+	case ASYNC_BREAKPOINT_DELETED:
+		printf("breakpoint-deleted");
+		break;
 	}
 	print_result_list(async_out_ptr->result_ptr);
 	putchar('\n');
@@ -409,6 +542,9 @@ void print_async_output(async_output_t *async_out_ptr)
 
 void destroy_async_record(async_record_t *async_rec_ptr)
 {
+	mi_mem_account(MI_NODE_ASYNC_RECORD, -1,
+		       -(long)sizeof(async_record_t) -
+		       mi_str_bytes(async_rec_ptr->token));
 	if (async_rec_ptr->token)
 		free(async_rec_ptr->token);
 	destroy_async_output(async_rec_ptr->async_out_ptr);
@@ -430,6 +566,9 @@ void print_async_record(async_record_t *async_rec_ptr)
 
 void destroy_stream_record(stream_record_t *stream_rec_ptr)
 {
+	mi_mem_account(MI_NODE_STREAM_RECORD, -1,
+		       -(long)sizeof(stream_record_t) -
+		       mi_str_bytes(stream_rec_ptr->cstr));
 	free(stream_rec_ptr->cstr);
 	free(stream_rec_ptr);
 }
@@ -447,6 +586,9 @@ void print_stream_record(stream_record_t *stream_rec_ptr)
 void destroy_result_record(result_record_t *result_rec_ptr)
 {
 	if (result_rec_ptr) {
+		mi_mem_account(MI_NODE_RESULT_RECORD, -1,
+			       -(long)sizeof(result_record_t) -
+			       mi_str_bytes(result_rec_ptr->token));
 		if (result_rec_ptr->token)
 			free(result_rec_ptr->token);
 		destroy_result_list(result_rec_ptr->result_ptr);
@@ -492,6 +634,7 @@ void destroy_oob_record(oob_record_t *oob_rec_ptr)
 			destroy_stream_record(cur->r.stream_rec_ptr);
 		else if (cur->rtype == ASYNC_RECORD)
 			destroy_async_record(cur->r.async_rec_ptr);
+		mi_mem_account(MI_NODE_OOB_RECORD, -1, -(long)sizeof(oob_record_t));
 		prev = cur;
 		cur = cur->next;
 		free(prev);
@@ -520,11 +663,14 @@ void destroy_gdbmi_output(void)
 		do {
 			destroy_oob_record(cur->oob_rec_ptr);
 			destroy_result_record(cur->result_rec_ptr);
+			mi_mem_account(MI_NODE_GDBMI_OUTPUT, -1,
+				       -(long)sizeof(gdbmi_output_t));
 			prev = cur;
 			cur = cur->next;
 			free(prev);
 		} while (cur);
 	}
+	mi_mem_check_leaks();
 }
 
 void print_gdbmi_output(void)
@@ -16,6 +16,9 @@ typedef struct stream_record {
 /* async record messages */
 typedef enum async_class {
 	ASYNC_STOPPED,
+	ASYNC_BREAKPOINT_CREATED,
+	ASYNC_BREAKPOINT_MODIFIED,
+	ASYNC_BREAKPOINT_DELETED,
 } async_class_t;
 
 struct result;
@@ -116,8 +119,38 @@ typedef struct gdbmi_output {
 	struct gdbmi_output *next;
 } gdbmi_output_t;
 
+/* Memory accounting, one slot per node type */
+typedef enum mi_node_type {
+	MI_NODE_GDBMI_OUTPUT,
+	MI_NODE_OOB_RECORD,
+	MI_NODE_STREAM_RECORD,
+	MI_NODE_ASYNC_RECORD,
+	MI_NODE_ASYNC_OUTPUT,
+	MI_NODE_RESULT_RECORD,
+	MI_NODE_RESULT,
+	MI_NODE_VALUE,
+	MI_NODE_TUPLE,
+	MI_NODE_LIST,
+	MI_NODE_FRAME_INFO,
+	MI_NODE_TYPE_MAX
+} mi_node_type_t;
+
+typedef struct mi_mem_stats {
+	long nodes[MI_NODE_TYPE_MAX];		/* live nodes */
+	long bytes[MI_NODE_TYPE_MAX];		/* live bytes */
+	long total_nodes[MI_NODE_TYPE_MAX];	/* allocated since start */
+	long total_bytes[MI_NODE_TYPE_MAX];
+	long live_nodes;
+	long peak_nodes;
+	long live_bytes;
+	long peak_bytes;
+	long leak_checks;
+	long leaked_nodes;
+	long leaked_bytes;
+} mi_mem_stats_t;
+
 /* Global definitions */
-gdbmi_output_t *gdbmi_out_ptr;
+extern gdbmi_output_t *gdbmi_out_ptr;
 
 /* Function declarations */
 list_t *create_list(list_type_t ltype, void *data);
@@ -171,4 +204,9 @@ gdbmi_output_t *append_gdbmi_output(gdbmi_output_t *head, gdbmi_output_t *new);
 void destroy_gdbmi_output(void);
 void print_gdmi_output(void);
 
+void mi_mem_account(mi_node_type_t ntype, int nodes, long bytes);
+long mi_str_bytes(const char *str);
+const mi_mem_stats_t *mi_get_mem_stats(void);
+void mi_print_mem_stats(void);
+
 #endif /* __MI_PARSETREE_H__ */
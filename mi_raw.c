@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <string.h>
+#include "mi_raw.h"
+
+/*
+ * Past the closing quote of the cstring at s, NULL if it is not closed
+ * before end, or before the '\0' if end is NULL.
+ */
+static const char *skip_cstr(const char *s, const char *end)
+{
+	for (s++; (!end || s < end) && *s; s++) {
+		if (*s == '\\' && (!end || s + 1 < end) && s[1])
+			s++;
+		else if (*s == '"')
+			return s + 1;
+	}
+
+	return NULL;
+}
+
+/*
+ * Copies the value of key="..." in rec, up to end, to buf. The key
+ * must follow a ',' or a '{', so that id does not match group-id.
+ * Returns a pointer past the value, to go on from for the next one,
+ * or NULL if there is no such key.
+ */
+const char *mi_raw_field(const char *rec, const char *end, const char *key,
+			 char *buf, int size)
+{
+	int key_len = strlen(key);
+	const char *s;
+	int n = 0;
+
+	for (s = rec; s + key_len + 2 < end; s++) {
+		if (*s == '"') {
+			if (!(s = skip_cstr(s, end)))
+				return NULL;
+			s--;
+			continue;
+		}
+		if ((*s != ',' && *s != '{') || strncmp(s + 1, key, key_len) ||
+		    s[key_len + 1] != '=' || s[key_len + 2] != '"')
+			continue;
+		for (s += key_len + 3; s < end && *s != '"'; s++) {
+			if (*s == '\\' && s + 1 < end)
+				s++;
+			if (n < size - 1)
+				buf[n++] = *s;
+		}
+		buf[n] = '\0';
+		return s < end ? s + 1 : s;
+	}
+
+	return NULL;
+}
+
+/*
+ * Past the {...} or [...] at s, NULL if it is not closed. Braces in the
+ * cstrings do not count: a C++ function such as main::{lambda()#1} has
+ * them in its name, so a frame does not end at the first '}'.
+ */
+const char *mi_raw_end(const char *s)
+{
+	int depth = 0;
+
+	for (; *s; s++) {
+		if (*s == '"') {
+			if (!(s = skip_cstr(s, NULL)))
+				return NULL;
+			s--;
+		}
+		else if (*s == '{' || *s == '[')
+			depth++;
+		else if ((*s == '}' || *s == ']') && !--depth)
+			return s + 1;
+	}
+
+	return NULL;
+}
+
+/* FNV-1a, for the tables keyed by names */
+unsigned int mi_raw_hash(const char *str)
+{
+	unsigned int h = 2166136261u;
+
+	while (*str)
+		h = (h ^ (unsigned char)*str++) * 16777619u;
+
+	return h;
+}
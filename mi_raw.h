@@ -0,0 +1,18 @@
+#ifndef __MI_RAW_H__
+#define __MI_RAW_H__
+
+/*
+ * Reading gdb/mi records as raw text, without a parse tree, for the
+ * replies that come often or big: the notifications of libraries and
+ * threads, pages of frames, the samples of the profiler. Cstrings are
+ * skipped as a whole, so a brace or a key="..." in a value is not taken
+ * for one of the record.
+ */
+
+/* Function prototypes */
+const char *mi_raw_field(const char *rec, const char *end, const char *key,
+			 char *buf, int size);
+const char *mi_raw_end(const char *s);
+unsigned int mi_raw_hash(const char *str);
+
+#endif /* __MI_RAW_H__ */
@@ -0,0 +1,649 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mi_serialize.h"
+
+/* Bytes that do not go into a JSON string as they are */
+static unsigned char json_esc[256];
+static int json_esc_ready;
+/* A string with its escapes undone */
+static strbuf_t scratch;
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static void init_json_esc(void)
+{
+	int c;
+
+	json_esc_ready = 1;
+	for (c = 0; c < 0x20; c++)
+		json_esc[c] = 1;
+	json_esc['"'] = json_esc['\\'] = 1;
+}
+
+static int put_varint(strbuf_t *sb, unsigned long n)
+{
+	char buf[10];
+	int len = 0;
+
+	do {
+		buf[len] = n & 0x7f;
+		if (n >>= 7)
+			buf[len] |= 0x80;
+		len++;
+	} while (n);
+
+	return strbuf_append(sb, buf, len);
+}
+
+/* len bytes as a JSON string, or as a binary one */
+static int put_bytes(strbuf_t *sb, const char *s, int len, mi_format_t fmt)
+{
+	const unsigned char *u = (const unsigned char *)s;
+	char *d;
+	int i;
+
+	if (fmt == MI_FORMAT_BINARY) {
+		if (put_varint(sb, len) < 0)
+			return -1;
+		return strbuf_append(sb, s, len);
+	}
+	if (!json_esc_ready)
+		init_json_esc();
+	if (strbuf_reserve(sb, len * 6 + 2) < 0)
+		return -1;
+	d = sb->str + sb->len;
+	*d++ = '"';
+	for (i = 0; i < len; i++) {
+		if (!json_esc[u[i]]) {
+			*d++ = u[i];
+			continue;
+		}
+		*d++ = '\\';
+		switch (u[i]) {
+		case '"':
+		case '\\':
+			*d++ = u[i];
+			break;
+		case '\n':
+			*d++ = 'n';
+			break;
+		case '\t':
+			*d++ = 't';
+			break;
+		case '\r':
+			*d++ = 'r';
+			break;
+		default:
+			memcpy(d, "u00", 3);
+			d[3] = hex_digits[u[i] >> 4];
+			d[4] = hex_digits[u[i] & 0xf];
+			d += 5;
+		}
+	}
+	*d++ = '"';
+	*d = '\0';
+	sb->len = d - sb->str;
+
+	return 0;
+}
+
+/*
+ * The body of a gdb/mi cstring, between its quotes, with the escapes
+ * undone: \n, \t, \" and the like, and \ooo in octal.
+ */
+static int put_cstr(strbuf_t *sb, const char *s, int len, mi_format_t fmt)
+{
+	const char *end = s + len;
+	char *d;
+	int n;
+
+	if (!memchr(s, '\\', len))
+		return put_bytes(sb, s, len, fmt);
+	strbuf_reset(&scratch);
+	if (strbuf_reserve(&scratch, len) < 0)
+		return -1;
+	for (d = scratch.str; s < end; s++) {
+		if (*s != '\\' || s + 1 == end) {
+			*d++ = *s;
+			continue;
+		}
+		switch (*++s) {
+		case 'n': *d++ = '\n'; break;
+		case 't': *d++ = '\t'; break;
+		case 'r': *d++ = '\r'; break;
+		case 'a': *d++ = '\a'; break;
+		case 'b': *d++ = '\b'; break;
+		case 'f': *d++ = '\f'; break;
+		case 'v': *d++ = '\v'; break;
+		case 'e': *d++ = '\033'; break;
+		default:
+			if (*s < '0' || *s > '7') {
+				*d++ = *s;
+				break;
+			}
+			for (n = 0, len = 0; len < 3 && s < end &&
+			     *s >= '0' && *s <= '7'; len++, s++)
+				n = n * 8 + *s - '0';
+			*d++ = n;
+			s--;
+		}
+	}
+
+	return put_bytes(sb, scratch.str, d - scratch.str, fmt);
+}
+
+/* A key of a tuple or of a list of results */
+static int put_key(strbuf_t *sb, const char *s, int len, mi_format_t fmt)
+{
+	if (put_bytes(sb, s, len, fmt) < 0)
+		return -1;
+
+	return fmt == MI_FORMAT_JSON ? strbuf_putc(sb, ':') : 0;
+}
+
+static const char *record_type(int kind)
+{
+	switch (kind) {
+	case '~':
+		return "console";
+	case '@':
+		return "target";
+	case '&':
+		return "log";
+	case '*':
+		return "exec";
+	case '+':
+		return "status";
+	case '=':
+		return "notify";
+	case '^':
+		return "result";
+	}
+
+	return "text";
+}
+
+static void begin_record(strbuf_t *sb, int kind, int *first,
+			 mi_format_t fmt)
+{
+	if (fmt == MI_FORMAT_BINARY) {
+		strbuf_putc(sb, kind);
+		return;
+	}
+	if (!*first)
+		strbuf_putc(sb, ',');
+	*first = 0;
+	strbuf_printf(sb, "{\"type\":\"%s\"", record_type(kind));
+}
+
+/* The text of a stream record, or of a line that is not gdb/mi */
+static void put_text(strbuf_t *sb, const char *s, int len, int cstr,
+		     mi_format_t fmt)
+{
+	if (fmt == MI_FORMAT_JSON)
+		strbuf_puts(sb, ",\"text\":");
+	if (cstr)
+		put_cstr(sb, s, len, fmt);
+	else
+		put_bytes(sb, s, len, fmt);
+	if (fmt == MI_FORMAT_JSON)
+		strbuf_putc(sb, '}');
+}
+
+/* The token and the class of an async or result record */
+static void put_class(strbuf_t *sb, const char *token, int token_len,
+		      const char *class, int class_len, mi_format_t fmt)
+{
+	if (fmt == MI_FORMAT_BINARY) {
+		put_bytes(sb, token, token_len, fmt);
+		put_bytes(sb, class, class_len, fmt);
+		return;
+	}
+	if (token_len) {
+		strbuf_puts(sb, ",\"token\":");
+		put_bytes(sb, token, token_len, fmt);
+	}
+	strbuf_puts(sb, ",\"class\":");
+	put_bytes(sb, class, class_len, fmt);
+	strbuf_puts(sb, ",\"results\":");
+}
+
+static int begin_doc(strbuf_t *sb, mi_format_t fmt)
+{
+	int start = sb->len;
+
+	if (fmt == MI_FORMAT_BINARY)
+		strbuf_append(sb, "\0\0\0\0", 4);
+	else
+		strbuf_putc(sb, '[');
+
+	return start;
+}
+
+static int end_doc(strbuf_t *sb, int start, mi_format_t fmt)
+{
+	unsigned long len;
+	int i;
+
+	if (fmt == MI_FORMAT_JSON)
+		return strbuf_append(sb, "]\n", 2);
+	if (sb->len < start + 4)
+		return -1;
+	len = sb->len - start - 4;
+	for (i = 0; i < 4; i++, len >>= 8)
+		sb->str[start + i] = len & 0xff;
+
+	return 0;
+}
+
+/* From a parse tree */
+
+static void tree_value(strbuf_t *sb, const value_t *v, mi_format_t fmt);
+
+/* An object of the results, or the pairs of them */
+static void tree_results(strbuf_t *sb, const result_t *r, mi_format_t fmt)
+{
+	if (fmt == MI_FORMAT_JSON)
+		strbuf_putc(sb, '{');
+	for (; r; r = r->next) {
+		put_key(sb, r->identifier, strlen(r->identifier), fmt);
+		tree_value(sb, r->val_ptr, fmt);
+		if (fmt == MI_FORMAT_JSON && r->next)
+			strbuf_putc(sb, ',');
+	}
+	strbuf_putc(sb, fmt == MI_FORMAT_JSON ? '}' : '\0');
+}
+
+static void tree_list(strbuf_t *sb, const list_t *l, mi_format_t fmt)
+{
+	const result_t *r;
+	const value_t *v;
+
+	if (!l) {
+		if (fmt == MI_FORMAT_JSON)
+			strbuf_append(sb, "[]", 2);
+		else
+			strbuf_append(sb, "L", 2);
+		return;
+	}
+	if (fmt == MI_FORMAT_BINARY) {
+		if (l->ltype == RESULT) {
+			strbuf_putc(sb, 'R');
+			tree_results(sb, l->data.result_ptr, fmt);
+			return;
+		}
+		strbuf_putc(sb, 'L');
+		for (v = l->data.value_ptr; v; v = v->next)
+			tree_value(sb, v, fmt);
+		strbuf_append(sb, "", 1);
+		return;
+	}
+
+	strbuf_putc(sb, '[');
+	if (l->ltype == RESULT) {
+		for (r = l->data.result_ptr; r; r = r->next) {
+			strbuf_putc(sb, '{');
+			put_key(sb, r->identifier, strlen(r->identifier), fmt);
+			tree_value(sb, r->val_ptr, fmt);
+			strbuf_putc(sb, '}');
+			if (r->next)
+				strbuf_putc(sb, ',');
+		}
+	}
+	else {
+		for (v = l->data.value_ptr; v; v = v->next) {
+			tree_value(sb, v, fmt);
+			if (v->next)
+				strbuf_putc(sb, ',');
+		}
+	}
+	strbuf_putc(sb, ']');
+}
+
+static void tree_value(strbuf_t *sb, const value_t *v, mi_format_t fmt)
+{
+	const char *s;
+
+	switch (v->vtype) {
+	case CSTRING:
+		if (fmt == MI_FORMAT_BINARY)
+			strbuf_putc(sb, 'S');
+		/* The grammar keeps the quotes */
+		s = v->data.cstr;
+		put_cstr(sb, s + 1, strlen(s) - 2, fmt);
+		break;
+	case TUPLE:
+		if (fmt == MI_FORMAT_BINARY)
+			strbuf_putc(sb, 'T');
+		tree_results(sb, v->data.tuple_ptr ?
+			     v->data.tuple_ptr->result_ptr : NULL, fmt);
+		break;
+	case LIST:
+		tree_list(sb, v->data.list_ptr, fmt);
+		break;
+	}
+}
+
+static const char *async_class_name(async_class_t aclass)
+{
+	switch (aclass) {
+	case ASYNC_STOPPED:
+		return "stopped";
+	case ASYNC_BREAKPOINT_CREATED:
+		return "breakpoint-created";
+	case ASYNC_BREAKPOINT_MODIFIED:
+		return "breakpoint-modified";
+	case ASYNC_BREAKPOINT_DELETED:
+		return "breakpoint-deleted";
+	}
+
+	return "";
+}
+
+static const char *result_class_name(result_class_t rclass)
+{
+	switch (rclass) {
+	case RESULT_DONE:
+		return "done";
+	case RESULT_RUNNING:
+		return "running";
+	case RESULT_CONNECTED:
+		return "connected";
+	case RESULT_ERROR:
+		return "error";
+	case RESULT_EXIT:
+		return "exit";
+	}
+
+	return "";
+}
+
+static void tree_oob(strbuf_t *sb, const oob_record_t *oob, int *first,
+		     mi_format_t fmt)
+{
+	static const char stream_kinds[] = "~@&";
+	static const char async_kinds[] = "*+=";
+	const stream_record_t *sr;
+	const async_record_t *ar;
+	const char *s;
+
+	if (oob->rtype == STREAM_RECORD) {
+		sr = oob->r.stream_rec_ptr;
+		begin_record(sb, stream_kinds[sr->stype], first, fmt);
+		s = sr->cstr;
+		put_text(sb, s + 1, strlen(s) - 2, 1, fmt);
+		return;
+	}
+	ar = oob->r.async_rec_ptr;
+	begin_record(sb, async_kinds[ar->atype], first, fmt);
+	s = async_class_name(ar->async_out_ptr->aclass);
+	put_class(sb, ar->token, ar->token ? strlen(ar->token) : 0, s,
+		  strlen(s), fmt);
+	tree_results(sb, ar->async_out_ptr->result_ptr, fmt);
+	if (fmt == MI_FORMAT_JSON)
+		strbuf_putc(sb, '}');
+}
+
+/* One output of a parse tree, not the ones chained after it */
+int mi_serialize_output(strbuf_t *sb, const gdbmi_output_t *out,
+			mi_format_t fmt)
+{
+	const result_record_t *rr = out->result_rec_ptr;
+	const oob_record_t *oob;
+	const char *s;
+	int start, first = 1;
+
+	start = begin_doc(sb, fmt);
+	for (oob = out->oob_rec_ptr; oob; oob = oob->next)
+		tree_oob(sb, oob, &first, fmt);
+	if (rr) {
+		begin_record(sb, '^', &first, fmt);
+		s = result_class_name(rr->rclass);
+		put_class(sb, rr->token, rr->token ? strlen(rr->token) : 0,
+			  s, strlen(s), fmt);
+		tree_results(sb, rr->result_ptr, fmt);
+		if (fmt == MI_FORMAT_JSON)
+			strbuf_putc(sb, '}');
+	}
+
+	return end_doc(sb, start, fmt);
+}
+
+/* From the raw text, as the grammar reads it */
+
+static int is_ident(int c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+	       (c >= '0' && c <= '9') || c == '_' || c == '-';
+}
+
+/* Past the closing quote of the cstring at p, NULL if it is not closed */
+static const char *scan_cstr(const char *p, const char *end)
+{
+	for (p++; p < end; p++) {
+		if (*p == '\\')
+			p++;
+		else if (*p == '"')
+			return p + 1;
+	}
+
+	return NULL;
+}
+
+static const char *raw_value(strbuf_t *sb, const char *p, const char *end,
+			     mi_format_t fmt);
+
+/*
+ * key=value pairs up to close, '}' or ']', or to the end of the line
+ * if close is 0. In a list they go as one-key objects. Returns what
+ * follows, NULL if the text is not gdb/mi.
+ */
+static const char *raw_pairs(strbuf_t *sb, const char *p, const char *end,
+			     int close, int in_list, mi_format_t fmt)
+{
+	const char *key;
+	int first = 1;
+
+	if (fmt == MI_FORMAT_JSON)
+		strbuf_putc(sb, in_list ? '[' : '{');
+	while (p < end && *p != close) {
+		for (key = p; p < end && is_ident(*p); p++)
+			;
+		if (p == key || p == end || *p != '=')
+			return NULL;
+		if (fmt == MI_FORMAT_JSON) {
+			if (!first)
+				strbuf_putc(sb, ',');
+			if (in_list)
+				strbuf_putc(sb, '{');
+		}
+		put_key(sb, key, p - key, fmt);
+		if (!(p = raw_value(sb, p + 1, end, fmt)))
+			return NULL;
+		if (fmt == MI_FORMAT_JSON && in_list)
+			strbuf_putc(sb, '}');
+		first = 0;
+		if (p == end || *p != ',')
+			break;
+		p++;
+	}
+	if (close) {
+		if (p == end || *p != close)
+			return NULL;
+		p++;
+	}
+	else if (p != end)
+		return NULL;
+	if (fmt == MI_FORMAT_JSON)
+		strbuf_putc(sb, in_list ? ']' : '}');
+	else
+		strbuf_append(sb, "", 1);
+
+	return p;
+}
+
+static const char *raw_value(strbuf_t *sb, const char *p, const char *end,
+			     mi_format_t fmt)
+{
+	const char *q;
+	int first = 1;
+
+	if (p == end)
+		return NULL;
+	switch (*p) {
+	case '"':
+		if (!(q = scan_cstr(p, end)))
+			return NULL;
+		if (fmt == MI_FORMAT_BINARY)
+			strbuf_putc(sb, 'S');
+		put_cstr(sb, p + 1, q - p - 2, fmt);
+		return q;
+	case '{':
+		if (fmt == MI_FORMAT_BINARY)
+			strbuf_putc(sb, 'T');
+		return raw_pairs(sb, p + 1, end, '}', 0, fmt);
+	case '[':
+		break;
+	default:
+		return NULL;
+	}
+
+	/* A list of results */
+	if (++p < end && is_ident(*p)) {
+		if (fmt == MI_FORMAT_BINARY)
+			strbuf_putc(sb, 'R');
+		return raw_pairs(sb, p, end, ']', 1, fmt);
+	}
+	/* Or of values, maybe empty */
+	strbuf_putc(sb, fmt == MI_FORMAT_JSON ? '[' : 'L');
+	while (p < end && *p != ']') {
+		if (fmt == MI_FORMAT_JSON && !first)
+			strbuf_putc(sb, ',');
+		if (!(p = raw_value(sb, p, end, fmt)))
+			return NULL;
+		first = 0;
+		if (p == end || *p != ',')
+			break;
+		p++;
+	}
+	if (p == end || *p != ']')
+		return NULL;
+	if (fmt == MI_FORMAT_JSON)
+		strbuf_putc(sb, ']');
+	else
+		strbuf_append(sb, "", 1);
+
+	return p + 1;
+}
+
+/* One line; -1 if it is not gdb/mi */
+static int raw_record(strbuf_t *sb, const char *p, const char *end,
+		      int *first, mi_format_t fmt)
+{
+	const char *token = p, *class;
+	int kind, token_len;
+
+	while (p < end && *p >= '0' && *p <= '9')
+		p++;
+	token_len = p - token;
+	if (p == end)
+		return -1;
+	switch (kind = *p++) {
+	case '~':
+	case '@':
+	case '&':
+		if (token_len || p == end || *p != '"' ||
+		    scan_cstr(p, end) != end)
+			return -1;
+		begin_record(sb, kind, first, fmt);
+		put_text(sb, p + 1, end - p - 2, 1, fmt);
+		return 0;
+	case '*':
+	case '+':
+	case '=':
+	case '^':
+		break;
+	default:
+		return -1;
+	}
+
+	for (class = p; p < end && is_ident(*p); p++)
+		;
+	if (p == class || (p < end && *p != ','))
+		return -1;
+	begin_record(sb, kind, first, fmt);
+	put_class(sb, token, token_len, class, p - class, fmt);
+	if (p < end)
+		p++;
+	if (!raw_pairs(sb, p, end, 0, 0, fmt))
+		return -1;
+	if (fmt == MI_FORMAT_JSON)
+		strbuf_putc(sb, '}');
+
+	return 0;
+}
+
+/* "(gdb)", with the spaces gdb puts after it */
+int mi_is_prompt(const char *line, int len)
+{
+	if (len < 5 || memcmp(line, "(gdb)", 5))
+		return 0;
+	for (line += 5, len -= 5; len && (*line == ' ' || *line == '\r');
+	     line++, len--)
+		;
+
+	return !len;
+}
+
+/*
+ * One output from its text, the lines up to a prompt; the prompt, if it
+ * is there, is left out. A line that is not gdb/mi, such as the echo of
+ * a command or the program's output, is kept as text.
+ */
+int mi_serialize_raw(strbuf_t *sb, const char *text, int len,
+		     mi_format_t fmt)
+{
+	const char *end = text + len, *eol, *line_end;
+	int start, mark, first = 1, was_first;
+
+	start = begin_doc(sb, fmt);
+	for (; text < end; text = eol + 1) {
+		if (!(eol = memchr(text, '\n', end - text)))
+			eol = end;
+		line_end = eol > text && eol[-1] == '\r' ? eol - 1 : eol;
+		if (line_end == text || mi_is_prompt(text, line_end - text))
+			continue;
+		mark = sb->len;
+		was_first = first;
+		if (raw_record(sb, text, line_end, &first, fmt) < 0) {
+			sb->len = mark;
+			first = was_first;
+			begin_record(sb, 't', &first, fmt);
+			put_text(sb, text, line_end - text, 0, fmt);
+		}
+	}
+
+	return end_doc(sb, start, fmt);
+}
+
+/*
+ * The outputs of text, each up to its prompt. Returns how much of the
+ * text they took: what follows the last prompt is left for the caller.
+ */
+int mi_serialize_text(strbuf_t *sb, const char *text, int len,
+		      mi_format_t fmt)
+{
+	const char *doc, *line, *eol, *end = text + len;
+
+	for (doc = line = text; (eol = memchr(line, '\n', end - line));
+	     line = eol + 1) {
+		if (!mi_is_prompt(line, eol - line))
+			continue;
+		if (mi_serialize_raw(sb, doc, line - doc, fmt) < 0)
+			return -1;
+		doc = eol + 1;
+	}
+
+	return doc - text;
+}
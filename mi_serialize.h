@@ -0,0 +1,46 @@
+#ifndef __MI_SERIALIZE_H__
+#define __MI_SERIALIZE_H__
+
+#include "strbuf.h"
+#include "mi_parsetree.h"
+
+/*
+ * gdb/mi output as JSON or as a compact binary form, one document for
+ * each output up to a "(gdb)" prompt, appended to a buffer the caller
+ * reuses. A document is either written from a parse tree, or scanned
+ * straight from the raw text of the stream without building one; both
+ * give the same bytes.
+ *
+ * JSON: one array of records per line,
+ *
+ *	[{"type":"console","text":"..."},
+ *	 {"type":"result","token":"7","class":"done","results":{...}}]
+ *
+ * where a tuple is an object, a list of values an array and a list of
+ * results, stack=[frame={...},frame={...}], an array of one-key
+ * objects. Lines that are not gdb/mi are kept as {"type":"text"}.
+ *
+ * Binary: a 32-bit little-endian length, then the records. A stream
+ * record or text is its kind ('~', '@', '&' or 't') and a string; an
+ * async or result record is its kind ('*', '+', '=' or '^'), the token
+ * and the class as strings and its results. Results are key and value
+ * pairs ending with a 0 byte. A value is 'S' and a string, 'T' and
+ * results for a tuple, 'R' and results for a list of results, or 'L',
+ * values and a 0 byte. A string is its length as a LEB128 varint, then
+ * its bytes with the C escapes of gdb/mi undone.
+ */
+typedef enum mi_format {
+	MI_FORMAT_JSON,
+	MI_FORMAT_BINARY
+} mi_format_t;
+
+/* Function prototypes */
+int mi_serialize_output(strbuf_t *sb, const gdbmi_output_t *out,
+			mi_format_t fmt);
+int mi_serialize_raw(strbuf_t *sb, const char *text, int len,
+		     mi_format_t fmt);
+int mi_serialize_text(strbuf_t *sb, const char *text, int len,
+		      mi_format_t fmt);
+int mi_is_prompt(const char *line, int len);
+
+#endif /* __MI_SERIALIZE_H__ */
@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "profile.h"
+#include "strbuf.h"
+#include "mi_raw.h"
+
+static prof_stack_t **buckets;
+static int hash_size, stack_count;
+static unsigned long samples, stops;
+static int active, waiting, cancelled;
+static long period_ms, start_ms, end_ms, due_ms;
+static strbuf_t folded;
+
+static long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void free_stacks(void)
+{
+	prof_stack_t *st, *next;
+	int i;
+
+	for (i = 0; i < hash_size; i++) {
+		for (st = buckets[i]; st; st = next) {
+			next = st->hnext;
+			free(st->frames);
+			free(st);
+		}
+	}
+	free(buckets);
+	buckets = NULL;
+	hash_size = stack_count = 0;
+}
+
+int profile_start(int hz, int seconds)
+{
+	free_stacks();
+	samples = stops = 0;
+	active = 1;
+	waiting = cancelled = 0;
+	period_ms = 1000 / hz;
+	start_ms = due_ms = now_ms();
+	end_ms = start_ms + seconds * 1000L;
+
+	return 0;
+}
+
+int profile_active(void)
+{
+	return active;
+}
+
+/* The program runs again, it is stopped a period after the last stop */
+void profile_resumed(void)
+{
+	long now = now_ms();
+
+	due_ms += period_ms;
+	/* Late, e.g. gdb was slow: no burst of stops to catch up */
+	if (due_ms < now)
+		due_ms = now;
+	waiting = 1;
+}
+
+/* Milliseconds until the program is to be stopped, -1 if it is not */
+int profile_timeout(void)
+{
+	long left;
+
+	if (!waiting)
+		return -1;
+	if (cancelled)
+		return 0;
+	left = due_ms - now_ms();
+
+	return left > 0 ? left : 0;
+}
+
+/* 1 once, when the time has come to stop the program, or it is over */
+int profile_sample_due(void)
+{
+	if (!waiting || (!cancelled && due_ms > now_ms()))
+		return 0;
+	waiting = 0;
+	stops++;
+
+	return 1;
+}
+
+int profile_over(void)
+{
+	return cancelled || now_ms() >= end_ms;
+}
+
+void profile_cancel(void)
+{
+	cancelled = 1;
+}
+
+static int grow_buckets(void)
+{
+	prof_stack_t **new_buckets, *st, *next;
+	int new_size = hash_size ? hash_size * 2 : PROF_HASH_MIN;
+	unsigned int h;
+	int i;
+
+	new_buckets = (prof_stack_t **)calloc(new_size,
+					      sizeof(prof_stack_t *));
+	if (!new_buckets) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return -1;
+	}
+	for (i = 0; i < hash_size; i++) {
+		for (st = buckets[i]; st; st = next) {
+			next = st->hnext;
+			h = mi_raw_hash(st->frames) & (new_size - 1);
+			st->hnext = new_buckets[h];
+			new_buckets[h] = st;
+		}
+	}
+	free(buckets);
+	buckets = new_buckets;
+	hash_size = new_size;
+
+	return 0;
+}
+
+static int count_stack(const char *frames)
+{
+	prof_stack_t *st;
+	unsigned int h;
+
+	if (stack_count >= hash_size && grow_buckets() < 0)
+		return -1;
+	h = mi_raw_hash(frames) & (hash_size - 1);
+	for (st = buckets[h]; st; st = st->hnext) {
+		if (!strcmp(st->frames, frames)) {
+			st->count++;
+			return 0;
+		}
+	}
+	if (!(st = (prof_stack_t *)calloc(1, sizeof(prof_stack_t))) ||
+	    !(st->frames = strdup(frames))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		free(st);
+		return -1;
+	}
+	st->count = 1;
+	st->hnext = buckets[h];
+	buckets[h] = st;
+	stack_count++;
+
+	return 0;
+}
+
+/* The value of key="..." between s and end in name, 0 if it is empty */
+static int get_name(const char *s, const char *end, const char *key,
+		    char *name)
+{
+	char *p;
+
+	if (!mi_raw_field(s, end, key, name, PROF_MAX_NAME))
+		return 0;
+	/* ';' and ' ' separate frames and the count */
+	for (p = name; *p; p++)
+		if (*p == ';' || *p == ' ')
+			*p = '_';
+
+	return p - name;
+}
+
+/*
+ * Counts the stack in the reply of -stack-list-frames, read as it is
+ * without a parse tree:
+ *
+ *	^done,stack=[frame={level="0",addr="0x..",func="work",...},...]
+ *
+ * The innermost frame comes first. A frame without a function, in a
+ * library without symbols, is named by its address.
+ */
+int profile_add_stack(const char *reply)
+{
+	const char *frames[PROF_MAX_FRAMES];
+	char name[PROF_MAX_NAME];
+	const char *s, *end;
+	int n = 0;
+
+	if (strncmp(reply, "^done", 5))
+		return -1;
+	for (s = reply; n < PROF_MAX_FRAMES && (s = strstr(s, "frame={"));
+	     s = end) {
+		if (!(end = mi_raw_end(s + 6)))
+			break;
+		frames[n++] = s + 6;
+	}
+	if (!n)
+		return -1;
+
+	strbuf_reset(&folded);
+	while (n--) {
+		end = mi_raw_end(frames[n]);
+		if (!get_name(frames[n], end, "func", name) &&
+		    !get_name(frames[n], end, "addr", name))
+			strcpy(name, "??");
+		if (folded.len)
+			strbuf_putc(&folded, ';');
+		strbuf_puts(&folded, name);
+	}
+	samples++;
+
+	return count_stack(folded.str);
+}
+
+/* The folded stacks go to path and a summary to the console */
+int profile_write(const char *path)
+{
+	prof_stack_t *st;
+	long elapsed = now_ms() - start_ms;
+	FILE *fp;
+	int i;
+
+	if (!samples) {
+		printf("No samples taken.\n");
+		return 0;
+	}
+	if (!(fp = fopen(path, "w"))) {
+		printf("Cannot open %s.\n", path);
+		return -1;
+	}
+	for (i = 0; i < hash_size; i++)
+		for (st = buckets[i]; st; st = st->hnext)
+			fprintf(fp, "%s %lu\n", st->frames, st->count);
+	fclose(fp);
+
+	printf("%lu stops, %lu stacks in %ld.%03ld s (%.1f Hz), %d distinct "
+	       "written to %s\n", stops, samples, elapsed / 1000,
+	       elapsed % 1000, elapsed ? stops * 1000.0 / elapsed : 0.0,
+	       stack_count, path);
+
+	return 0;
+}
+
+void profile_stop(void)
+{
+	free_stacks();
+	active = waiting = 0;
+}
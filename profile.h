@@ -0,0 +1,35 @@
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+/*
+ * A sampling profiler run through gdb: the program is stopped at a
+ * fixed rate, the stacks of its threads are asked and it is continued.
+ * Identical stacks are counted together and written out folded, one
+ * "main;run;work COUNT" line each, as flame graph tools read them.
+ */
+typedef struct prof_stack {
+	char *frames;		/* outermost first, joined with ';' */
+	unsigned long count;
+	struct prof_stack *hnext;
+} prof_stack_t;
+
+#define PROF_HASH_MIN	256
+#define PROF_MAX_FRAMES	256
+#define PROF_MAX_NAME	256
+#define PROF_DEFAULT_HZ		20
+#define PROF_DEFAULT_SECONDS	10
+#define PROF_DEFAULT_FILE	"gdbvim.folded"
+
+/* Function prototypes */
+int profile_start(int hz, int seconds);
+int profile_active(void);
+void profile_resumed(void);
+int profile_timeout(void);
+int profile_sample_due(void);
+int profile_over(void);
+void profile_cancel(void);
+int profile_add_stack(const char *reply);
+int profile_write(const char *path);
+void profile_stop(void);
+
+#endif /* __PROFILE_H__ */
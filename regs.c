@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "regs.h"
+
+static reg_entry_t *regs;
+static int reg_count, reg_size;
+static unsigned long cur_gen;
+static strbuf_t str_sb;
+
+static char *dup_or_null(const char *str)
+{
+	char *dup;
+
+	if (!str)
+		return NULL;
+	if (!(dup = strdup(str)))
+		fprintf(stderr, "Cannot allocate memory\n");
+
+	return dup;
+}
+
+/* Copies the next string of a list such as ["rax","rbx"] to sb */
+static const char *next_string(const char *s, strbuf_t *sb)
+{
+	strbuf_reset(sb);
+	for (; *s != '"'; s++)
+		if (!*s || *s == ']')
+			return NULL;
+	for (s++; *s && *s != '"'; s++) {
+		if (*s == '\\' && s[1])
+			s++;
+		strbuf_putc(sb, *s);
+	}
+
+	return *s ? s + 1 : NULL;
+}
+
+static int grow_regs(void)
+{
+	reg_entry_t *new_regs;
+	int new_size = reg_size ? reg_size * 2 : 64;
+
+	new_regs = (reg_entry_t *)realloc(regs, new_size *
+					  sizeof(reg_entry_t));
+	if (!new_regs) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return -1;
+	}
+	memset(new_regs + reg_size, 0,
+	       (new_size - reg_size) * sizeof(reg_entry_t));
+	regs = new_regs;
+	reg_size = new_size;
+
+	return 0;
+}
+
+/* The reply of -data-list-register-names: register-names=["rax",...] */
+int regs_load_names(const char *reply)
+{
+	const char *s;
+
+	if (strncmp(reply, "^done", 5) ||
+	    !(s = strstr(reply, "register-names=[")))
+		return -1;
+	regs_clear();
+	for (s += 16; s = next_string(s, &str_sb); reg_count++) {
+		if (reg_count == reg_size && grow_regs() < 0)
+			return -1;
+		if (str_sb.len)
+			regs[reg_count].name = dup_or_null(str_sb.str);
+	}
+
+	return reg_count;
+}
+
+int regs_known(void)
+{
+	return reg_count > 0;
+}
+
+/*
+ * A stop: the reply of -data-list-changed-registers, changed-registers=
+ * ["0","7"], gives the numbers to ask the values of, appended to
+ * numbers as " 0 7". Returns how many there are, -1 on error.
+ */
+int regs_new_stop(const char *reply, strbuf_t *numbers)
+{
+	const char *s;
+	int n = 0;
+
+	if (strncmp(reply, "^done", 5) ||
+	    !(s = strstr(reply, "changed-registers=[")))
+		return -1;
+	cur_gen++;
+	for (s += 19; s = next_string(s, &str_sb); n++)
+		strbuf_printf(numbers, " %s", str_sb.str);
+
+	return n;
+}
+
+/*
+ * The reply of -data-list-register-values, register-values=[{number=
+ * "0",value="0x1c"},...]. A value is scanned up to its closing quote:
+ * those of vector registers have braces in them. Returns the number of
+ * registers whose value is not the one kept.
+ */
+int regs_load_values(const char *reply)
+{
+	const char *s;
+	int n = 0, num;
+
+	if (strncmp(reply, "^done", 5))
+		return -1;
+	for (s = reply; s = strstr(s, "number=\""); ) {
+		num = atoi(s + 8);
+		if (!(s = strstr(s, "value=\"")) ||
+		    !(s = next_string(s + 6, &str_sb)))
+			break;
+		if (num < 0 || num >= reg_count || (regs[num].value &&
+		    !strcmp(regs[num].value, str_sb.str)))
+			continue;
+		/* The first value is not a change */
+		if (regs[num].value)
+			regs[num].gen = cur_gen;
+		free(regs[num].value);
+		regs[num].value = dup_or_null(str_sb.str);
+		n++;
+	}
+
+	return n;
+}
+
+/*
+ * REGS_PER_LINE registers a line, those changed at the last stop in
+ * bold; a value too wide for a column, such as that of a vector
+ * register, gets a line of its own. Returns the number shown.
+ */
+int regs_print(int changed_only)
+{
+	reg_entry_t *r;
+	int i, len, wide, changed, col = 0, pad = 0, n = 0;
+
+	for (i = 0; i < reg_count; i++) {
+		r = &regs[i];
+		changed = cur_gen && r->gen == cur_gen;
+		if (!r->name || !r->value || (changed_only && !changed))
+			continue;
+		len = strlen(r->value);
+		wide = len > REGS_VALUE_WIDTH;
+		if (col && (wide || col == REGS_PER_LINE)) {
+			putchar('\n');
+			col = 0;
+		}
+		/* The column before is filled up only when one follows */
+		if (col)
+			printf("%*s", pad, "");
+		printf("%s%-8s%s%s", changed ? "\033[1m" : "", r->name,
+		       r->value, changed ? "\033[0m" : "");
+		pad = REGS_VALUE_WIDTH - len;
+		col = wide ? REGS_PER_LINE : col + 1;
+		n++;
+	}
+	if (col)
+		putchar('\n');
+
+	return n;
+}
+
+void regs_clear(void)
+{
+	int i;
+
+	for (i = 0; i < reg_count; i++) {
+		free(regs[i].name);
+		free(regs[i].value);
+	}
+	memset(regs, 0, reg_count * sizeof(reg_entry_t));
+	reg_count = 0;
+	cur_gen = 0;
+}
@@ -0,0 +1,32 @@
+#ifndef __REGS_H__
+#define __REGS_H__
+
+#include "strbuf.h"
+
+/*
+ * The register panel. At a stop gdb is asked which registers have
+ * changed since it was last asked, "-data-list-changed-registers",
+ * and then the values of only those, "-data-list-register-values x 0
+ * 7 16"; stepping an instruction at a time costs two short replies.
+ * The values are kept with the stop generation they changed at, so
+ * the panel is shown again without asking gdb and the last changes
+ * stand out.
+ */
+typedef struct reg_entry {
+	char *name;		/* NULL for the numbers gdb leaves unnamed */
+	char *value;		/* NULL until it is asked */
+	unsigned long gen;	/* stop generation of its last change */
+} reg_entry_t;
+
+#define REGS_VALUE_WIDTH	18
+#define REGS_PER_LINE		3
+
+/* Function prototypes */
+int regs_load_names(const char *reply);
+int regs_known(void);
+int regs_new_stop(const char *reply, strbuf_t *numbers);
+int regs_load_values(const char *reply);
+int regs_print(int changed_only);
+void regs_clear(void);
+
+#endif /* __REGS_H__ */
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <string.h>
+#include "slot_cache.h"
+
+/* All the slots are free and nothing is asked */
+void slot_cache_clear(slot_cache_t *c)
+{
+	memset(c->stamps, 0, sizeof(c->stamps));
+	c->asked_count = 0;
+}
+
+/* Clears the cache of an older epoch; 1 if there was one */
+int slot_cache_sync(slot_cache_t *c, unsigned long epoch)
+{
+	if (epoch == c->epoch)
+		return 0;
+	slot_cache_clear(c);
+	c->epoch = epoch;
+
+	return 1;
+}
+
+/*
+ * 1 if key is to be asked, the caller having found it is not kept: it
+ * is not asked already and there is room to remember it.
+ */
+int slot_cache_ask(slot_cache_t *c, unsigned long key)
+{
+	int i;
+
+	if (c->asked_count == c->asked_max)
+		return 0;
+	for (i = 0; i < c->asked_count; i++)
+		if (c->asked[i] == key)
+			return 0;
+	c->asked[c->asked_count++] = key;
+
+	return 1;
+}
+
+/* 1 if key was asked since the cache was cleared, it is not any longer */
+int slot_cache_take(slot_cache_t *c, unsigned long key)
+{
+	int i;
+
+	for (i = 0; i < c->asked_count; i++) {
+		if (c->asked[i] == key) {
+			c->asked[i] = c->asked[--c->asked_count];
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* The slot is in use and the one looked at last */
+void slot_cache_touch(slot_cache_t *c, int slot)
+{
+	c->stamps[slot] = ++c->stamp;
+}
+
+void slot_cache_free(slot_cache_t *c, int slot)
+{
+	c->stamps[slot] = 0;
+}
+
+/*
+ * A free slot, or the one looked at least recently; the caller frees
+ * what is in it if its stamp is not 0.
+ */
+int slot_cache_pick(slot_cache_t *c)
+{
+	int i, oldest = 0;
+
+	for (i = 0; i < c->slots; i++) {
+		if (!c->stamps[i])
+			return i;
+		if (c->stamps[i] < c->stamps[oldest])
+			oldest = i;
+	}
+
+	return oldest;
+}
+
+/* The slot in use looked at least recently, -1 if all are free */
+int slot_cache_oldest(slot_cache_t *c)
+{
+	int i, oldest = -1;
+
+	for (i = 0; i < c->slots; i++)
+		if (c->stamps[i] &&
+		    (oldest < 0 || c->stamps[i] < c->stamps[oldest]))
+			oldest = i;
+
+	return oldest;
+}
@@ -0,0 +1,35 @@
+#ifndef __SLOT_CACHE_H__
+#define __SLOT_CACHE_H__
+
+/*
+ * The bookkeeping of a cache of gdb replies kept in a fixed number of
+ * slots, as the stack window, the memory view and the disassembly are:
+ * the keys asked and not come yet, the epoch of the stop cache the
+ * slots belong to, and a stamp for each slot, 0 while it is free, so
+ * that the one looked at least recently goes first. What is in the
+ * slots belongs to the caller, which frees it when a slot is dropped.
+ */
+#define SLOT_CACHE_MAX		256
+#define SLOT_ASKED_MAX		64
+
+typedef struct slot_cache {
+	int slots;		/* at most SLOT_CACHE_MAX */
+	int asked_max;		/* at most SLOT_ASKED_MAX */
+	unsigned long stamps[SLOT_CACHE_MAX];
+	unsigned long stamp;
+	unsigned long epoch;
+	unsigned long asked[SLOT_ASKED_MAX];
+	int asked_count;
+} slot_cache_t;
+
+/* Function prototypes */
+void slot_cache_clear(slot_cache_t *c);
+int slot_cache_sync(slot_cache_t *c, unsigned long epoch);
+int slot_cache_ask(slot_cache_t *c, unsigned long key);
+int slot_cache_take(slot_cache_t *c, unsigned long key);
+void slot_cache_touch(slot_cache_t *c, int slot);
+void slot_cache_free(slot_cache_t *c, int slot);
+int slot_cache_pick(slot_cache_t *c);
+int slot_cache_oldest(slot_cache_t *c);
+
+#endif /* __SLOT_CACHE_H__ */
@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "src_cache.h"
+
+#define SRC_LINES_MIN	1024
+
+static src_file_t *src_files;
+static unsigned long src_stamp;
+static long src_bytes;		/* mapped and index bytes of all files */
+static unsigned long src_hits, src_misses, src_reloads, src_evictions;
+
+static long src_file_cost(src_file_t *f)
+{
+	return f->size + (f->nlines > 0 ? f->nlines * sizeof(unsigned int) : 0);
+}
+
+static void unmap_src_file(src_file_t *f)
+{
+	src_bytes -= src_file_cost(f);
+	if (f->map)
+		munmap(f->map, f->size);
+	free(f->lines);
+	f->map = NULL;
+	f->lines = NULL;
+	f->size = 0;
+	f->nlines = -1;
+}
+
+static void free_src_file(src_file_t *f)
+{
+	unmap_src_file(f);
+	free(f->path);
+	free(f);
+}
+
+/*
+ * Size and mtime are set only once the file is mapped. They are taken
+ * from the file opened, not from the stat of the path: a file cut short
+ * in between would raise SIGBUS when the mapping is read past its end.
+ */
+static int map_src_file(src_file_t *f)
+{
+	struct stat st;
+	char *map = NULL;
+	int fd;
+
+	f->nlines = -1;
+	if ((fd = open(f->path, O_RDONLY)) < 0)
+		return -1;
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return -1;
+	}
+	/* An empty file can not be mapped, it has no lines anyway */
+	if (st.st_size)
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+	f->map = map;
+	f->size = st.st_size;
+	f->mtime = st.st_mtim;
+	src_bytes += f->size;
+
+	return 0;
+}
+
+/* The least recently used files go until the budget is kept */
+static void evict_src_files(src_file_t *keep)
+{
+	src_file_t **pp, **victim, *f;
+
+	while (src_bytes > SRC_CACHE_BUDGET) {
+		victim = NULL;
+		for (pp = &src_files; *pp; pp = &(*pp)->next)
+			if (*pp != keep &&
+			    (!victim || (*pp)->stamp < (*victim)->stamp))
+				victim = pp;
+		if (!victim)
+			return;
+		f = *victim;
+		*victim = f->next;
+		free_src_file(f);
+		src_evictions++;
+	}
+}
+
+/*
+ * Returns the file mapped, NULL if it can not be read. It is checked
+ * against the disk every time, an edited file is mapped again.
+ */
+src_file_t *src_cache_get(const char *path)
+{
+	src_file_t *f, **pp;
+	struct stat st;
+
+	if (stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+		return NULL;
+
+	for (f = src_files; f; f = f->next)
+		if (!strcmp(f->path, path))
+			break;
+
+	if (f) {
+		if (f->size == st.st_size &&
+		    f->mtime.tv_sec == st.st_mtim.tv_sec &&
+		    f->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+			src_hits++;
+			f->stamp = ++src_stamp;
+			return f;
+		}
+		src_reloads++;
+		unmap_src_file(f);
+	}
+	else {
+		src_misses++;
+		if (!(f = (src_file_t *)calloc(1, sizeof(src_file_t))) ||
+		    !(f->path = strdup(path))) {
+			fprintf(stderr, "Cannot allocate memory\n");
+			free(f);
+			return NULL;
+		}
+		f->next = src_files;
+		src_files = f;
+	}
+
+	/* An entry that is not mapped would be taken for a hit */
+	if (map_src_file(f) < 0) {
+		for (pp = &src_files; *pp != f; pp = &(*pp)->next)
+			;
+		*pp = f->next;
+		free_src_file(f);
+		return NULL;
+	}
+	f->stamp = ++src_stamp;
+	evict_src_files(f);
+
+	return f;
+}
+
+/*
+ * Line starts in one pass. memchr looks at a word or a vector at a
+ * time, which is what makes a generated multi-megabyte file cheap.
+ */
+static int build_line_index(src_file_t *f)
+{
+	unsigned int *new_lines;
+	const char *p = f->map, *end = f->map + f->size;
+	int size = SRC_LINES_MIN;
+
+	if (!(f->lines = (unsigned int *)malloc(size * sizeof(unsigned int)))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return -1;
+	}
+	f->nlines = 0;
+	while (p < end) {
+		if (f->nlines == size) {
+			size *= 2;
+			new_lines = (unsigned int *)realloc(f->lines,
+						size * sizeof(unsigned int));
+			if (!new_lines) {
+				fprintf(stderr, "Cannot allocate memory\n");
+				free(f->lines);
+				f->lines = NULL;
+				f->nlines = -1;
+				return -1;
+			}
+			f->lines = new_lines;
+		}
+		f->lines[f->nlines++] = p - f->map;
+		if (!(p = memchr(p, '\n', end - p)))
+			break;
+		p++;
+	}
+	/* What is kept is what counts against the budget */
+	if (f->nlines && f->nlines < size &&
+	    (new_lines = (unsigned int *)realloc(f->lines,
+				f->nlines * sizeof(unsigned int))))
+		f->lines = new_lines;
+	src_bytes += f->nlines * sizeof(unsigned int);
+	evict_src_files(f);
+
+	return 0;
+}
+
+/*
+ * Points str to the line, 1 based, without its newline. Returns -1 if
+ * the file has no such line.
+ */
+int src_cache_line(src_file_t *f, int line, const char **str, int *len)
+{
+	const char *end;
+
+	if (f->nlines < 0 && (!f->map || build_line_index(f) < 0))
+		return -1;
+	if (line < 1 || line > f->nlines)
+		return -1;
+
+	*str = f->map + f->lines[line - 1];
+	if (line < f->nlines)
+		end = f->map + f->lines[line] - 1;
+	else
+		end = f->map + f->size;
+	if (end > *str && end[-1] == '\r')
+		end--;
+	*len = end - *str;
+
+	return 0;
+}
+
+/* Shows the lines around line the way gdb lists them, line marked */
+void src_cache_print_context(const char *path, int line, int context)
+{
+	src_file_t *f;
+	const char *str;
+	int i, len;
+
+	if (!(f = src_cache_get(path)))
+		return;
+
+	for (i = line - context; i <= line + context; i++) {
+		if (src_cache_line(f, i, &str, &len) < 0)
+			continue;
+		printf("%c%d\t%.*s\n", i == line ? '>' : ' ', i, len, str);
+	}
+}
+
+void src_cache_clear(void)
+{
+	src_file_t *f;
+
+	while (f = src_files) {
+		src_files = f->next;
+		free_src_file(f);
+	}
+}
+
+void src_cache_print_stats(void)
+{
+	src_file_t *f;
+	int n = 0;
+
+	for (f = src_files; f; f = f->next)
+		n++;
+	printf("%d files, %ld bytes of %ld\n", n, src_bytes,
+	       SRC_CACHE_BUDGET);
+	printf("%lu hits, %lu misses, %lu reloaded, %lu evicted\n",
+	       src_hits, src_misses, src_reloads, src_evictions);
+}
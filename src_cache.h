@@ -0,0 +1,35 @@
+#ifndef __SRC_CACHE_H__
+#define __SRC_CACHE_H__
+
+#include <sys/types.h>
+#include <time.h>
+
+/*
+ * A source file named in a frame, mapped into memory. lines[i] is the
+ * offset where line i + 1 starts; it is built the first time a line is
+ * asked for. The file is mapped again if its mtime or size changes.
+ */
+typedef struct src_file {
+	char *path;
+	char *map;
+	off_t size;
+	struct timespec mtime;
+	unsigned int *lines;
+	int nlines;		/* -1 until the index is built */
+	unsigned long stamp;	/* for LRU eviction */
+	struct src_file *next;
+} src_file_t;
+
+/* Mapped bytes and indexes are kept below this, old files are dropped */
+#define SRC_CACHE_BUDGET	(64L * 1024 * 1024)
+/* Lines shown before and after the line of a stop */
+#define SRC_CONTEXT_LINES	2
+
+/* Function prototypes */
+src_file_t *src_cache_get(const char *path);
+int src_cache_line(src_file_t *f, int line, const char **str, int *len);
+void src_cache_print_context(const char *path, int line, int context);
+void src_cache_clear(void);
+void src_cache_print_stats(void);
+
+#endif /* __SRC_CACHE_H__ */
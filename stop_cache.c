@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stop_cache.h"
+
+static stop_cache_entry_t *stop_cache;
+static int stop_cache_count;
+static int cur_thread;
+static unsigned long cur_gen;
+static unsigned long cur_epoch;	/* advances whenever anything is dropped */
+static int running = 1;		/* nothing to cache before the first stop */
+static unsigned long sc_hits, sc_misses, sc_drops;
+
+/* Commands only looking at the stopped program */
+static const char *query_cmds[] = {
+	"bt", "backtrace", "where", "output", "ptype", "whatis", NULL
+};
+/*
+ * These only look too, but each answer adds a $N to gdb's value history:
+ * replayed, it would show a stale $N and leave the history behind.
+ */
+static const char *history_cmds[] = {
+	"print", "p", "inspect", NULL
+};
+static const char *info_queries[] = {
+	"locals", "args", "frame", NULL
+};
+
+static void free_stop_cache_entry(stop_cache_entry_t *e)
+{
+	free(e->key);
+	free(e->value);
+	free(e);
+}
+
+void stop_cache_invalidate(void)
+{
+	stop_cache_entry_t *e;
+
+	if (stop_cache)
+		sc_drops++;
+	cur_epoch++;
+	while (e = stop_cache) {
+		stop_cache = e->next;
+		free_stop_cache_entry(e);
+	}
+	stop_cache_count = 0;
+}
+
+/* A new stop, thread is the one reported by *stopped */
+void stop_cache_stopped(int thread)
+{
+	stop_cache_invalidate();
+	cur_gen++;
+	cur_thread = thread;
+	running = 0;
+}
+
+void stop_cache_running(void)
+{
+	stop_cache_invalidate();
+	running = 1;
+}
+
+/* Another thread is selected, its entries are kept apart */
+void stop_cache_select_thread(int thread)
+{
+	cur_thread = thread;
+	cur_epoch++;
+}
+
+/*
+ * What is kept elsewhere about the stopped program holds as long as
+ * this stays the same.
+ */
+unsigned long stop_cache_epoch(void)
+{
+	return cur_epoch;
+}
+
+const char *stop_cache_lookup(const char *key)
+{
+	stop_cache_entry_t *e;
+
+	if (running)
+		return NULL;
+	for (e = stop_cache; e; e = e->next) {
+		if (e->thread == cur_thread && e->gen == cur_gen &&
+		    !strcmp(e->key, key)) {
+			sc_hits++;
+			return e->value;
+		}
+	}
+	sc_misses++;
+
+	return NULL;
+}
+
+void stop_cache_store(const char *key, const char *value)
+{
+	stop_cache_entry_t *e, **pp;
+
+	if (running)
+		return;
+
+	/* The oldest one goes, it is at the end */
+	if (stop_cache_count == STOP_CACHE_MAX) {
+		for (pp = &stop_cache; (*pp)->next; pp = &(*pp)->next)
+			;
+		free_stop_cache_entry(*pp);
+		*pp = NULL;
+		stop_cache_count--;
+	}
+
+	e = (stop_cache_entry_t *)calloc(1, sizeof(stop_cache_entry_t));
+	if (!e || !(e->key = strdup(key)) || !(e->value = strdup(value))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		if (e) {
+			free(e->key);
+			free(e);
+		}
+		return;
+	}
+	e->thread = cur_thread;
+	e->gen = cur_gen;
+	e->next = stop_cache;
+	stop_cache = e;
+	stop_cache_count++;
+}
+
+/* Whether the '=' at eq ends ==, !=, <= or >=, rather than <<= or >>= */
+static int is_comparison(const char *expr, const char *eq)
+{
+	if (eq == expr)
+		return 0;
+	if (eq[-1] == '=' || eq[-1] == '!')
+		return 1;
+	if (eq[-1] == '<' || eq[-1] == '>')
+		return eq - 1 == expr || (eq[-2] != '<' && eq[-2] != '>');
+
+	return 0;
+}
+
+/*
+ * An expression may change the program: assignments, ++ and --, and
+ * function calls. A '(' may be a cast too, it is not cached either.
+ */
+static int has_side_effects(const char *expr)
+{
+	const char *s;
+
+	for (s = expr; *s; s++) {
+		if (*s == '(')
+			return 1;
+		if ((*s == '+' || *s == '-') && s[1] == *s)
+			return 1;
+		if (*s == '=' && s[1] != '=' && !is_comparison(expr, s))
+			return 1;
+	}
+
+	return 0;
+}
+
+static int is_cmd(const char **list, const char *cmd, size_t cmd_len)
+{
+	int i;
+
+	for (i = 0; list[i]; i++)
+		if (strlen(list[i]) == cmd_len &&
+		    !strncmp(list[i], cmd, cmd_len))
+			return 1;
+
+	return 0;
+}
+
+/* Returns 1 if evaluating expr can not change the program */
+int stop_cache_is_pure(const char *expr)
+{
+	return !has_side_effects(expr);
+}
+
+/*
+ * Returns 1 if the command only looks at the stopped program, so its
+ * answer can be cached until the next run.
+ */
+int stop_cache_is_query(const char *cmd, int cmd_len, const char *args)
+{
+	int i;
+
+	if ((cmd_len == 4 && !strncmp(cmd, "info", 4)) ||
+	    (cmd_len == 1 && *cmd == 'i')) {
+		if (!args)
+			return 0;
+		for (i = 0; info_queries[i]; i++)
+			if (!strcmp(info_queries[i], args))
+				return 1;
+		return 0;
+	}
+	if (!is_cmd(query_cmds, cmd, cmd_len))
+		return 0;
+
+	return !args || !has_side_effects(args);
+}
+
+/*
+ * Returns 1 if the command leaves the cached answers true: a query, or
+ * a print of an expression without side effects.
+ */
+int stop_cache_keeps(const char *cmd, int cmd_len, const char *args)
+{
+	if (is_cmd(history_cmds, cmd, cmd_len))
+		return !args || !has_side_effects(args);
+
+	return stop_cache_is_query(cmd, cmd_len, args);
+}
+
+void stop_cache_print_stats(void)
+{
+	stop_cache_entry_t *e;
+
+	printf("Stop generation %lu, thread %d, %s\n", cur_gen, cur_thread,
+	       running ? "running" : "stopped");
+	for (e = stop_cache; e; e = e->next)
+		printf("  %s\n", e->key);
+	printf("%lu hits, %lu misses, dropped %lu times\n", sc_hits,
+	       sc_misses, sc_drops);
+}
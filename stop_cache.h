@@ -0,0 +1,37 @@
+#ifndef __STOP_CACHE_H__
+#define __STOP_CACHE_H__
+
+/*
+ * Answers to queries that can not change while the program stays
+ * stopped: the stack, the locals, the value of an expression. They
+ * belong to a (thread, stop generation); the generation advances on
+ * every *stopped and everything is dropped on ^running, or when a
+ * command may have changed the state or the selected frame.
+ *
+ * The key is the query as sent: the gdb/mi command, e.g.
+ * "-data-evaluate-expression x", or the gdb/cli line, e.g. "bt".
+ */
+typedef struct stop_cache_entry {
+	char *key;
+	char *value;
+	int thread;
+	unsigned long gen;
+	struct stop_cache_entry *next;
+} stop_cache_entry_t;
+
+#define STOP_CACHE_MAX	64
+
+/* Function prototypes */
+void stop_cache_stopped(int thread);
+void stop_cache_running(void);
+void stop_cache_select_thread(int thread);
+void stop_cache_invalidate(void);
+unsigned long stop_cache_epoch(void);
+const char *stop_cache_lookup(const char *key);
+void stop_cache_store(const char *key, const char *value);
+int stop_cache_is_pure(const char *expr);
+int stop_cache_is_query(const char *cmd, int cmd_len, const char *args);
+int stop_cache_keeps(const char *cmd, int cmd_len, const char *args);
+void stop_cache_print_stats(void);
+
+#endif /* __STOP_CACHE_H__ */
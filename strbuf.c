@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "strbuf.h"
+
+#define STRBUF_MIN_SIZE	256
+
+/* Makes room for len more characters and the null char */
+int strbuf_reserve(strbuf_t *sb, int len)
+{
+	char *str;
+	int size;
+
+	if (sb->len + len + 1 <= sb->size)
+		return 0;
+
+	size = sb->size ? sb->size : STRBUF_MIN_SIZE;
+	while (size < sb->len + len + 1)
+		size *= 2;
+
+	if (!(str = (char *)realloc(sb->str, size))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return -1;
+	}
+	sb->str = str;
+	sb->size = size;
+
+	return 0;
+}
+
+void strbuf_reset(strbuf_t *sb)
+{
+	sb->len = 0;
+	if (sb->str)
+		sb->str[0] = '\0';
+}
+
+int strbuf_append(strbuf_t *sb, const char *str, int len)
+{
+	if (strbuf_reserve(sb, len) < 0)
+		return -1;
+
+	memcpy(sb->str + sb->len, str, len);
+	sb->len += len;
+	sb->str[sb->len] = '\0';
+
+	return 0;
+}
+
+int strbuf_puts(strbuf_t *sb, const char *str)
+{
+	return strbuf_append(sb, str, strlen(str));
+}
+
+int strbuf_putc(strbuf_t *sb, char c)
+{
+	return strbuf_append(sb, &c, 1);
+}
+
+int strbuf_printf(strbuf_t *sb, const char *fmt, ...)
+{
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(NULL, 0, fmt, ap);
+	va_end(ap);
+
+	if (strbuf_reserve(sb, len) < 0)
+		return -1;
+
+	va_start(ap, fmt);
+	vsnprintf(sb->str + sb->len, len + 1, fmt, ap);
+	va_end(ap);
+	sb->len += len;
+
+	return 0;
+}
+
+void strbuf_free(strbuf_t *sb)
+{
+	free(sb->str);
+	sb->str = NULL;
+	sb->len = sb->size = 0;
+}
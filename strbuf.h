@@ -0,0 +1,23 @@
+#ifndef __STRBUF_H__
+#define __STRBUF_H__
+
+/*
+ * A growable string buffer. It is meant to be reused: reset keeps the
+ * memory, so formatting into it costs nothing after it has grown once.
+ */
+typedef struct strbuf {
+	char *str;
+	int len;
+	int size;
+} strbuf_t;
+
+/* Function prototypes */
+int strbuf_reserve(strbuf_t *sb, int len);
+void strbuf_reset(strbuf_t *sb);
+int strbuf_append(strbuf_t *sb, const char *str, int len);
+int strbuf_puts(strbuf_t *sb, const char *str);
+int strbuf_putc(strbuf_t *sb, char c);
+int strbuf_printf(strbuf_t *sb, const char *fmt, ...);
+void strbuf_free(strbuf_t *sb);
+
+#endif /* __STRBUF_H__ */
@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "symidx.h"
+
+#define SYMIDX_POOL_MIN		(64 * 1024)
+#define SYMIDX_OFFS_MIN		4096
+#define SYMIDX_MAX_NAME		256
+#define SYMIDX_MAX_DIST		2
+
+/* The index in use and the one being filled from gdb's replies */
+static sym_table_t sym_tables[SYM_KIND_MAX];
+static sym_table_t sym_building[SYM_KIND_MAX];
+static int sym_ready;
+static struct timeval build_start;
+static long build_ms;
+
+/* Commands loading or dropping symbols, the index is built again */
+static const char *symidx_reload_cmds[] = {
+	"file", "symbol-file", "add-symbol-file", "sharedlibrary",
+	"core-file", "attach", "load", NULL
+};
+
+static void free_sym_table(sym_table_t *t)
+{
+	free(t->pool);
+	free(t->offs);
+	memset(t, 0, sizeof(sym_table_t));
+}
+
+static int sym_table_add(sym_table_t *t, const char *name, int len)
+{
+	unsigned int *new_offs;
+	char *new_pool;
+	long new_size;
+
+	if (t->pool_len + len + 1 > t->pool_size) {
+		new_size = t->pool_size ? t->pool_size * 2 : SYMIDX_POOL_MIN;
+		while (new_size < t->pool_len + len + 1)
+			new_size *= 2;
+		if (!(new_pool = (char *)realloc(t->pool, new_size))) {
+			fprintf(stderr, "Cannot allocate memory\n");
+			return -1;
+		}
+		t->pool = new_pool;
+		t->pool_size = new_size;
+	}
+	if (t->count == t->size) {
+		new_size = t->size ? t->size * 2 : SYMIDX_OFFS_MIN;
+		new_offs = (unsigned int *)realloc(t->offs,
+					new_size * sizeof(unsigned int));
+		if (!new_offs) {
+			fprintf(stderr, "Cannot allocate memory\n");
+			return -1;
+		}
+		t->offs = new_offs;
+		t->size = new_size;
+	}
+
+	t->offs[t->count++] = t->pool_len;
+	memcpy(t->pool + t->pool_len, name, len);
+	t->pool_len += len;
+	t->pool[t->pool_len++] = '\0';
+
+	return 0;
+}
+
+/* qsort has no user argument, the pool being sorted is kept here */
+static const char *sort_pool;
+
+static int compare_offs(const void *a, const void *b)
+{
+	return strcmp(sort_pool + *(const unsigned int *)a,
+		      sort_pool + *(const unsigned int *)b);
+}
+
+static void sym_table_sort(sym_table_t *t)
+{
+	int i, n, c;
+
+	sort_pool = t->pool;
+	qsort(t->offs, t->count, sizeof(unsigned int), compare_offs);
+
+	/* A name is listed once even if it is in many files */
+	for (i = 1, n = t->count ? 1 : 0; i < t->count; i++)
+		if (strcmp(t->pool + t->offs[i], t->pool + t->offs[n - 1]))
+			t->offs[n++] = t->offs[i];
+	t->count = n;
+
+	/* first[c]: the first name not less than byte c */
+	for (i = 0, c = 0; c < 256; c++) {
+		while (i < t->count &&
+		       (unsigned char)t->pool[t->offs[i]] < c)
+			i++;
+		t->first[c] = i;
+	}
+	t->first[256] = t->count;
+}
+
+/* Starts building a new index, the current one serves until commit */
+void symidx_begin(void)
+{
+	int k;
+
+	for (k = 0; k < SYM_KIND_MAX; k++)
+		free_sym_table(&sym_building[k]);
+	gettimeofday(&build_start, NULL);
+}
+
+/*
+ * Adds the names in the reply of -symbol-info-functions or
+ * -symbol-info-variables. Only name="..." fields are of interest:
+ *
+ *	^done,symbols={debug=[{filename="a.c",fullname="/src/a.c",
+ *	symbols=[{line="3",name="main",type="int (void)",...}]}],
+ *	nondebugging=[{address="0x401000",name="_init"}]}
+ *
+ * "fullname=" also ends with name=, so the field must start after a
+ * ',' or '{'. Returns the number of names added.
+ */
+int symidx_load_mi(sym_kind_t kind, const char *reply)
+{
+	sym_table_t *t = &sym_building[kind];
+	char name[SYMIDX_MAX_NAME];
+	const char *s;
+	int len, n = 0;
+
+	for (s = reply; s = strstr(s, "name=\""); ) {
+		if (s == reply || (s[-1] != ',' && s[-1] != '{')) {
+			s += 6;
+			continue;
+		}
+		for (s += 6, len = 0; *s && *s != '\"'; s++) {
+			if (*s == '\\' && s[1])
+				s++;
+			if (len < SYMIDX_MAX_NAME - 1)
+				name[len++] = *s;
+		}
+		if (!len)
+			continue;
+		if (sym_table_add(t, name, len) < 0)
+			break;
+		n++;
+	}
+
+	return n;
+}
+
+/* The new index replaces the old one */
+void symidx_commit(void)
+{
+	struct timeval now;
+	int k;
+
+	for (k = 0; k < SYM_KIND_MAX; k++) {
+		sym_table_sort(&sym_building[k]);
+		free_sym_table(&sym_tables[k]);
+		sym_tables[k] = sym_building[k];
+		memset(&sym_building[k], 0, sizeof(sym_table_t));
+	}
+	sym_ready = 1;
+
+	gettimeofday(&now, NULL);
+	build_ms = (now.tv_sec - build_start.tv_sec) * 1000 +
+		   (now.tv_usec - build_start.tv_usec) / 1000;
+}
+
+void symidx_reset(void)
+{
+	int k;
+
+	for (k = 0; k < SYM_KIND_MAX; k++) {
+		free_sym_table(&sym_tables[k]);
+		free_sym_table(&sym_building[k]);
+	}
+	sym_ready = 0;
+}
+
+int symidx_ready(void)
+{
+	return sym_ready;
+}
+
+/*
+ * Finds the names starting with prefix. Returns their number and the
+ * index of the first one in first; only the bucket of the first byte
+ * is searched.
+ */
+int symidx_range(sym_kind_t kind, const char *prefix, int len, int *first)
+{
+	sym_table_t *t = &sym_tables[kind];
+	int lo, hi, mid, start, end;
+
+	if (!len) {
+		*first = 0;
+		return t->count;
+	}
+
+	lo = t->first[(unsigned char)*prefix];
+	end = hi = t->first[(unsigned char)*prefix + 1];
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (strncmp(t->pool + t->offs[mid], prefix, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	start = lo;
+
+	hi = end;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (strncmp(t->pool + t->offs[mid], prefix, len) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*first = start;
+	return lo - start;
+}
+
+const char *symidx_name(sym_kind_t kind, int i)
+{
+	return sym_tables[kind].pool + sym_tables[kind].offs[i];
+}
+
+/*
+ * Edit distance of a and b, or max + 1 once it is sure to exceed max.
+ * Both are shorter than SYMIDX_MAX_NAME.
+ */
+static int bounded_distance(const char *a, int alen, const char *b,
+			    int blen, int max)
+{
+	int row[2][SYMIDX_MAX_NAME];
+	int *prev = row[0], *cur = row[1], *tmp;
+	int i, j, best, d;
+
+	for (j = 0; j <= blen; j++)
+		prev[j] = j;
+	for (i = 1; i <= alen; i++) {
+		cur[0] = best = i;
+		for (j = 1; j <= blen; j++) {
+			d = prev[j - 1] + (a[i - 1] != b[j - 1]);
+			if (prev[j] + 1 < d)
+				d = prev[j] + 1;
+			if (cur[j - 1] + 1 < d)
+				d = cur[j - 1] + 1;
+			cur[j] = d;
+			if (d < best)
+				best = d;
+		}
+		if (best > max)
+			return max + 1;
+		tmp = prev;
+		prev = cur;
+		cur = tmp;
+	}
+
+	return prev[blen];
+}
+
+/*
+ * Names close to a mistyped one, best first. Typos are rarely in the
+ * first character, so only that bucket of each table is scanned and
+ * names whose length is too far off are skipped without a look.
+ */
+int symidx_suggest(const char *name, int len, const char **out, int max)
+{
+	int dist[SYMIDX_MAX_SUGGEST];
+	sym_table_t *t;
+	const char *cand;
+	int k, i, j, n = 0, clen, d, limit;
+
+	if (!sym_ready || !len || len >= SYMIDX_MAX_NAME)
+		return 0;
+	if (max > SYMIDX_MAX_SUGGEST)
+		max = SYMIDX_MAX_SUGGEST;
+	limit = len > 3 ? SYMIDX_MAX_DIST : 1;
+
+	for (k = 0; k < SYM_KIND_MAX; k++) {
+		t = &sym_tables[k];
+		for (i = t->first[(unsigned char)*name];
+		     i < t->first[(unsigned char)*name + 1]; i++) {
+			cand = t->pool + t->offs[i];
+			clen = strlen(cand);
+			if (clen >= SYMIDX_MAX_NAME || clen - len > limit ||
+			    len - clen > limit)
+				continue;
+			d = bounded_distance(name, len, cand, clen, limit);
+			if (d > limit || (n == max && d >= dist[n - 1]))
+				continue;
+			/* Insertion into the short sorted list */
+			if (n < max)
+				n++;
+			for (j = n - 1; j > 0 && dist[j - 1] > d; j--) {
+				dist[j] = dist[j - 1];
+				out[j] = out[j - 1];
+			}
+			dist[j] = d;
+			out[j] = cand;
+		}
+	}
+
+	return n;
+}
+
+int symidx_cmd_reloads(const char *cmd, int cmd_len)
+{
+	int i;
+
+	/* "f" is frame, not file */
+	if (cmd_len < 3)
+		return 0;
+	for (i = 0; symidx_reload_cmds[i]; i++)
+		if (!strncmp(symidx_reload_cmds[i], cmd, cmd_len))
+			return 1;
+
+	return 0;
+}
+
+void symidx_print_stats(void)
+{
+	sym_table_t *t;
+	int k;
+
+	if (!sym_ready) {
+		printf("Symbol index is not built yet.\n");
+		return;
+	}
+	for (k = 0; k < SYM_KIND_MAX; k++) {
+		t = &sym_tables[k];
+		printf("%-10s %9d names %9ld bytes\n",
+		       k == SYM_FUNC ? "functions" : "variables", t->count,
+		       t->pool_len + (long)t->size * sizeof(unsigned int));
+	}
+	printf("Built in %ld ms.\n", build_ms);
+}
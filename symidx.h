@@ -0,0 +1,39 @@
+#ifndef __SYMIDX_H__
+#define __SYMIDX_H__
+
+typedef enum sym_kind {
+	SYM_FUNC,
+	SYM_VAR,
+	SYM_KIND_MAX
+} sym_kind_t;
+
+/*
+ * Symbol names of one kind in a sorted string table. The names are
+ * null terminated in pool, offs keeps them in strcmp order and the
+ * names starting with byte c are offs[first[c]] .. offs[first[c + 1]].
+ */
+typedef struct sym_table {
+	char *pool;
+	long pool_len;
+	long pool_size;
+	unsigned int *offs;
+	int count;
+	int size;
+	int first[257];
+} sym_table_t;
+
+#define SYMIDX_MAX_SUGGEST	5
+
+/* Function prototypes */
+void symidx_begin(void);
+int symidx_load_mi(sym_kind_t kind, const char *reply);
+void symidx_commit(void);
+void symidx_reset(void);
+int symidx_ready(void);
+int symidx_range(sym_kind_t kind, const char *prefix, int len, int *first);
+const char *symidx_name(sym_kind_t kind, int i);
+int symidx_suggest(const char *name, int len, const char **out, int max);
+int symidx_cmd_reloads(const char *cmd, int cmd_len);
+void symidx_print_stats(void);
+
+#endif /* __SYMIDX_H__ */
@@ -0,0 +1,579 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "triage.h"
+
+/* Extern declarations */
+typedef struct yy_buffer_state *YY_BUFFER_STATE;
+extern YY_BUFFER_STATE yy_scan_string(const char *yy_str);
+extern void yy_delete_buffer(YY_BUFFER_STATE b);
+extern int yyparse(void);
+
+static const char *gdb_bin;
+static char **exprs;
+static int expr_count;
+static const char *out_dir;
+static int cores_failed;
+
+/* Appends str as a JSON string */
+static void json_str(strbuf_t *sb, const char *str)
+{
+	const char *s;
+
+	strbuf_putc(sb, '"');
+	for (s = str ? str : ""; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			strbuf_printf(sb, "\\%c", *s);
+		else if (*s == '\n')
+			strbuf_puts(sb, "\\n");
+		else if (*s == '\t')
+			strbuf_puts(sb, "\\t");
+		else if ((unsigned char)*s < 0x20)
+			strbuf_printf(sb, "\\u%04x", *s);
+		else
+			strbuf_putc(sb, *s);
+	}
+	strbuf_putc(sb, '"');
+}
+
+/* Appends ,"key":"value" if there is a value */
+static void json_field(strbuf_t *sb, const char *key, const char *value)
+{
+	if (!value)
+		return;
+	strbuf_printf(sb, ",\"%s\":", key);
+	json_str(sb, value);
+}
+
+/*
+ * The result record of a reply through the gdb/mi parser; the lines
+ * before it, such as notifications, are not needed. The tree is left
+ * in gdbmi_out_ptr, NULL if there is none.
+ */
+static gdbmi_output_t *parse_result(const char *reply)
+{
+	static strbuf_t sb;
+	YY_BUFFER_STATE bufstate;
+	const char *s, *end;
+
+	for (s = reply; *s != '^'; s = end + 1)
+		if (!(end = strchr(s, '\n')))
+			return NULL;
+	if (!(end = strchr(s, '\n')))
+		return NULL;
+	strbuf_reset(&sb);
+	strbuf_append(&sb, s, end + 1 - s);
+	strbuf_puts(&sb, "(gdb) \n");
+
+	bufstate = yy_scan_string(sb.str);
+	yyparse();
+	yy_delete_buffer(bufstate);
+
+	return gdbmi_out_ptr;
+}
+
+static void release_result(void)
+{
+	destroy_gdbmi_output();
+	gdbmi_out_ptr = NULL;
+}
+
+static void send_cmd(triage_job_t *job, const char *fmt, ...)
+{
+	static strbuf_t sb;
+	va_list ap;
+	char *s;
+	int n, w;
+
+	strbuf_reset(&sb);
+	va_start(ap, fmt);
+	n = vsnprintf(NULL, 0, fmt, ap);
+	va_end(ap);
+	if (strbuf_reserve(&sb, n + 1) < 0)
+		return;
+	va_start(ap, fmt);
+	vsnprintf(sb.str, n + 1, fmt, ap);
+	va_end(ap);
+	/* A gdb gone is seen when its output ends */
+	for (s = sb.str; n > 0; s += w, n -= w) {
+		if ((w = write(job->to_gdb, s, n)) < 0) {
+			if (errno != EINTR)
+				return;
+			w = 0;
+		}
+	}
+}
+
+static void fail(triage_job_t *job, char *error)
+{
+	if (!job->error)
+		job->error = error;
+	else
+		free(error);
+}
+
+static void ask_stack(triage_job_t *job)
+{
+	send_cmd(job, "-stack-list-frames --thread %s 0 %d\n",
+		 job->thread->id, TRIAGE_FRAMES_MAX - 1);
+	job->step = TRIAGE_FRAMES;
+}
+
+/* The next expression in the thread that crashed, or gdb is done */
+static void ask_expr(triage_job_t *job)
+{
+	static strbuf_t sb;
+	const char *s;
+
+	if (job->expr == expr_count) {
+		send_cmd(job, "-gdb-exit\n");
+		job->step = TRIAGE_EXITING;
+		return;
+	}
+	strbuf_reset(&sb);
+	for (s = exprs[job->expr]; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			strbuf_putc(&sb, '\\');
+		strbuf_putc(&sb, *s);
+	}
+	if (job->current)
+		send_cmd(job, "-data-evaluate-expression --thread %s --frame 0 "
+			 "\"%s\"\n", job->current, sb.str ? sb.str : "");
+	else
+		send_cmd(job, "-data-evaluate-expression \"%s\"\n",
+			 sb.str ? sb.str : "");
+	job->step = TRIAGE_EXPRS;
+}
+
+static void add_threads(triage_job_t *job)
+{
+	gdbmi_output_t *out;
+	char *str;
+
+	if (!(out = parse_result(job->reply.str)))
+		fail(job, strdup("No reply to -thread-info"));
+	else if (str = mi_get_error_result_record(out))
+		fail(job, str);
+	else {
+		job->threads = mi_get_thread_list(out);
+		job->current = mi_get_done_result(out, "current-thread-id");
+		if (!job->threads)
+			fail(job, strdup("No threads"));
+	}
+	if (out)
+		release_result();
+}
+
+static void add_stack(triage_job_t *job)
+{
+	gdbmi_output_t *out;
+	frame_info_t *frames, *f;
+	strbuf_t *sb = &job->stacks;
+	char *str;
+
+	if (sb->len)
+		strbuf_putc(sb, ',');
+	strbuf_puts(sb, "{\"id\":");
+	json_str(sb, job->thread->id);
+	json_field(sb, "target_id", job->thread->target_id);
+	json_field(sb, "name", job->thread->name);
+	if (!(out = parse_result(job->reply.str))) {
+		strbuf_puts(sb, ",\"error\":\"No reply\"}");
+		return;
+	}
+	if (str = mi_get_error_result_record(out)) {
+		json_field(sb, "error", str);
+		free(str);
+		strbuf_putc(sb, '}');
+		release_result();
+		return;
+	}
+	frames = mi_get_frame_list(out, "stack");
+	release_result();
+
+	strbuf_puts(sb, ",\"frames\":[");
+	for (f = frames; f; f = f->next) {
+		strbuf_printf(sb, "%s{\"level\":%d", f == frames ? "" : ",",
+			      f->level);
+		json_field(sb, "addr", f->addr);
+		json_field(sb, "func", f->func);
+		json_field(sb, "file", f->fullname ? f->fullname : f->file);
+		if (f->line)
+			strbuf_printf(sb, ",\"line\":%d", atoi(f->line));
+		json_field(sb, "from", f->from);
+		strbuf_putc(sb, '}');
+	}
+	strbuf_puts(sb, "]}");
+	free_frame_info(frames);
+}
+
+static void add_value(triage_job_t *job)
+{
+	gdbmi_output_t *out;
+	strbuf_t *sb = &job->values;
+	char *str;
+
+	if (sb->len)
+		strbuf_putc(sb, ',');
+	strbuf_puts(sb, "{\"expr\":");
+	json_str(sb, exprs[job->expr]);
+	if (!(out = parse_result(job->reply.str)))
+		json_field(sb, "error", "No reply");
+	else if (str = mi_get_error_result_record(out)) {
+		json_field(sb, "error", str);
+		free(str);
+	}
+	else if (str = mi_get_done_result(out, "value")) {
+		json_field(sb, "value", str);
+		free(str);
+	}
+	if (out)
+		release_result();
+	strbuf_putc(sb, '}');
+}
+
+/* A reply has come, up to the prompt: the next question goes */
+static void handle_reply(triage_job_t *job)
+{
+	switch (job->step) {
+	case TRIAGE_LOADING:
+		send_cmd(job, "-thread-info\n");
+		job->step = TRIAGE_THREADS;
+		break;
+	case TRIAGE_THREADS:
+		add_threads(job);
+		if (job->error) {
+			send_cmd(job, "-gdb-exit\n");
+			job->step = TRIAGE_EXITING;
+			break;
+		}
+		job->thread = job->threads;
+		ask_stack(job);
+		break;
+	case TRIAGE_FRAMES:
+		add_stack(job);
+		if (job->thread = job->thread->next)
+			ask_stack(job);
+		else
+			ask_expr(job);
+		break;
+	case TRIAGE_EXPRS:
+		add_value(job);
+		job->expr++;
+		ask_expr(job);
+		break;
+	case TRIAGE_EXITING:
+		break;
+	}
+}
+
+/*
+ * Both ends are closed on exec: gdb keeps only the copies on its stdin
+ * and stdout, and the gdbs started later none of them, so each one sees
+ * the end of its input when its own job closes it.
+ */
+static int cloexec_pipe(int fds[2])
+{
+	if (pipe(fds) < 0)
+		return -1;
+	if (fcntl(fds[0], F_SETFD, FD_CLOEXEC) < 0 ||
+	    fcntl(fds[1], F_SETFD, FD_CLOEXEC) < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int start_job(triage_job_t *job)
+{
+	int in[2], out[2], fd;
+
+	if (cloexec_pipe(in) < 0)
+		return -1;
+	if (cloexec_pipe(out) < 0) {
+		close(in[0]);
+		close(in[1]);
+		return -1;
+	}
+	if ((job->pid = fork()) < 0) {
+		close(in[0]);
+		close(in[1]);
+		close(out[0]);
+		close(out[1]);
+		return -1;
+	}
+	if (!job->pid) {
+		dup2(in[0], STDIN_FILENO);
+		dup2(out[1], STDOUT_FILENO);
+		/* Its warnings would be in the way of the replies */
+		if ((fd = open("/dev/null", O_WRONLY | O_CLOEXEC)) >= 0)
+			dup2(fd, STDERR_FILENO);
+		execlp(gdb_bin, gdb_bin, "-q", "--interpreter=mi", job->prog,
+		       job->core, (char *)NULL);
+		_exit(127);
+	}
+	close(in[0]);
+	close(out[1]);
+	job->to_gdb = in[1];
+	job->from_gdb = out[0];
+	job->start = time(NULL);
+	job->step = TRIAGE_LOADING;
+
+	return 0;
+}
+
+/* NAME.json in the output directory */
+static void write_json(triage_job_t *job)
+{
+	static strbuf_t path;
+	FILE *fp;
+
+	strbuf_reset(&path);
+	strbuf_printf(&path, "%s/%s.json", out_dir, job->name);
+	if (!(fp = fopen(path.str, "w"))) {
+		perror(path.str);
+		return;
+	}
+	fprintf(fp, "{\"program\":");
+	strbuf_reset(&path);
+	json_str(&path, job->prog);
+	strbuf_puts(&path, ",\"core\":");
+	json_str(&path, job->core);
+	json_field(&path, "crashed_thread", job->current);
+	json_field(&path, "error", job->error);
+	fprintf(fp, "%s,\"threads\":[%s],\"expressions\":[%s]}\n", path.str,
+		job->stacks.len ? job->stacks.str : "",
+		job->values.len ? job->values.str : "");
+	if (fclose(fp))
+		perror(job->name);
+}
+
+/* gdb's output has ended; the findings are written and it is reaped */
+static void finish_job(triage_job_t *job)
+{
+	int status;
+	thread_info_t *t;
+	int n = 0;
+
+	close(job->to_gdb);
+	close(job->from_gdb);
+	if (job->pid > 0)
+		waitpid(job->pid, &status, 0);
+	job->pid = 0;
+	if (job->step != TRIAGE_EXITING)
+		fail(job, strdup("gdb exited before it was done"));
+	write_json(job);
+
+	for (t = job->threads; t; t = t->next)
+		n++;
+	if (job->error) {
+		printf("%s: %s\n", job->core, job->error);
+		cores_failed++;
+	}
+	else
+		printf("%s: %d threads\n", job->core, n);
+	fflush(stdout);
+
+	free_thread_info(job->threads);
+	job->threads = job->thread = NULL;
+	free(job->current);
+	free(job->error);
+	job->current = job->error = NULL;
+	strbuf_free(&job->reply);
+	strbuf_free(&job->stacks);
+	strbuf_free(&job->values);
+}
+
+/* Reads what gdb has said; 0 once its output has ended */
+static int read_job(triage_job_t *job)
+{
+	char buf[TRIAGE_READ_SIZE];
+	char *prompt;
+	int n, len;
+
+	if ((n = read(job->from_gdb, buf, sizeof(buf))) < 0)
+		return errno == EINTR;
+	if (!n)
+		return 0;
+	strbuf_append(&job->reply, buf, n);
+	while (prompt = strstr(job->reply.str, "(gdb) \n")) {
+		len = prompt + 7 - job->reply.str;
+		*prompt = '\0';
+		handle_reply(job);
+		memmove(job->reply.str, job->reply.str + len,
+			job->reply.len - len + 1);
+		job->reply.len -= len;
+	}
+
+	return 1;
+}
+
+/*
+ * The name of the findings of core: its path with the '/'s made '_'s,
+ * since cores are mostly all named core or core.PID in different
+ * directories. A leading / or ./ is left out.
+ */
+static char *json_name(const char *core)
+{
+	char *name, *s;
+
+	while (*core == '/' || (core[0] == '.' && core[1] == '/'))
+		core += *core == '/' ? 1 : 2;
+	if (!(name = strdup(core)))
+		return NULL;
+	for (s = name; *s; s++)
+		if (*s == '/')
+			*s = '_';
+
+	return name;
+}
+
+/* The pairs of the list, one "PROG CORE" a line */
+static int read_list(const char *list, triage_job_t **jobs)
+{
+	char line[TRIAGE_LINE_SIZE];
+	triage_job_t *j;
+	char *prog, *core;
+	int i, n = 0, size = 0;
+	FILE *fp;
+
+	if (!strcmp(list, "-"))
+		fp = stdin;
+	else if (!(fp = fopen(list, "r"))) {
+		perror(list);
+		return -1;
+	}
+	*jobs = NULL;
+	while (fgets(line, sizeof(line), fp)) {
+		if (!(prog = strtok(line, " \t\n")) || *prog == '#')
+			continue;
+		if (!(core = strtok(NULL, " \t\n"))) {
+			fprintf(stderr, "%s: No core for %s\n", list, prog);
+			continue;
+		}
+		if (n == size) {
+			size = size ? size * 2 : 64;
+			if (!(j = (triage_job_t *)realloc(*jobs,
+						size * sizeof(*j)))) {
+				fprintf(stderr, "Cannot allocate memory\n");
+				break;
+			}
+			*jobs = j;
+		}
+		j = &(*jobs)[n];
+		memset(j, 0, sizeof(*j));
+		if (!(j->prog = strdup(prog)) || !(j->core = strdup(core)) ||
+		    !(j->name = json_name(core))) {
+			fprintf(stderr, "Cannot allocate memory\n");
+			break;
+		}
+		/* Its findings would overwrite those of another core */
+		for (i = 0; i < n && strcmp((*jobs)[i].name, j->name); i++)
+			;
+		if (i < n) {
+			fprintf(stderr, "%s: %s and %s would both go to "
+				"%s.json\n", list, (*jobs)[i].core, core,
+				j->name);
+			free(j->prog);
+			free(j->core);
+			free(j->name);
+			continue;
+		}
+		n++;
+	}
+	if (fp != stdin)
+		fclose(fp);
+
+	return n;
+}
+
+/*
+ * Runs up to jobs gdbs at a time over the pairs of the list. Returns
+ * the number of cores that could not be triaged, -1 on error.
+ */
+int triage_run(const char *gdb, const char *list, int jobs, char **ex,
+	       int ex_count, const char *dir)
+{
+	triage_job_t *all, **running;
+	struct pollfd *fds;
+	struct timeval start, end;
+	int i, n, next = 0, active = 0;
+	time_t now;
+
+	gdb_bin = gdb;
+	exprs = ex;
+	expr_count = ex_count;
+	out_dir = dir;
+	if ((n = read_list(list, &all)) <= 0)
+		return n;
+	if (jobs < 1)
+		jobs = 1;
+	running = (triage_job_t **)malloc(jobs * sizeof(*running));
+	fds = (struct pollfd *)malloc(jobs * sizeof(*fds));
+	if (!running || !fds) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		return -1;
+	}
+	/* A gdb that dies is seen as the end of its output */
+	signal(SIGPIPE, SIG_IGN);
+	gettimeofday(&start, NULL);
+
+	while (next < n || active) {
+		for (; next < n && active < jobs; next++) {
+			if (start_job(&all[next]) < 0) {
+				perror(all[next].core);
+				cores_failed++;
+				continue;
+			}
+			running[active++] = &all[next];
+		}
+		/* An interrupted poll leaves revents as they were */
+		for (i = 0; i < active; i++) {
+			fds[i].fd = running[i]->from_gdb;
+			fds[i].events = POLLIN;
+			fds[i].revents = 0;
+		}
+		if (poll(fds, active, 1000) < 0 && errno != EINTR) {
+			perror(__FUNCTION__);
+			return -1;
+		}
+		now = time(NULL);
+		for (i = active - 1; i >= 0; i--) {
+			if (now - running[i]->start > TRIAGE_TIMEOUT) {
+				if (running[i]->step != TRIAGE_EXITING)
+					fail(running[i], strdup("Timed out"));
+				running[i]->step = TRIAGE_EXITING;
+				kill(running[i]->pid, SIGKILL);
+			}
+			if (!fds[i].revents || read_job(running[i]))
+				continue;
+			finish_job(running[i]);
+			running[i] = running[--active];
+		}
+	}
+
+	gettimeofday(&end, NULL);
+	printf("%d cores, %d failed, in %.1f seconds\n", n, cores_failed,
+	       end.tv_sec - start.tv_sec +
+	       (end.tv_usec - start.tv_usec) / 1e6);
+	for (i = 0; i < n; i++) {
+		free(all[i].prog);
+		free(all[i].core);
+		free(all[i].name);
+	}
+	free(all);
+	free(running);
+	free(fds);
+
+	return cores_failed;
+}
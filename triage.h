@@ -0,0 +1,55 @@
+#ifndef __TRIAGE_H__
+#define __TRIAGE_H__
+
+#include <sys/types.h>
+#include <time.h>
+#include "strbuf.h"
+#include "mi_parser.h"
+
+/*
+ * Core dump triage, without a terminal. Each line of the list names a
+ * program and one of its cores; a gdb is started on each pair, up to
+ * jobs of them at a time, and asked the threads, the stack of each and
+ * the given expressions in the thread that crashed. The replies go
+ * through the gdb/mi parser one at a time, as they come from any of the
+ * gdbs, and the findings are written to NAME.json in the output
+ * directory, NAME being the path of the core with '_' for '/'.
+ */
+#define TRIAGE_FRAMES_MAX	256
+#define TRIAGE_EXPRS_MAX	32
+#define TRIAGE_TIMEOUT		300	/* seconds a gdb may take on a core */
+#define TRIAGE_LINE_SIZE	4096
+#define TRIAGE_READ_SIZE	4096
+
+typedef enum triage_step {
+	TRIAGE_LOADING,		/* the first prompt has not come yet */
+	TRIAGE_THREADS,
+	TRIAGE_FRAMES,
+	TRIAGE_EXPRS,
+	TRIAGE_EXITING
+} triage_step_t;
+
+typedef struct triage_job {
+	char *prog;
+	char *core;
+	char *name;		/* of its findings, made from the core's path */
+	pid_t pid;		/* 0 once gdb is gone */
+	int to_gdb;
+	int from_gdb;
+	time_t start;
+	triage_step_t step;
+	strbuf_t reply;		/* what gdb has said since its last prompt */
+	thread_info_t *threads;
+	thread_info_t *thread;	/* the one whose stack is asked */
+	char *current;		/* the thread that got the signal */
+	int expr;
+	strbuf_t stacks;	/* the JSON of the threads so far */
+	strbuf_t values;	/* and of the expressions */
+	char *error;
+} triage_job_t;
+
+/* Function prototypes */
+int triage_run(const char *gdb, const char *list, int jobs, char **exprs,
+	       int expr_count, const char *out_dir);
+
+#endif /* __TRIAGE_H__ */
@@ -0,0 +1,437 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "vim_channel.h"
+
+#define VIM_IN_BUF_SIZE	1024
+
+static vim_channel_t vim = { .listen_fd = -1, .fd = -1 };
+
+static long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int set_nonblock(int fd)
+{
+	int flags = fcntl(fd, F_GETFL);
+
+	return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+int vim_channel_open(const char *path, vim_request_handler_t handler)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	mode_t mask;
+	int ret;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Socket path is too long: %s\n", path);
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	/* Only a socket left by an earlier gdbvim is removed */
+	if (!lstat(path, &st)) {
+		if (!S_ISSOCK(st.st_mode)) {
+			fprintf(stderr, "%s exists and is not a socket\n", path);
+			return -1;
+		}
+		unlink(path);
+	}
+	if ((vim.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror(__FUNCTION__);
+		return -1;
+	}
+	/* Whoever connects can run any gdb command, shell included */
+	mask = umask(077);
+	ret = bind(vim.listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+	if (ret < 0 || listen(vim.listen_fd, 1) < 0 ||
+	    set_nonblock(vim.listen_fd) < 0) {
+		perror(__FUNCTION__);
+		close(vim.listen_fd);
+		vim.listen_fd = -1;
+		return -1;
+	}
+	if (!(vim.path = strdup(path))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		close(vim.listen_fd);
+		vim.listen_fd = -1;
+		unlink(path);
+		return -1;
+	}
+	vim.handler = handler;
+
+	return 0;
+}
+
+static void close_client(void)
+{
+	if (vim.fd < 0)
+		return;
+	close(vim.fd);
+	vim.fd = -1;
+	strbuf_reset(&vim.out);
+	vim.out_pos = 0;
+	strbuf_reset(&vim.in);
+	free(vim.sent_file);
+	vim.sent_file = NULL;
+}
+
+void vim_channel_close(void)
+{
+	close_client();
+	if (vim.listen_fd >= 0) {
+		close(vim.listen_fd);
+		vim.listen_fd = -1;
+		unlink(vim.path);
+	}
+}
+
+int vim_channel_listen_fd(void)
+{
+	return vim.listen_fd;
+}
+
+int vim_channel_fd(void)
+{
+	return vim.fd;
+}
+
+/* POLLOUT only while something is waiting to be written */
+int vim_channel_events(void)
+{
+	return vim.out_pos < vim.out.len ? POLLIN | POLLOUT : POLLIN;
+}
+
+/* One Vim at a time, a new connection replaces the old one */
+void vim_channel_accept(void)
+{
+	int fd;
+
+	if ((fd = accept(vim.listen_fd, NULL, NULL)) < 0)
+		return;
+	close_client();
+	set_nonblock(fd);
+	vim.fd = fd;
+
+	/* A new Vim is shown where the program is at once */
+	if (vim.file) {
+		vim.dirty = 1;
+		vim.due_ms = now_ms();
+	}
+}
+
+static void write_pending(void)
+{
+	int nwritten;
+
+	while (vim.out_pos < vim.out.len) {
+		nwritten = write(vim.fd, vim.out.str + vim.out_pos,
+				 vim.out.len - vim.out_pos);
+		if (nwritten < 0) {
+			if (errno != EAGAIN && errno != EINTR)
+				close_client();
+			return;
+		}
+		vim.out_pos += nwritten;
+	}
+	strbuf_reset(&vim.out);
+	vim.out_pos = 0;
+}
+
+/*
+ * Length of the JSON message [id,"request"] at the start of msg with
+ * the request unescaped into vim.req, 0 if it has not come whole yet.
+ * A message which is not in this form is skipped, its id is -1.
+ */
+static int parse_json_request(const char *msg, long *id)
+{
+	const char *s, *end;
+	char *num_end;
+	int depth = 0, in_str = 0;
+	int i, c;
+
+	/* Where the message ends, brackets in strings do not count */
+	for (end = msg; *end; end++) {
+		if (in_str) {
+			if (*end == '\\' && end[1])
+				end++;
+			else if (*end == '\"')
+				in_str = 0;
+		}
+		else if (*end == '\"')
+			in_str = 1;
+		else if (*end == '[')
+			depth++;
+		else if (*end == ']' && !--depth)
+			break;
+	}
+	if (!*end)
+		return 0;
+
+	strbuf_reset(&vim.req);
+	s = msg + 1;
+	*id = strtol(s, &num_end, 10);
+	for (s = num_end; *s == ' ' || *s == ','; s++)
+		;
+	if (num_end == msg + 1 || *s != '\"') {
+		*id = -1;
+		return end - msg + 1;
+	}
+	for (s++; s < end && *s != '\"'; s++) {
+		if (*s != '\\') {
+			strbuf_putc(&vim.req, *s);
+			continue;
+		}
+		switch (*++s) {
+		case 'n':
+			strbuf_putc(&vim.req, '\n');
+			break;
+		case 't':
+			strbuf_putc(&vim.req, '\t');
+			break;
+		case 'u':
+			/* Only ASCII is expected in a request */
+			for (i = 0, c = 0; i < 4 && isxdigit((unsigned char)s[1]);
+			     i++, s++)
+				c = c * 16 + (isdigit((unsigned char)s[1]) ?
+					      s[1] - '0' :
+					      tolower((unsigned char)s[1]) - 'a' + 10);
+			strbuf_putc(&vim.req, c);
+			break;
+		default:
+			strbuf_putc(&vim.req, *s);
+		}
+	}
+
+	return end - msg + 1;
+}
+
+/* "12 toggle /src/a.c:42\n", the id is optional */
+static int parse_line_request(const char *msg, long *id)
+{
+	const char *s = msg, *end;
+	char *num_end;
+
+	if (!(end = strchr(msg, '\n')))
+		return 0;
+
+	*id = strtol(s, &num_end, 10);
+	if (num_end == s)
+		*id = 0;
+	for (s = num_end; *s == ' '; s++)
+		;
+	strbuf_reset(&vim.req);
+	strbuf_append(&vim.req, s, end - s);
+	if (vim.req.len && vim.req.str[vim.req.len - 1] == '\r')
+		vim.req.str[--vim.req.len] = '\0';
+
+	return end - msg + 1;
+}
+
+/* Every request read whole is given to the handler */
+static int dispatch_requests(void)
+{
+	char *msg = vim.in.str;
+	long id;
+	int len, n = 0;
+
+	while (1) {
+		while (*msg == ' ' || *msg == '\n' || *msg == '\r')
+			msg++;
+		if (!*msg)
+			break;
+		if (*msg == '[')
+			len = parse_json_request(msg, &id);
+		else
+			len = parse_line_request(msg, &id);
+		if (!len)
+			break;
+		msg += len;
+		if (id < 0 || !vim.req.len)
+			continue;
+		vim.requests++;
+		n++;
+		vim.handler(id, vim.req.str);
+		/* The handler may close the channel */
+		if (vim.fd < 0)
+			return n;
+	}
+
+	/* The part of a request still to come is kept */
+	len = vim.in.len - (msg - vim.in.str);
+	memmove(vim.in.str, msg, len + 1);
+	vim.in.len = len;
+
+	return n;
+}
+
+/* Returns the number of requests handled */
+int vim_channel_handle(int revents)
+{
+	char inbuf[VIM_IN_BUF_SIZE];
+	int nread;
+
+	if (vim.fd < 0)
+		return 0;
+
+	if (revents & POLLOUT)
+		write_pending();
+
+	if (revents & (POLLIN | POLLHUP | POLLERR)) {
+		nread = read(vim.fd, inbuf, VIM_IN_BUF_SIZE);
+		if (nread == 0 || (nread < 0 && errno != EAGAIN)) {
+			close_client();
+			return 0;
+		}
+		if (nread > 0 && !strbuf_append(&vim.in, inbuf, nread) &&
+		    vim.handler)
+			return dispatch_requests();
+	}
+
+	return 0;
+}
+
+/* Records the latest stop, it is sent by vim_channel_flush */
+void vim_channel_frame(const char *file, int line)
+{
+	char *copy;
+
+	vim.stops++;
+	if (!vim.file || strcmp(vim.file, file)) {
+		if (!(copy = strdup(file))) {
+			fprintf(stderr, "Cannot allocate memory\n");
+			return;
+		}
+		free(vim.file);
+		vim.file = copy;
+	}
+	vim.line = line;
+
+	/* The deadline is not pushed back, a long burst is still seen */
+	if (!vim.dirty) {
+		vim.dirty = 1;
+		vim.due_ms = now_ms() + VIM_COALESCE_MS;
+	}
+}
+
+/* ms until the pending location is due, -1 if there is none */
+int vim_channel_timeout(void)
+{
+	long left;
+
+	/* Waits for POLLOUT while Vim has not taken the previous one */
+	if (!vim.dirty || vim.fd < 0 || vim.out.len)
+		return -1;
+	left = vim.due_ms - now_ms();
+
+	return left > 0 ? left : 0;
+}
+
+/*
+ * Appends str as the inside of a JSON string. In a file name, ' is
+ * doubled too since it goes into a Vim single quoted string.
+ */
+static void put_json_string(strbuf_t *sb, const char *str, int file_name)
+{
+	for (; *str; str++) {
+		if (*str == '\'' && file_name)
+			strbuf_puts(sb, "''");
+		else if (*str == '\n')
+			strbuf_puts(sb, "\\n");
+		else if (*str == '\"' || *str == '\\') {
+			strbuf_putc(sb, '\\');
+			strbuf_putc(sb, *str);
+		}
+		else if ((unsigned char)*str < 0x20)
+			strbuf_printf(sb, "\\u%04x", *str);
+		else
+			strbuf_putc(sb, *str);
+	}
+}
+
+/*
+ * Sends the latest location if it is due and Vim has taken what was
+ * written before. The file is opened only if Vim is not showing it.
+ */
+void vim_channel_flush(void)
+{
+	strbuf_t *sb = &vim.out;
+	int same_file;
+
+	if (!vim.dirty || vim.fd < 0 || vim.out.len ||
+	    vim_channel_timeout() > 0)
+		return;
+	vim.dirty = 0;
+
+	same_file = vim.sent_file && !strcmp(vim.sent_file, vim.file);
+	if (same_file && vim.sent_line == vim.line)
+		return;
+
+	strbuf_puts(sb, "[\"ex\",\"");
+	if (!same_file) {
+		strbuf_puts(sb, "execute 'drop ' . fnameescape('");
+		put_json_string(sb, vim.file, 1);
+		strbuf_puts(sb, "') | ");
+	}
+	strbuf_printf(sb, "call cursor(%d, 1) | normal! zz\"]", vim.line);
+	strbuf_puts(sb, "[\"redraw\",\"\"]\n");
+
+	if (!same_file) {
+		free(vim.sent_file);
+		vim.sent_file = strdup(vim.file);
+	}
+	vim.sent_line = vim.line;
+	vim.updates++;
+
+	write_pending();
+}
+
+/*
+ * Answers request id: [id,{"status":"done","value":"42"}]. key and
+ * value may be NULL.
+ */
+void vim_channel_reply(long id, const char *status, const char *key,
+		       const char *value)
+{
+	if (vim.fd < 0)
+		return;
+
+	strbuf_printf(&vim.out, "[%ld,{\"status\":\"%s\"", id, status);
+	if (key && value) {
+		strbuf_printf(&vim.out, ",\"%s\":\"", key);
+		put_json_string(&vim.out, value, 0);
+		strbuf_putc(&vim.out, '\"');
+	}
+	strbuf_puts(&vim.out, "}]\n");
+
+	write_pending();
+}
+
+void vim_channel_print_stats(void)
+{
+	if (vim.listen_fd < 0)
+		printf("Vim channel is not open.\n");
+	else
+		printf("Vim channel: unix:%s, %s\n", vim.path,
+		       vim.fd < 0 ? "not connected" : "connected");
+	printf("%lu stops, %lu sent to Vim, %lu requests from Vim\n",
+	       vim.stops, vim.updates, vim.requests);
+}
@@ -0,0 +1,62 @@
+#ifndef __VIM_CHANNEL_H__
+#define __VIM_CHANNEL_H__
+
+#include "strbuf.h"
+
+/*
+ * Connection to Vim over a Unix socket. Vim connects once with
+ *
+ *	:let ch = ch_open('unix:/tmp/gdbvim-1234.sock', {'mode': 'json'})
+ *
+ * and keeps the channel open. Stops are not sent one by one: only the
+ * latest location is kept and it goes out when the output has been
+ * quiet for VIM_COALESCE_MS, so a burst of stops is one redraw.
+ *
+ * Vim asks gdb through the same channel, either with ch_sendexpr(),
+ * which sends [id,"request"], or with ch_sendraw() and a line:
+ *
+ *	12 toggle /src/a.c:42\n
+ *
+ * Each request is answered with [id,{"status":...}], which Vim hands
+ * to the callback of ch_sendexpr() or returns from ch_evalexpr().
+ */
+#define VIM_COALESCE_MS	20
+
+typedef void (*vim_request_handler_t)(long id, char *req);
+
+typedef struct vim_channel {
+	char *path;
+	int listen_fd;
+	int fd;			/* -1 until Vim connects */
+	strbuf_t out;		/* not written yet, Vim is slow */
+	int out_pos;
+	strbuf_t in;		/* a request not read whole yet */
+	strbuf_t req;
+	vim_request_handler_t handler;
+	char *file;		/* latest location, not sent yet if dirty */
+	int line;
+	int dirty;
+	long due_ms;
+	char *sent_file;	/* what Vim shows */
+	int sent_line;
+	unsigned long stops;
+	unsigned long updates;
+	unsigned long requests;
+} vim_channel_t;
+
+/* Function prototypes */
+int vim_channel_open(const char *path, vim_request_handler_t handler);
+void vim_channel_close(void);
+int vim_channel_listen_fd(void);
+int vim_channel_fd(void);
+int vim_channel_events(void);
+void vim_channel_accept(void);
+int vim_channel_handle(int revents);
+void vim_channel_reply(long id, const char *status, const char *key,
+		       const char *value);
+void vim_channel_frame(const char *file, int line);
+int vim_channel_timeout(void);
+void vim_channel_flush(void);
+void vim_channel_print_stats(void);
+
+#endif /* __VIM_CHANNEL_H__ */
@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "watch.h"
+#include "strbuf.h"
+
+static watch_var_t *watches;
+static strbuf_t path_sb;
+static int page_count;
+static unsigned long page_stamp;
+
+static void free_pages(watch_var_t *w);
+
+static void free_watch_vars(watch_var_t *w)
+{
+	watch_var_t *next;
+
+	for (; w; w = next) {
+		next = w->next;
+		free_pages(w);
+		free_watch_vars(w->children);
+		free(w->name);
+		free(w->exp);
+		free(w->value);
+		free(w->type);
+		free(w);
+	}
+}
+
+static void free_pages(watch_var_t *w)
+{
+	watch_page_t *pg;
+
+	while (pg = w->pages) {
+		w->pages = pg->next;
+		free_watch_vars(pg->children);
+		free(pg);
+		page_count--;
+	}
+}
+
+static char *dup_or_null(const char *str)
+{
+	char *dup;
+
+	if (!str)
+		return NULL;
+	if (!(dup = strdup(str)))
+		fprintf(stderr, "Cannot allocate memory\n");
+
+	return dup;
+}
+
+static watch_var_t *new_watch_var(varobj_info_t *vo, watch_var_t *parent)
+{
+	watch_var_t *w;
+
+	if (!(w = (watch_var_t *)calloc(1, sizeof(watch_var_t))) ||
+	    !(w->name = strdup(vo->name))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		free(w);
+		return NULL;
+	}
+	w->exp = dup_or_null(vo->exp);
+	w->value = dup_or_null(vo->value);
+	w->type = dup_or_null(vo->type);
+	w->numchild = vo->numchild;
+	w->parent = parent;
+
+	return w;
+}
+
+static void set_str(char **field, const char *str)
+{
+	free(*field);
+	*field = dup_or_null(str);
+}
+
+/* vo is the reply of -var-create; its exp is what the user typed */
+int watch_add(varobj_info_t *vo)
+{
+	watch_var_t *w, **pp;
+	int n = 1;
+
+	if (!(w = new_watch_var(vo, NULL)))
+		return -1;
+	for (pp = &watches; *pp; pp = &(*pp)->next)
+		n++;
+	*pp = w;
+
+	return n;
+}
+
+static watch_var_t *find_child(watch_var_t *w, const char *name);
+
+static watch_var_t *find_watch_var(watch_var_t *w, const char *name)
+{
+	watch_var_t *found;
+
+	for (; w; w = w->next) {
+		if (!strcmp(w->name, name))
+			return w;
+		/* A child's name starts with its parent's */
+		if ((w->children || w->pages) &&
+		    !strncmp(w->name, name, strlen(w->name)) &&
+		    (found = find_child(w, name)))
+			return found;
+	}
+
+	return NULL;
+}
+
+/* Among the children shown and those of the pages kept */
+static watch_var_t *find_child(watch_var_t *w, const char *name)
+{
+	watch_page_t *pg;
+	watch_var_t *found;
+
+	if (found = find_watch_var(w->children, name))
+		return found;
+	for (pg = w->pages; pg; pg = pg->next)
+		if (found = find_watch_var(pg->children, name))
+			return found;
+
+	return NULL;
+}
+
+watch_var_t *watch_find(const char *name)
+{
+	return find_watch_var(watches, name);
+}
+
+/* Only a watch, not a child, is removed */
+void watch_remove(watch_var_t *w)
+{
+	watch_var_t **pp;
+
+	for (pp = &watches; *pp; pp = &(*pp)->next) {
+		if (*pp == w) {
+			*pp = w->next;
+			w->next = NULL;
+			free_watch_vars(w);
+			return;
+		}
+	}
+}
+
+static int is_ancestor(watch_var_t *a, watch_var_t *w)
+{
+	for (; w; w = w->parent)
+		if (w == a)
+			return 1;
+
+	return 0;
+}
+
+/*
+ * The link to the oldest page under w and its siblings, if it is older
+ * than *oldest. The pages of keep's ancestors stay, keep may be in one.
+ */
+static void find_oldest_page(watch_var_t *w, watch_var_t *keep,
+			     watch_page_t ***oldest)
+{
+	watch_page_t **pp;
+
+	for (; w; w = w->next) {
+		for (pp = &w->pages; *pp; pp = &(*pp)->next) {
+			if (!is_ancestor(w, keep) && (!*oldest ||
+			    (*pp)->stamp < (**oldest)->stamp))
+				*oldest = pp;
+			find_oldest_page((*pp)->children, keep, oldest);
+		}
+		find_oldest_page(w->children, keep, oldest);
+	}
+}
+
+/* The children shown are kept as a page, another window is shown */
+static void stash_children(watch_var_t *w)
+{
+	watch_page_t *pg, **oldest = NULL;
+
+	if (!w->children)
+		return;
+	if (!(pg = (watch_page_t *)calloc(1, sizeof(watch_page_t)))) {
+		fprintf(stderr, "Cannot allocate memory\n");
+		free_watch_vars(w->children);
+		w->children = NULL;
+		return;
+	}
+	pg->from = w->child_from;
+	pg->stamp = ++page_stamp;
+	pg->children = w->children;
+	pg->next = w->pages;
+	w->pages = pg;
+	w->children = NULL;
+
+	if (++page_count <= WATCH_PAGES_MAX)
+		return;
+	find_oldest_page(watches, w, &oldest);
+	if (!oldest)
+		return;
+	pg = *oldest;
+	*oldest = pg->next;
+	free_watch_vars(pg->children);
+	free(pg);
+	page_count--;
+}
+
+/*
+ * children is the reply of -var-list-children, in order, for the
+ * window starting at from. It is shown from now on.
+ */
+void watch_set_children(watch_var_t *w, int from, varobj_info_t *children)
+{
+	watch_var_t **tail;
+
+	if (w->expanded && from != w->child_from)
+		stash_children(w);
+	free_watch_vars(w->children);
+	w->children = NULL;
+	for (tail = &w->children; children; children = children->next)
+		if (*tail = new_watch_var(children, w))
+			tail = &(*tail)->next;
+	w->child_from = from;
+	w->expanded = 1;
+	w->refetch = 0;
+}
+
+/* Shows the window starting at from if it is kept; 0 if it is to be asked */
+int watch_show_page(watch_var_t *w, int from)
+{
+	watch_page_t *pg, **pp;
+
+	if (!w->expanded)
+		return 0;
+	if (from == w->child_from)
+		return 1;
+	for (pp = &w->pages; pg = *pp; pp = &pg->next)
+		if (pg->from == from)
+			break;
+	if (!pg)
+		return 0;
+	*pp = pg->next;
+	page_count--;
+	stash_children(w);
+	w->children = pg->children;
+	w->child_from = from;
+	free(pg);
+
+	return 1;
+}
+
+/* gdb keeps the child varobjs, their changes are simply not shown */
+void watch_collapse(watch_var_t *w)
+{
+	free_pages(w);
+	free_watch_vars(w->children);
+	w->children = NULL;
+	w->child_from = 0;
+	w->expanded = 0;
+	w->refetch = 0;
+}
+
+/*
+ * Applies the changelist of -var-update. An expanded watch whose type
+ * or number of children has changed is marked to be fetched again.
+ * Returns the number of watches changed.
+ */
+int watch_update(varobj_info_t *changes)
+{
+	watch_var_t *w;
+	int n = 0;
+
+	for (; changes; changes = changes->next) {
+		if (!(w = watch_find(changes->name)))
+			continue;
+		if (changes->in_scope == 0)
+			set_str(&w->value, "<out of scope>");
+		else if (changes->in_scope < 0)
+			set_str(&w->value, "<invalid>");
+		else if (changes->value)
+			set_str(&w->value, changes->value);
+		if (changes->type_changed) {
+			set_str(&w->type, changes->type);
+			w->refetch = w->expanded;
+		}
+		if (changes->new_num_children >= 0) {
+			w->numchild = changes->new_num_children;
+			w->refetch = w->expanded;
+		}
+		/* Only the window shown is asked again */
+		if (w->refetch)
+			free_pages(w);
+		w->changed = 1;
+		n++;
+	}
+
+	return n;
+}
+
+static watch_var_t *next_refetch(watch_var_t *w)
+{
+	watch_var_t *found;
+
+	for (; w; w = w->next) {
+		if (w->refetch) {
+			w->refetch = 0;
+			return w;
+		}
+		if (found = next_refetch(w->children))
+			return found;
+	}
+
+	return NULL;
+}
+
+/* An expanded watch whose children are to be asked again, one by one */
+watch_var_t *watch_next_refetch(void)
+{
+	return next_refetch(watches);
+}
+
+int watch_count(void)
+{
+	watch_var_t *w;
+	int n = 0;
+
+	for (w = watches; w; w = w->next)
+		n++;
+
+	return n;
+}
+
+static int is_access_label(const char *exp)
+{
+	return !strcmp(exp, "public") || !strcmp(exp, "private") ||
+	       !strcmp(exp, "protected");
+}
+
+/* s.next.len, a[3]; C++ access labels are not a part of it */
+static void put_path(strbuf_t *sb, watch_var_t *w)
+{
+	if (w->parent)
+		put_path(sb, w->parent);
+	if (!w->exp || is_access_label(w->exp))
+		return;
+	if (!w->parent)
+		strbuf_puts(sb, w->exp);
+	else if (w->exp[strspn(w->exp, "0123456789")] == '\0')
+		strbuf_printf(sb, "[%s]", w->exp);
+	else
+		strbuf_printf(sb, ".%s", w->exp);
+}
+
+static int count_vars(watch_var_t *w)
+{
+	int n = 0;
+
+	for (; w; w = w->next)
+		n++;
+
+	return n;
+}
+
+static void print_watch_var(watch_var_t *w, int n, int depth,
+			    int changed_only)
+{
+	for (; w; w = w->next) {
+		if (!changed_only && depth)
+			printf("%*s%s = %s\n", 3 + 2 * depth, "",
+			       w->exp ? w->exp : w->name,
+			       w->value ? w->value : "");
+		else if (!changed_only || w->changed) {
+			strbuf_reset(&path_sb);
+			put_path(&path_sb, w);
+			printf("%d: %s = %s\n", n, path_sb.str,
+			       w->value ? w->value : "");
+		}
+		w->changed = 0;
+		print_watch_var(w->children, n, depth + 1, changed_only);
+		if (!changed_only && w->children &&
+		    (w->child_from || w->numchild > WATCH_PAGE_SIZE))
+			printf("%*s[%d-%d of %d]\n", 5 + 2 * depth, "",
+			       w->child_from, w->child_from +
+			       count_vars(w->children) - 1, w->numchild);
+		/* Only the watches themselves are numbered */
+		if (!depth)
+			n++;
+	}
+}
+
+static watch_var_t *find_watch_path(watch_var_t *w, const char *path)
+{
+	watch_var_t *found;
+
+	for (; w; w = w->next) {
+		strbuf_reset(&path_sb);
+		put_path(&path_sb, w);
+		if (!strcmp(path_sb.str, path))
+			return w;
+		if (found = find_watch_path(w->children, path))
+			return found;
+	}
+
+	return NULL;
+}
+
+/* A watch by its number, or a watch or a child by its path: s.next */
+watch_var_t *watch_lookup(const char *arg)
+{
+	watch_var_t *w;
+	int n;
+
+	if (*arg && arg[strspn(arg, "0123456789")] == '\0') {
+		for (w = watches, n = atoi(arg); w && --n > 0; w = w->next)
+			;
+		return n == 0 ? w : NULL;
+	}
+
+	return find_watch_path(watches, arg);
+}
+
+/* Either all of the panel, or the lines changed since it was shown */
+void watch_print(int changed_only)
+{
+	print_watch_var(watches, 1, 0, changed_only);
+}
+
+void watch_clear(void)
+{
+	free_watch_vars(watches);
+	watches = NULL;
+}
@@ -0,0 +1,61 @@
+#ifndef __WATCH_H__
+#define __WATCH_H__
+
+#include "mi_parser.h"
+
+/*
+ * The watch panel: expressions kept as gdb/mi variable objects. gdb
+ * remembers their values, so at a stop one "-var-update *" tells which
+ * of them have changed and only those are shown again. The children
+ * of a watch are asked for when it is expanded, and then again only
+ * if their number or the type changes.
+ *
+ * An array of millions of elements is never asked whole: only a window
+ * of WATCH_PAGE_SIZE children is, with "-var-list-children NAME FROM
+ * TO". The windows looked at before are kept as pages, at most
+ * WATCH_PAGES_MAX of them for all watches; the one not shown for the
+ * longest time goes first.
+ */
+#define WATCH_PAGE_SIZE	20
+#define WATCH_PAGES_MAX	32
+#define WATCH_NAME_MAX	256
+
+typedef struct watch_page {
+	int from;		/* index of its first child */
+	unsigned long stamp;
+	struct watch_var *children;
+	struct watch_page *next;
+} watch_page_t;
+
+typedef struct watch_var {
+	char *name;		/* varobj name given by gdb: var1, var1.next */
+	char *exp;		/* expression, or field name of a child */
+	char *value;
+	char *type;
+	int numchild;
+	int expanded;		/* children have been fetched */
+	int child_from;		/* index of the first child shown */
+	int refetch;		/* children are to be fetched again */
+	int changed;		/* not shown since it has changed */
+	struct watch_var *parent;
+	struct watch_var *children;
+	struct watch_page *pages;	/* windows shown before */
+	struct watch_var *next;
+} watch_var_t;
+
+/* Function prototypes */
+int watch_add(varobj_info_t *vo);
+watch_var_t *watch_lookup(const char *arg);
+watch_var_t *watch_find(const char *name);
+void watch_remove(watch_var_t *w);
+void watch_set_children(watch_var_t *w, int from,
+			varobj_info_t *children);
+int watch_show_page(watch_var_t *w, int from);
+void watch_collapse(watch_var_t *w);
+int watch_update(varobj_info_t *changes);
+watch_var_t *watch_next_refetch(void);
+int watch_count(void);
+void watch_print(int changed_only);
+void watch_clear(void);
+
+#endif /* __WATCH_H__ */